@@ -3,12 +3,205 @@ using System.Collections;
 using System;
 using System.Threading;
 using System.Runtime.InteropServices;
+using System.Security;
 using UnityEngine.Rendering;
+using UnityEngine.Experimental.Rendering;
 using Unity.Collections;
 using Unity.Collections.LowLevel.Unsafe;
 
 namespace AsyncGPUReadbackPluginNs {
 
+	/// <summary>
+	/// How the native plugin detects that a request is done
+	/// </summary>
+	public enum FenceWaitStrategy
+	{
+		/// <summary>Non-blocking check on each Update() (default)</summary>
+		Poll = 0,
+		/// <summary>Block the render thread up to a timeout on each Update()</summary>
+		ClientWait = 1,
+		/// <summary>A native thread waits for requests and completes them as soon as they are ready</summary>
+		Thread = 2
+	}
+
+	/// <summary>
+	/// Urgency of a request for the native plugin, the most urgent requests are issued first
+	/// </summary>
+	public enum RequestPriority
+	{
+		/// <summary>Background captures, limited by the bulk budget of each frame (see SetBulkBudget)</summary>
+		Bulk = 0,
+		/// <summary>Issued right away (default)</summary>
+		Normal = 1,
+		/// <summary>Issued right away, before any other pending request</summary>
+		High = 2
+	}
+
+	/// <summary>
+	/// YUV 4:2:0 layout (BT.601, limited range) the native plugin converts a texture to before reading it back
+	/// </summary>
+	public enum YuvFormat
+	{
+		/// <summary>Y plane, then interleaved UV plane</summary>
+		Nv12 = 1,
+		/// <summary>Y plane, then U plane, then V plane</summary>
+		I420 = 2
+	}
+
+	/// <summary>
+	/// Reduction the native plugin runs on the GPU, reading back only its result
+	/// </summary>
+	public enum ReductionType
+	{
+		/// <summary>Minimum, maximum and mean of each channel: an AsyncGPUReadbackPluginReductionStats</summary>
+		Stats = 1,
+		/// <summary>Histograms of R, G, B and luminance of values in [0, 1]: 4 x bins uint counts</summary>
+		Histogram = 2
+	}
+
+	/// <summary>
+	/// Result of a ReductionType.Stats request
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct AsyncGPUReadbackPluginReductionStats
+	{
+		public Vector4 minimum;
+		public Vector4 maximum;
+		public Vector4 mean;
+		public uint pixelCount;
+		private uint padding0;
+		private uint padding1;
+		private uint padding2;
+	}
+
+	/// <summary>
+	/// How the native plugin backs the data buffers with huge pages
+	/// </summary>
+	public enum HugePageMode
+	{
+		/// <summary>Regular pages (default)</summary>
+		None = 0,
+		/// <summary>Transparent huge pages asked with madvise on buffers of 2MB or more</summary>
+		Madvise = 1,
+		/// <summary>Explicit huge pages (MAP_HUGETLB), regular pages if none are reserved by the system</summary>
+		HugeTlb = 2
+	}
+
+	/// <summary>
+	/// How the native plugin backs its pixel buffers with host memory
+	/// </summary>
+	public enum PinnedMemoryMode
+	{
+		/// <summary>Not supported or disabled: the data is copied out of the pixel buffers</summary>
+		None = 0,
+		/// <summary>Buffer storage in client memory (GL_ARB_buffer_storage), persistently mapped</summary>
+		ClientStorage = 1,
+		/// <summary>Memory allocated by the plugin and pinned by the driver (GL_AMD_pinned_memory)</summary>
+		Amd = 2
+	}
+
+	/// <summary>
+	/// Encoder of a native video sink
+	/// </summary>
+	public enum VideoEncoderType
+	{
+		/// <summary>libx264 through an ffmpeg process, in the container guessed from the path (ffmpeg has to be installed)</summary>
+		FFmpeg = 0,
+		/// <summary>Raw NV12 frames, one after the other</summary>
+		RawNv12 = 1
+	}
+
+	/// <summary>
+	/// Counters of a native video sink
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct AsyncGPUReadbackPluginVideoSinkStats
+	{
+		public long framesCaptured;
+		public long framesEncoded;
+		/// <summary>Frames dropped because the readback or the encoder was late</summary>
+		public long framesDropped;
+		public long errors;
+	}
+
+	/// <summary>
+	/// How a native disk writer writes its files
+	/// </summary>
+	public enum DiskWriterBackend
+	{
+		/// <summary>io_uring, with batched submissions. Falls back to Threads when the system doesn't allow it</summary>
+		IoUring = 0,
+		/// <summary>Pool of threads writing with pwrite</summary>
+		Threads = 1
+	}
+
+	/// <summary>
+	/// What the native plugin does with the hash of the data of a request
+	/// </summary>
+	public enum HashMode
+	{
+		/// <summary>Only hash the data (see AsyncGPUReadbackPluginRequest.hash)</summary>
+		Hash = 0,
+		/// <summary>Deliver no data for a frame identical to the previous one of its stream (see AsyncGPUReadbackPluginRequest.isDuplicate)</summary>
+		SuppressDuplicates = 1
+	}
+
+	/// <summary>
+	/// Counters of a native disk writer
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct AsyncGPUReadbackPluginDiskWriterStats
+	{
+		public long filesReceived;
+		public long filesWritten;
+		/// <summary>Files dropped because too many were waiting to be written</summary>
+		public long filesDropped;
+		public long errors;
+		public long bytesWritten;
+		/// <summary>Backend in use</summary>
+		public DiskWriterBackend backend;
+		/// <summary>1 if the files are written with O_DIRECT</summary>
+		public int directIo;
+	}
+
+	/// <summary>
+	/// Memory usage of the native data buffers, in bytes and number of calls
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct AsyncGPUReadbackPluginMemoryStats
+	{
+		public long bytesInUse;
+		public long bytesCached;
+		public long peakBytesInUse;
+		public long allocations;
+		public long reuses;
+		public long mmapCalls;
+		public long munmapCalls;
+		public long hugePageAllocations;
+	}
+
+	/// <summary>
+	/// Counters of the native transfer scheduler, in bytes and number of requests
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct AsyncGPUReadbackPluginSchedulerStats
+	{
+		/// <summary>Current bytes per frame budget, lowered while fences are late. 0 if unlimited</summary>
+		public long budgetBytes;
+		public long lastFrameBytes;
+		/// <summary>Requests and bytes that had to wait for a later frame</summary>
+		public long deferredRequests;
+		public long deferredBytes;
+		/// <summary>Requests and bytes waiting right now</summary>
+		public long pendingRequests;
+		public long pendingBytes;
+		public long expiredRequests;
+		/// <summary>Highest fence latency seen during the last frame, in frames. -1 if no fence signaled</summary>
+		public long lastFenceLatencyFrames;
+		/// <summary>Requests that shared the read of another one (see SetCoalescing)</summary>
+		public long coalescedRequests;
+	}
+
 	// Tries to match the official API
 	public class AsyncGPUReadbackPlugin
 	{
@@ -16,6 +209,536 @@ namespace AsyncGPUReadbackPluginNs {
 		{
 			return new AsyncGPUReadbackPluginRequest(src);
 		}
+
+		/// <summary>
+		/// Request a texture, copying the result straight into memory you own.
+		/// The memory has to stay valid (pinned) until the request is done or disposed.
+		/// </summary>
+		public static AsyncGPUReadbackPluginRequest Request(Texture src, IntPtr destination, long capacity)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, destination, capacity);
+		}
+
+		/// <summary>
+		/// Request a texture, copying the result straight into a NativeArray.
+		/// The array has to stay allocated until the request is done or disposed.
+		/// </summary>
+		public static unsafe AsyncGPUReadbackPluginRequest Request<T>(Texture src, NativeArray<T> destination) where T : struct
+		{
+			IntPtr ptr = new IntPtr(NativeArrayUnsafeUtility.GetUnsafePtr(destination));
+			return new AsyncGPUReadbackPluginRequest(src, ptr, destination.Length * UnsafeUtility.SizeOf<T>());
+		}
+
+		/// <summary>
+		/// Same as Request(src), returning a struct handle instead of an object:
+		/// steady-state capture with handles makes no managed allocation.
+		/// </summary>
+		public static AsyncGPUReadbackPluginHandle RequestHandle(Texture src)
+		{
+			return AsyncGPUReadbackPluginHandle.Create(src, IntPtr.Zero, 0);
+		}
+
+		/// <summary>
+		/// Same as Request(src, destination, capacity), returning a struct handle instead of an object.
+		/// </summary>
+		public static AsyncGPUReadbackPluginHandle RequestHandle(Texture src, IntPtr destination, long capacity)
+		{
+			return AsyncGPUReadbackPluginHandle.Create(src, destination, capacity);
+		}
+
+		/// <summary>
+		/// Reduce a texture on the GPU and read back only the result: GetData&lt;AsyncGPUReadbackPluginReductionStats&gt;()
+		/// for ReductionType.Stats, GetData&lt;uint&gt;() (R, G, B then luminance bins) for ReductionType.Histogram.
+		/// Only with the native plugin, the handle has an error otherwise.
+		/// </summary>
+		/// <param name="bins">Number of bins of the histograms, up to 256</param>
+		public static AsyncGPUReadbackPluginHandle RequestHandle(Texture src, ReductionType reduction, int bins = 64)
+		{
+			return AsyncGPUReadbackPluginHandle.Create(src, reduction, bins);
+		}
+
+		/// <summary>
+		/// Read back only the texels at some points (picking, probes), gathered on the GPU: GetData&lt;Vector4&gt;()
+		/// gives one value per point, GetData&lt;int&gt;() or GetData&lt;uint&gt;() 4 per point for integer textures.
+		/// Points outside the texture give zeros. Only with the native plugin, the handle has an error otherwise.
+		/// </summary>
+		/// <param name="points">Coordinates of the points, origin at the bottom left (copied)</param>
+		/// <param name="count">Number of points to read from the array</param>
+		public static AsyncGPUReadbackPluginHandle RequestHandle(Texture src, Vector2Int[] points, int count)
+		{
+			return AsyncGPUReadbackPluginHandle.Create(src, points, count);
+		}
+
+		/// <summary>
+		/// Create the requests submitted from other threads (AsyncGPUReadbackPluginHandle.Submit)
+		/// and complete them. Call it once per frame from the main thread.
+		/// </summary>
+		public static void UpdateSubmitted()
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				AsyncGPUReadbackPluginRequest.ScheduleFrame();
+				GL.IssuePluginEvent(getfunction_updateBatches_renderThread(), 0);
+			}
+		}
+
+		/// <summary>
+		/// Request a region of a texture level
+		/// </summary>
+		public static AsyncGPUReadbackPluginRequest Request(Texture src, int mipIndex, int x, int width, int y, int height)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, mipIndex, x, width, y, height);
+		}
+
+		/// <summary>
+		/// Request a texture with a given urgency.
+		/// With the native plugin, a request whose read is not issued within deadlineMilliseconds is dropped (hasError).
+		/// </summary>
+		/// <param name="deadlineMilliseconds">0 for no deadline</param>
+		public static AsyncGPUReadbackPluginRequest Request(Texture src, RequestPriority priority, int deadlineMilliseconds = 0)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, priority, deadlineMilliseconds);
+		}
+
+		/// <summary>
+		/// Request a texture converted to YUV on the GPU, 1.5 bytes per pixel.
+		/// The width and height have to be even. With the official api, the data stays RGBA.
+		/// </summary>
+		public static AsyncGPUReadbackPluginRequest Request(Texture src, YuvFormat format)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, format);
+		}
+
+		/// <summary>
+		/// Request a large texture (atlas, lightmap, screenshot) read by bands of chunkRows rows,
+		/// chunksPerFrame bands per frame, to keep frame times smooth. See progress.
+		/// With the official api, the texture is read at once.
+		/// </summary>
+		public static AsyncGPUReadbackPluginRequest RequestChunked(Texture src, int chunkRows, int chunksPerFrame = 1)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, chunkRows, chunksPerFrame);
+		}
+
+		/// <summary>
+		/// Request a texture whose data is written to a file by a native disk writer (see CreateDiskWriter),
+		/// instead of being kept: GetRawData gives no data. With the official api, the request keeps its data.
+		/// </summary>
+		/// <param name="fileIndex">Index of the file, -1 for the next index of the writer. Receives the index used</param>
+		public static AsyncGPUReadbackPluginRequest RequestToDisk(Texture src, int diskWriterId, ref int fileIndex)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, diskWriterId, ref fileIndex);
+		}
+
+		/// <summary>
+		/// Request a texture whose data is hashed by the native plugin while it is copied out of the GPU buffer.
+		/// With HashMode.SuppressDuplicates, a frame identical to the previous completed frame of the stream
+		/// is done without data (isDuplicate), saving its encoding or storage. Can be combined with a disk writer
+		/// by the native api only. With the official api, the data is not hashed.
+		/// </summary>
+		/// <param name="stream">Stream the frame is compared with, greater than 0, e.g. one per camera</param>
+		public static AsyncGPUReadbackPluginRequest Request(Texture src, HashMode mode, int stream = 1)
+		{
+			return new AsyncGPUReadbackPluginRequest(src, mode, stream);
+		}
+
+		/// <summary>
+		/// Forget the last frame of a hash stream: its next frame is never a duplicate, e.g. after a cut
+		/// </summary>
+		public static void ResetHashStream(int stream)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				return;
+			}
+			resetHashStream(stream);
+		}
+
+		/// <summary>
+		/// Limit the bytes of RequestPriority.Bulk requests the native plugin issues per frame,
+		/// the others wait for the next frames.
+		/// </summary>
+		/// <param name="bytesPerFrame">0 for no limit (default)</param>
+		public static void SetBulkBudget(long bytesPerFrame)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setBulkBudget(bytesPerFrame);
+			}
+		}
+
+		/// <summary>
+		/// Limit the bytes the native plugin reads per frame (RequestPriority.High requests excepted),
+		/// the other requests wait for the next frames.
+		/// </summary>
+		/// <param name="bytesPerFrame">0 for no limit (default)</param>
+		/// <param name="maxFenceLatencyFrames">Adaptive throttling: the budget is halved each frame a request takes
+		/// more than this number of frames to complete on the GPU, and grows back otherwise. 0 to disable</param>
+		public static void SetFrameBudget(long bytesPerFrame, int maxFenceLatencyFrames = 0)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setFrameBudget(bytesPerFrame, maxFenceLatencyFrames);
+			}
+		}
+
+		/// <summary>
+		/// Counters of the native transfer scheduler (current budget, deferred bytes...)
+		/// </summary>
+		public static AsyncGPUReadbackPluginSchedulerStats GetSchedulerStats()
+		{
+			AsyncGPUReadbackPluginSchedulerStats stats;
+			getSchedulerStats(out stats);
+			return stats;
+		}
+
+		/// <summary>
+		/// Create a native video sink, encoding the frames of a texture to a video file on its own thread
+		/// (RGBA to NV12 conversion, then encoding), without going through C# for each frame.
+		/// Frames are captured each time the CommandBuffer given to CaptureVideoSink is executed.
+		/// Only for the native plugin (OpenGL).
+		/// </summary>
+		/// <param name="options">Encoder options, e.g. "-c:v libx264 -preset fast -crf 18" for FFmpeg (arguments split on whitespace, no shell). null for the defaults</param>
+		/// <returns>Sink id, 0 if the arguments are invalid, the texture is an integer or depth one, or the native plugin is not used</returns>
+		public static int CreateVideoSink(Texture src, string path, int fps, VideoEncoderType encoder = VideoEncoderType.FFmpeg, string options = null)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				return 0;
+			}
+			// Frames are read as color: the native side can't check the format without the render thread
+			GraphicsFormat format = src.graphicsFormat;
+			if (GraphicsFormatUtility.IsIntegerFormat(format) || GraphicsFormatUtility.IsDepthFormat(format) || GraphicsFormatUtility.IsStencilFormat(format)) {
+				return 0;
+			}
+			return createVideoSink((int)(src.GetNativeTexturePtr()), src.width, src.height, path, fps, (int)encoder, options);
+		}
+
+		/// <summary>
+		/// Capture a frame for a video sink each time the command buffer is executed,
+		/// e.g. a command buffer added to a camera with Camera.AddCommandBuffer.
+		/// </summary>
+		public static void CaptureVideoSink(int sinkId, CommandBuffer commandBuffer)
+		{
+			commandBuffer.IssuePluginEvent(getfunction_captureVideoSink_renderThread(), sinkId);
+		}
+
+		/// <summary>
+		/// Stop a video sink and close its file, once the frames already read are encoded.
+		/// Remove the command buffers capturing for it first.
+		/// </summary>
+		public static void CloseVideoSink(int sinkId)
+		{
+			closeVideoSink(sinkId);
+		}
+
+		public static AsyncGPUReadbackPluginVideoSinkStats GetVideoSinkStats(int sinkId)
+		{
+			AsyncGPUReadbackPluginVideoSinkStats stats = new AsyncGPUReadbackPluginVideoSinkStats();
+			getVideoSinkStats(sinkId, out stats);
+			return stats;
+		}
+
+		/// <summary>
+		/// Create a native disk writer, e.g. to capture a dataset: the data of the requests made with
+		/// RequestToDisk is written to one file each on native threads, without going through C#.
+		/// Files are raw data, bottom-up rows. Only for the native plugin (OpenGL, Linux).
+		/// </summary>
+		/// <param name="pathFormat">Path of the files, with one integer format for their index, e.g. "/data/frame_%06d.raw"</param>
+		/// <param name="directIo">Bypass the page cache (O_DIRECT) where the file system supports it</param>
+		/// <param name="threads">Writer threads of DiskWriterBackend.Threads</param>
+		/// <param name="maxQueued">Files waiting to be written, the next ones are dropped (their request is in error)</param>
+		/// <returns>Writer id, 0 if the arguments are invalid or the native plugin is not used</returns>
+		public static int CreateDiskWriter(string pathFormat, int firstIndex = 0, DiskWriterBackend backend = DiskWriterBackend.IoUring,
+			bool directIo = true, int threads = 4, int maxQueued = 64)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				return 0;
+			}
+			return createDiskWriter(pathFormat, firstIndex, (int)backend, directIo, threads, maxQueued);
+		}
+
+		/// <summary>
+		/// Stop a disk writer once the files already queued are written.
+		/// Blocks until then. Returns the final counters.
+		/// </summary>
+		public static AsyncGPUReadbackPluginDiskWriterStats CloseDiskWriter(int writerId)
+		{
+			AsyncGPUReadbackPluginDiskWriterStats stats = new AsyncGPUReadbackPluginDiskWriterStats();
+			closeDiskWriter(writerId, out stats);
+			return stats;
+		}
+
+		public static AsyncGPUReadbackPluginDiskWriterStats GetDiskWriterStats(int writerId)
+		{
+			AsyncGPUReadbackPluginDiskWriterStats stats = new AsyncGPUReadbackPluginDiskWriterStats();
+			getDiskWriterStats(writerId, out stats);
+			return stats;
+		}
+
+		/// <summary>
+		/// Create a latest-frame mailbox for a live preview or a remote viewer: the texture is read
+		/// continuously each time the CommandBuffer given to CaptureMailbox is executed, and
+		/// AcquireMailboxFrame gives the newest completed frame. Only for the native plugin (OpenGL).
+		/// </summary>
+		/// <returns>Mailbox id, 0 if the native plugin is not used</returns>
+		public static int CreateMailbox(Texture src)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				return 0;
+			}
+			return createMailbox((int)(src.GetNativeTexturePtr()), src.width, src.height);
+		}
+
+		/// <summary>
+		/// Capture a frame for a mailbox each time the command buffer is executed, if a slot is free.
+		/// </summary>
+		public static void CaptureMailbox(int mailboxId, CommandBuffer commandBuffer)
+		{
+			commandBuffer.IssuePluginEvent(getfunction_captureMailbox_renderThread(), mailboxId);
+		}
+
+		/// <summary>
+		/// Acquire the newest completed frame of a mailbox, without copy. The frame acquired
+		/// before is released. Warning: data is only valid until the frame is released.
+		/// </summary>
+		/// <param name="frame">Plugin frame the frame was captured in</param>
+		/// <returns>false if no frame completed since the last acquire</returns>
+		public static unsafe bool AcquireMailboxFrame<T>(int mailboxId, out NativeArray<T> data, out uint frame) where T : struct
+		{
+			IntPtr buffer;
+			int length;
+			if (!acquireMailboxFrame(mailboxId, out buffer, out length, out frame)) {
+				data = default(NativeArray<T>);
+				return false;
+			}
+			data = NativeArrayUnsafeUtility.ConvertExistingDataToNativeArray<T>(buffer.ToPointer(), length / UnsafeUtility.SizeOf<T>(), Allocator.None);
+#if ENABLE_UNITY_COLLECTIONS_CHECKS
+			NativeArrayUnsafeUtility.SetAtomicSafetyHandle(ref data, AtomicSafetyHandle.GetTempUnsafePtrSliceHandle());
+#endif
+			return true;
+		}
+
+		/// <summary>
+		/// Release the acquired frame of a mailbox, so that its slot is reused by the next captures.
+		/// </summary>
+		public static void ReleaseMailboxFrame(int mailboxId)
+		{
+			releaseMailboxFrame(mailboxId);
+		}
+
+		/// <summary>
+		/// Close a mailbox, its frames are not valid anymore. Remove the command buffers capturing for it first.
+		/// </summary>
+		public static void CloseMailbox(int mailboxId)
+		{
+			closeMailbox(mailboxId);
+		}
+
+		/// <summary>
+		/// Forget the texture informations cached by the native plugin for this texture.
+		/// Call it if you change the format of a texture without changing its size.
+		/// </summary>
+		/// <param name="src"></param>
+		public static void InvalidateTextureCache(Texture src)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				invalidateTextureInfo((int)(src.GetNativeTexturePtr()));
+			}
+		}
+
+		/// <summary>
+		/// Select how the native plugin detects that the next requests are done.
+		/// </summary>
+		/// <param name="strategy"></param>
+		/// <param name="timeoutMicroseconds">Maximum time the render thread blocks on each Update() with FenceWaitStrategy.ClientWait</param>
+		public static void SetFenceWaitStrategy(FenceWaitStrategy strategy, int timeoutMicroseconds = 1000)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setFenceWaitStrategy((int)strategy, timeoutMicroseconds);
+			}
+		}
+
+		/// <summary>
+		/// Let the native requests of a frame for the same texture, mip level, region and format
+		/// share one read and one data buffer (enabled by default). Requests with a destination
+		/// or a deadline always do their own read.
+		/// </summary>
+		public static void SetCoalescing(bool enabled)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setCoalescing(enabled);
+			}
+		}
+
+		/// <summary>
+		/// Leave the data of the next native requests in their GPU buffer once done: it is only copied
+		/// when asked for (GetRawData, GetData), or partly with GetRawData(offset, length) / CopyData,
+		/// so dropped frames cost no copy. Disabled by default.
+		/// </summary>
+		public static void SetLazyMapping(bool enabled)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setLazyMapping(enabled);
+			}
+		}
+
+		/// <summary>
+		/// Let the GPU write the data of the next native requests straight into host memory, when the
+		/// driver supports it, instead of copying it out of a GPU buffer (enabled by default).
+		/// Requests with a destination, lazy mapping, reductions and gathers are always copied.
+		/// </summary>
+		public static void SetPinnedMemory(bool enabled)
+		{
+			if (!SystemInfo.supportsAsyncGPUReadback) {
+				setPinnedMemory(enabled);
+			}
+		}
+
+		/// <summary>
+		/// How the native plugin backs its pixel buffers with host memory, None until the plugin
+		/// was initialized on the render thread
+		/// </summary>
+		public static PinnedMemoryMode GetPinnedMemoryMode()
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				return PinnedMemoryMode.None;
+			}
+			return (PinnedMemoryMode)getPinnedMemoryMode();
+		}
+
+		/// <summary>
+		/// Start or stop recording native trace events (requests, fence checks, copies, GL errors...).
+		/// Recording is cheap enough to be left on, older events are overwritten.
+		/// </summary>
+		public static void SetTraceEnabled(bool enabled)
+		{
+			setTraceEnabled(enabled);
+		}
+
+		/// <summary>
+		/// Write the recorded trace events to a file that chrome://tracing or Perfetto can open.
+		/// </summary>
+		/// <returns>Number of events written, -1 if the file can't be opened</returns>
+		public static int DumpTrace(string path)
+		{
+			return dumpTrace(path);
+		}
+
+		/// <summary>
+		/// Record every call into the native plugin, with its timestamp and the size and format of the
+		/// textures read, to a file that ReadbackReplay can replay offline. Texture contents are not recorded.
+		/// </summary>
+		/// <returns>false if the file can't be created</returns>
+		public static bool StartCallRecording(string path)
+		{
+			return startCallRecording(path);
+		}
+
+		/// <summary>
+		/// Stop recording the calls and close the file.
+		/// </summary>
+		public static void StopCallRecording()
+		{
+			stopCallRecording();
+		}
+
+		/// <summary>
+		/// Maximum number of pixel buffers kept for the next requests, 8 by default.
+		/// </summary>
+		public static void SetPboPoolSize(int count)
+		{
+			setPboPoolSize(count);
+		}
+
+		/// <summary>
+		/// Configure the allocator of the native data buffers.
+		/// </summary>
+		/// <param name="hugePages"></param>
+		/// <param name="maxCachedBytes">Maximum size of the disposed buffers kept for the next requests</param>
+		public static void SetAllocatorOptions(HugePageMode hugePages, long maxCachedBytes = 256 * 1024 * 1024)
+		{
+			setAllocatorOptions((int)hugePages, maxCachedBytes);
+		}
+
+		/// <summary>
+		/// Prepare (map and pre-fault) native data buffers before starting to capture a stream of frames,
+		/// so that its first frames don't page fault.
+		/// </summary>
+		/// <param name="frameSize">Size in bytes of each frame</param>
+		/// <param name="count">Number of buffers, usually the number of requests in flight</param>
+		/// <returns>Number of buffers actually prepared</returns>
+		public static int ReserveBuffers(int frameSize, int count)
+		{
+			return reserveBuffers(frameSize, count);
+		}
+
+		/// <summary>
+		/// Memory usage counters of the native data buffers
+		/// </summary>
+		public static AsyncGPUReadbackPluginMemoryStats GetMemoryStats()
+		{
+			AsyncGPUReadbackPluginMemoryStats stats;
+			getMemoryStats(out stats);
+			return stats;
+		}
+
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void invalidateTextureInfo(int texture);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int createVideoSink(int texture, int width, int height, string path, int fps, int encoder, string options);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_captureVideoSink_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_updateBatches_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void closeVideoSink(int sink_id);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool getVideoSinkStats(int sink_id, out AsyncGPUReadbackPluginVideoSinkStats stats);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int createMailbox(int texture, int width, int height);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_captureMailbox_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool acquireMailboxFrame(int mailbox_id, out IntPtr buffer, out int length, out uint frame);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void releaseMailboxFrame(int mailbox_id);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void closeMailbox(int mailbox_id);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int createDiskWriter(string path_format, int first_index, int backend, bool direct_io, int threads, int max_queued);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool getDiskWriterStats(int writer_id, out AsyncGPUReadbackPluginDiskWriterStats stats);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool closeDiskWriter(int writer_id, out AsyncGPUReadbackPluginDiskWriterStats stats);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setBulkBudget(long bytes_per_frame);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setFrameBudget(long bytes_per_frame, int max_latency_frames);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void getSchedulerStats(out AsyncGPUReadbackPluginSchedulerStats stats);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setAllocatorOptions(int huge_pages, long max_cached_bytes);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int reserveBuffers(int size, int count);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void getMemoryStats(out AsyncGPUReadbackPluginMemoryStats stats);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setCoalescing(bool enabled);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setLazyMapping(bool enabled);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setPinnedMemory(bool enabled);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int getPinnedMemoryMode();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setTraceEnabled(bool enabled);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int dumpTrace(string path);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setFenceWaitStrategy(int strategy, int timeout_us);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void resetHashStream(int stream);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool startCallRecording(string path);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void stopCallRecording();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setPboPoolSize(int count);
 	}
 
 	public class AsyncGPUReadbackPluginRequest
@@ -27,61 +750,272 @@ namespace AsyncGPUReadbackPluginNs {
 		private bool usePlugin;
 
 		/// <summary>
-		/// Official api request object used if supported
+		/// Official api request object used if supported
+		/// </summary>
+		private AsyncGPUReadbackRequest gpuRequest;
+
+		/// <summary>
+		/// Event Id used to tell what texture is targeted to the render thread
+		/// </summary>
+		private int eventId;
+
+		/// <summary>
+		/// Caller-provided destination of the data, IntPtr.Zero if none
+		/// </summary>
+		private IntPtr destination = IntPtr.Zero;
+		private long destinationCapacity = 0;
+		private bool destinationFilled = false;
+
+		/// <summary>
+		/// Last frame the native scheduler was run
+		/// </summary>
+		private static int lastScheduledFrame = -1;
+
+		// Native RequestStatus flag of a duplicate frame
+		private const int StatusDuplicate = 16;
+
+		/// <summary>
+		/// Check if the request is done
+		/// </summary>
+		public bool done
+	    {
+	        get
+	        {
+				if (usePlugin) {
+					return isRequestDone(eventId);
+				}
+				else {
+					if (gpuRequest.done) {
+						FillDestination();
+					}
+					return gpuRequest.done;
+				}
+	        }
+	    }
+
+		/// <summary>
+		/// Check if the request has an error
+		/// </summary>
+		public bool hasError
+	    {
+	        get
+	        {
+				if (usePlugin) {
+					return isRequestError(eventId);
+				}
+				else {
+					return gpuRequest.hasError;
+				}
+	        }
+	    }
+
+		/// <summary>
+		/// Part of the request completed, from 0 to 1 (see AsyncGPUReadbackPlugin.RequestChunked)
+		/// </summary>
+		public float progress
+		{
+			get
+			{
+				if (usePlugin) {
+					return getRequestProgress(eventId);
+				}
+				else {
+					return gpuRequest.done ? 1 : 0;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Hash of the data once done (see AsyncGPUReadbackPlugin.Request with a HashMode),
+		/// the same for the same data. 0 with the official api
+		/// </summary>
+		public ulong hash
+		{
+			get
+			{
+				ulong value = 0;
+				if (usePlugin && !getRequestHash(eventId, out value)) {
+					value = 0;
+				}
+				return value;
+			}
+		}
+
+		/// <summary>
+		/// The data is the same as the previous frame of its hash stream, and is not delivered:
+		/// GetRawData gives no data. Never with the official api
+		/// </summary>
+		public bool isDuplicate
+		{
+			get
+			{
+				if (usePlugin) {
+					return (getRequestStatus(eventId, IntPtr.Zero, IntPtr.Zero) & StatusDuplicate) != 0;
+				}
+				return false;
+			}
+		}
+
+		/// <summary>
+		/// Create an AsyncGPUReadbackPluginRequest.
+		/// Use official AsyncGPUReadback.Request if possible.
+		/// If not, it tries to use OpenGL specific implementation
+		/// Warning! Can only be called from render thread yet (not main thread)
+		/// </summary>
+		/// <param name="src"></param>
+		/// <returns></returns>
+		public AsyncGPUReadbackPluginRequest(Texture src)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
+
+		/// <summary>
+		/// Create an AsyncGPUReadbackPluginRequest reading only a region of a texture level.
+		/// </summary>
+		public AsyncGPUReadbackPluginRequest(Texture src, int mipIndex, int x, int width, int y, int height)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src, mipIndex, x, width, y, height, 0, 1);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				int levelWidth = Math.Max(1, src.width >> mipIndex);
+				int levelHeight = Math.Max(1, src.height >> mipIndex);
+				this.eventId = makeRequestWithSize_mainThread(textureId, mipIndex, levelWidth, levelHeight);
+				setRequestRegion(this.eventId, x, y, width, height);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
+
+		/// <summary>
+		/// Create an AsyncGPUReadbackPluginRequest copying the result into a caller-provided destination.
 		/// </summary>
-		private AsyncGPUReadbackRequest gpuRequest;
+		public AsyncGPUReadbackPluginRequest(Texture src, IntPtr destination, long capacity)
+		{
+			this.destination = destination;
+			this.destinationCapacity = capacity;
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestDestination(this.eventId, destination, capacity);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
 
 		/// <summary>
-		/// Event Id used to tell what texture is targeted to the render thread
+		/// Create an AsyncGPUReadbackPluginRequest with a given urgency.
+		/// The official api has no priorities, the request is made right away.
 		/// </summary>
-		private int eventId;
+		public AsyncGPUReadbackPluginRequest(Texture src, RequestPriority priority, int deadlineMilliseconds)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestPriority(this.eventId, (int)priority, deadlineMilliseconds);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
 
 		/// <summary>
-		/// Is buffer allocated
+		/// Create an AsyncGPUReadbackPluginRequest converting the texture to YUV before the read.
+		/// The official api has no conversion, the data stays RGBA.
 		/// </summary>
-		private bool bufferCreated = false;
+		public AsyncGPUReadbackPluginRequest(Texture src, YuvFormat format)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestYuv(this.eventId, (int)format);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
 
-		/// <summary>
-		/// Check if the request is done
-		/// </summary>
-		public bool done
-	    {
-	        get
-	        {
-				if (usePlugin) {
-					return isRequestDone(eventId);
-				}
-				else {
-					return gpuRequest.done;
-				}
-	        }
-	    }
+		public AsyncGPUReadbackPluginRequest(Texture src, int chunkRows, int chunksPerFrame)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestChunks(this.eventId, chunkRows, chunksPerFrame);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
 
 		/// <summary>
-		/// Check if the request has an error
+		/// Create an AsyncGPUReadbackPluginRequest whose data is written to a file by a native disk writer.
+		/// The official api has no disk writer, the request keeps its data.
 		/// </summary>
-		public bool hasError
-	    {
-	        get
-	        {
-				if (usePlugin) {
-					return isRequestError(eventId);
-				}
-				else {
-					return gpuRequest.hasError;
-				}
-	        }
-	    }
+		public AsyncGPUReadbackPluginRequest(Texture src, int diskWriterId, ref int fileIndex)
+		{
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				usePlugin = false;
+				gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if(isCompatible()) {
+				usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				fileIndex = setRequestDiskWriter(this.eventId, diskWriterId, fileIndex);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+		}
 
 		/// <summary>
-		/// Create an AsyncGPUReadbackPluginRequest.
-		/// Use official AsyncGPUReadback.Request if possible.
-		/// If not, it tries to use OpenGL specific implementation
-		/// Warning! Can only be called from render thread yet (not main thread)
+		/// Create an AsyncGPUReadbackPluginRequest whose data is hashed while it is copied.
+		/// The official api has no hash, the request is made right away.
 		/// </summary>
-		/// <param name="src"></param>
-		/// <returns></returns>
-		public AsyncGPUReadbackPluginRequest(Texture src)
+		public AsyncGPUReadbackPluginRequest(Texture src, HashMode mode, int stream)
 		{
 			if (SystemInfo.supportsAsyncGPUReadback) {
 				usePlugin = false;
@@ -90,7 +1024,8 @@ namespace AsyncGPUReadbackPluginNs {
 			else if(isCompatible()) {
 				usePlugin = true;
 				int textureId = (int)(src.GetNativeTexturePtr());
-				this.eventId = makeRequest_mainThread(textureId, 0);
+				this.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestHashing(this.eventId, (mode == HashMode.SuppressDuplicates) ? Math.Max(1, stream) : 0);
 				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), this.eventId);
 			}
 			else {
@@ -98,18 +1033,36 @@ namespace AsyncGPUReadbackPluginNs {
 			}
 		}
 
+		/// <summary>
+		/// With the official api, copy the data to the caller-provided destination once
+		/// </summary>
+		private unsafe void FillDestination()
+		{
+			if (destination == IntPtr.Zero || destinationFilled || gpuRequest.hasError) {
+				return;
+			}
+			NativeArray<byte> data = gpuRequest.GetData<byte>();
+			UnsafeUtility.MemCpy(destination.ToPointer(), NativeArrayUnsafeUtility.GetUnsafeReadOnlyPtr(data), Math.Min((long)data.Length, destinationCapacity));
+			destinationFilled = true;
+		}
+
 		public unsafe byte[] GetRawData()
 		{
 			if (usePlugin) {
 				// Get data from cpp plugin
 				void* ptr = null;
-				int length = 0;
+				long length = 0;
 				getData_mainThread(this.eventId, ref ptr, ref length);
+				if (ptr == null) {
+					return new byte[0];
+				}
+				if (length > int.MaxValue) {
+					throw new InvalidOperationException("The data is larger than 2 GB, read it with GetRawData(offset, length)");
+				}
 
 				// Copy data to a buffer that we own and that will not be deleted
 				byte[] buffer = new byte[length];
-				Marshal.Copy(new IntPtr(ptr), buffer, 0, length);
-				bufferCreated = true;
+				Marshal.Copy(new IntPtr(ptr), buffer, 0, (int)length);
 
 				return buffer;
 			}
@@ -118,6 +1071,31 @@ namespace AsyncGPUReadbackPluginNs {
 			}
 		}
 
+		/// <summary>
+		/// Get a part of the data, e.g. a few rows. With lazy mapping (see SetLazyMapping)
+		/// only this part is copied from the GPU buffer.
+		/// </summary>
+		/// <returns>null if the request is not done or the range is out of the data</returns>
+		public unsafe byte[] GetRawData(long offset, int length)
+		{
+			if (usePlugin) {
+				byte[] buffer = new byte[length];
+				fixed (byte* ptr = buffer) {
+					if (!getDataRange_mainThread(this.eventId, offset, length, ptr)) {
+						return null;
+					}
+				}
+				return buffer;
+			}
+			else {
+				NativeArray<byte> data = gpuRequest.GetData<byte>();
+				if (offset < 0 || length < 0 || offset + length > data.Length) {
+					return null;
+				}
+				return data.GetSubArray((int)offset, length).ToArray();
+			}
+		}
+
 		/// <summary>
 		/// Has to be called regularly to update request status.
 		/// Call this from Update() or from a corountine
@@ -127,6 +1105,7 @@ namespace AsyncGPUReadbackPluginNs {
 		public void Update(bool force = false)
 		{
 			if (usePlugin) {
+				ScheduleFrame();
 				GL.IssuePluginEvent(getfunction_update_renderThread(), this.eventId);
 			}
 			else if(force) {
@@ -135,11 +1114,23 @@ namespace AsyncGPUReadbackPluginNs {
 		}
 
 		/// <summary>
-		/// Has to be called to free the allocated buffer after it has been used
+		/// Let the native scheduler issue the deferred requests, once per frame
+		/// </summary>
+		internal static void ScheduleFrame()
+		{
+			if (lastScheduledFrame != Time.frameCount) {
+				lastScheduledFrame = Time.frameCount;
+				GL.IssuePluginEvent(getfunction_scheduleFrame_renderThread(), 0);
+			}
+		}
+
+		/// <summary>
+		/// Has to be called to free the allocated buffer after it has been used.
+		/// Once it returns, a caller-provided destination is not written anymore.
 		/// </summary>
 		public void Dispose()
 		{
-			if (usePlugin && bufferCreated) {
+			if (usePlugin) {
 				dispose(this.eventId);
 			}
 		}
@@ -150,13 +1141,39 @@ namespace AsyncGPUReadbackPluginNs {
 		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern int makeRequest_mainThread(int texture, int miplevel);
 		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int makeRequestWithSize_mainThread(int texture, int miplevel, int width, int height);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestRegion(int event_id, int x, int y, int width, int height);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestDestination(int event_id, IntPtr buffer, long capacity);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestPriority(int event_id, int priority, int deadline_ms);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestYuv(int event_id, int format);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestChunks(int event_id, int chunk_rows, int chunks_per_frame);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int setRequestDiskWriter(int event_id, int writer_id, int index);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void setRequestHashing(int event_id, int stream);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool getRequestHash(int event_id, out ulong hash);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int getRequestStatus(int event_id, IntPtr buffer, IntPtr length);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern float getRequestProgress(int event_id);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_scheduleFrame_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern IntPtr getfunction_makeRequest_renderThread();
 		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern void makeRequest_renderThread(int event_id);
 		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern IntPtr getfunction_update_renderThread();
 		[DllImport ("AsyncGPUReadbackPlugin")]
-		private static extern unsafe void getData_mainThread(int event_id, ref void* buffer, ref int length);
+		private static extern unsafe void getData_mainThread(int event_id, ref void* buffer, ref long length);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern unsafe bool getDataRange_mainThread(int event_id, long offset, int length, void* buffer);
 		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern bool isRequestError(int event_id);
 		[DllImport ("AsyncGPUReadbackPlugin")]
@@ -164,4 +1181,230 @@ namespace AsyncGPUReadbackPluginNs {
 		[DllImport ("AsyncGPUReadbackPlugin")]
 		private static extern void dispose(int event_id);
 	}
-}
\ No newline at end of file
+
+	/// <summary>
+	/// Request handle without managed allocation, like the official AsyncGPUReadbackRequest:
+	/// a copyable struct refering to the native request, whose state is read with a single
+	/// native call returning packed flags. Disposed handles are simply not valid anymore.
+	/// </summary>
+	public struct AsyncGPUReadbackPluginHandle
+	{
+		// Same values as the native RequestStatus
+		private const int StatusValid = 1;
+		private const int StatusIssued = 2;
+		private const int StatusDone = 4;
+		private const int StatusError = 8;
+
+		private bool usePlugin;
+		private AsyncGPUReadbackRequest gpuRequest;
+		private int eventId;
+
+		internal static AsyncGPUReadbackPluginHandle Create(Texture src, IntPtr destination, long capacity)
+		{
+			AsyncGPUReadbackPluginHandle handle = new AsyncGPUReadbackPluginHandle();
+			if (SystemInfo.supportsAsyncGPUReadback) {
+				handle.gpuRequest = AsyncGPUReadback.Request(src);
+			}
+			else if (isCompatible() != 0) {
+				handle.usePlugin = true;
+				int textureId = (int)(src.GetNativeTexturePtr());
+				handle.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				if (destination != IntPtr.Zero) {
+					setRequestDestination(handle.eventId, destination, capacity);
+				}
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), handle.eventId);
+			}
+			else {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+			}
+			return handle;
+		}
+
+		/// <summary>
+		/// Make a request from any thread, e.g. a job: the native texture id and size have been
+		/// read on the main thread (Texture.GetNativeTexturePtr). Only with the native plugin,
+		/// the handle has an error otherwise. The request is created and completed by
+		/// AsyncGPUReadbackPlugin.UpdateSubmitted(), called once per frame on the main thread;
+		/// done, hasError, GetData and Dispose can be used from any thread, not Update.
+		/// </summary>
+		public static AsyncGPUReadbackPluginHandle Submit(int nativeTexture, int width, int height)
+		{
+			AsyncGPUReadbackPluginHandle handle = new AsyncGPUReadbackPluginHandle();
+			handle.usePlugin = true;
+			if (isCompatible() != 0) {
+				handle.eventId = makeRequestWithSize_mainThread(nativeTexture, 0, width, height);
+				submitRequest(handle.eventId);
+			}
+			return handle;
+		}
+
+		internal static AsyncGPUReadbackPluginHandle Create(Texture src, ReductionType reduction, int bins)
+		{
+			AsyncGPUReadbackPluginHandle handle = new AsyncGPUReadbackPluginHandle();
+			handle.usePlugin = true;
+			if (!SystemInfo.supportsAsyncGPUReadback && isCompatible() != 0) {
+				int textureId = (int)(src.GetNativeTexturePtr());
+				handle.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestReduction(handle.eventId, (int)reduction, bins);
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), handle.eventId);
+			}
+			else {
+				Debug.LogError("GPU reductions are only supported by the native plugin.");
+			}
+			return handle;
+		}
+
+		internal static AsyncGPUReadbackPluginHandle Create(Texture src, Vector2Int[] points, int count)
+		{
+			AsyncGPUReadbackPluginHandle handle = new AsyncGPUReadbackPluginHandle();
+			handle.usePlugin = true;
+			if (!SystemInfo.supportsAsyncGPUReadback && isCompatible() != 0) {
+				int textureId = (int)(src.GetNativeTexturePtr());
+				handle.eventId = makeRequestWithSize_mainThread(textureId, 0, src.width, src.height);
+				setRequestPoints(handle.eventId, points, Mathf.Min(count, points.Length));
+				GL.IssuePluginEvent(getfunction_makeRequest_renderThread(), handle.eventId);
+			}
+			else {
+				Debug.LogError("Pixel gathers are only supported by the native plugin.");
+			}
+			return handle;
+		}
+
+		private int Status()
+		{
+			IntPtr data;
+			int length;
+			return getRequestStatus(eventId, out data, out length);
+		}
+
+		/// <summary>
+		/// Check if the request is done
+		/// </summary>
+		public bool done
+		{
+			get
+			{
+				if (usePlugin) {
+					return (Status() & StatusDone) != 0;
+				}
+				return gpuRequest.done;
+			}
+		}
+
+		/// <summary>
+		/// Check if the request has an error, or has been disposed
+		/// </summary>
+		public bool hasError
+		{
+			get
+			{
+				if (usePlugin) {
+					int status = Status();
+					return (status & StatusError) != 0 || (status & StatusValid) == 0;
+				}
+				return gpuRequest.hasError;
+			}
+		}
+
+		/// <summary>
+		/// Get the data once done, without copy. Warning: it is only valid until Dispose()
+		/// </summary>
+		public unsafe NativeArray<T> GetData<T>() where T : struct
+		{
+			if (!usePlugin) {
+				return gpuRequest.GetData<T>();
+			}
+			IntPtr data;
+			int length = 0;
+			int status = getRequestStatus(eventId, out data, out length);
+			if ((status & StatusDone) == 0 || (status & StatusError) != 0) {
+				throw new InvalidOperationException("The request is not done or has an error");
+			}
+			long fullLength = length;
+			if (data == IntPtr.Zero || length < 0) {
+				// Lazy mapping: copied from the GPU buffer now. Over 2 GB: the size is only given here
+				void* ptr = null;
+				getData_mainThread(eventId, ref ptr, ref fullLength);
+				data = new IntPtr(ptr);
+			}
+			long count = fullLength / UnsafeUtility.SizeOf<T>();
+			if (count > int.MaxValue) {
+				throw new InvalidOperationException("The data has more than 2^31 elements of this type, read it with CopyData");
+			}
+			NativeArray<T> array = NativeArrayUnsafeUtility.ConvertExistingDataToNativeArray<T>(data.ToPointer(), (int)count, Allocator.None);
+#if ENABLE_UNITY_COLLECTIONS_CHECKS
+			NativeArrayUnsafeUtility.SetAtomicSafetyHandle(ref array, AtomicSafetyHandle.GetTempUnsafePtrSliceHandle());
+#endif
+			return array;
+		}
+
+		/// <summary>
+		/// Copy a part of the data once done, e.g. a few rows. With lazy mapping (see SetLazyMapping)
+		/// only this part is copied from the GPU buffer.
+		/// </summary>
+		/// <returns>false if the request is not done or the range is out of the data</returns>
+		public unsafe bool CopyData(long offset, IntPtr destination, int length)
+		{
+			if (!usePlugin) {
+				NativeArray<byte> data = gpuRequest.GetData<byte>();
+				if (offset < 0 || length < 0 || offset + length > data.Length) {
+					return false;
+				}
+				UnsafeUtility.MemCpy(destination.ToPointer(), (byte*)NativeArrayUnsafeUtility.GetUnsafeReadOnlyPtr(data) + offset, length);
+				return true;
+			}
+			return getDataRange_mainThread(eventId, offset, length, destination.ToPointer());
+		}
+
+		/// <summary>
+		/// Has to be called regularly to update request status, see AsyncGPUReadbackPluginRequest.Update
+		/// </summary>
+		public void Update(bool force = false)
+		{
+			if (usePlugin) {
+				AsyncGPUReadbackPluginRequest.ScheduleFrame();
+				GL.IssuePluginEvent(getfunction_update_renderThread(), eventId);
+			}
+			else if (force) {
+				gpuRequest.Update();
+			}
+		}
+
+		/// <summary>
+		/// Has to be called to free the native buffer after it has been used.
+		/// </summary>
+		public void Dispose()
+		{
+			if (usePlugin) {
+				dispose(eventId);
+			}
+		}
+
+
+		// C++ bool, returned as a byte to stay blittable
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern byte isCompatible();
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern int makeRequestWithSize_mainThread(int texture, int miplevel, int width, int height);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern void setRequestDestination(int event_id, IntPtr buffer, long capacity);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern void setRequestReduction(int event_id, int reduction, int bins);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern void setRequestPoints(int event_id, Vector2Int[] points, int count);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern IntPtr getfunction_makeRequest_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern void submitRequest(int event_id);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern IntPtr getfunction_update_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern int getRequestStatus(int event_id, out IntPtr buffer, out int length);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern unsafe void getData_mainThread(int event_id, ref void* buffer, ref long length);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern unsafe bool getDataRange_mainThread(int event_id, long offset, int length, void* buffer);
+		[DllImport ("AsyncGPUReadbackPlugin"), SuppressUnmanagedCodeSecurity]
+		private static extern void dispose(int event_id);
+	}
+}
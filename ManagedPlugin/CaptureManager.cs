@@ -0,0 +1,296 @@
+using UnityEngine;
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using UnityEngine.Rendering;
+using Unity.Collections;
+using Unity.Collections.LowLevel.Unsafe;
+
+namespace AsyncGPUReadbackPluginNs {
+
+	/// <summary>
+	/// A frame captured by a CaptureManager.
+	/// data is only valid during the FrameCaptured callback, copy what you need to keep.
+	/// </summary>
+	public struct CaptureFrame
+	{
+		public int cameraId;
+		public int frameIndex;
+		public bool hasError;
+		public NativeArray<byte> data;
+	}
+
+	/// <summary>
+	/// Captures many sources (the cameras of a rig) together: one batched native request per
+	/// captured frame, completions drained in one call, frames handed to FrameCaptured subscribers.
+	/// Steady-state capture makes a constant number of native calls per frame, whatever the
+	/// number of sources, and no managed allocation.
+	/// </summary>
+	public class CaptureManager : MonoBehaviour
+	{
+		/// <summary>
+		/// Capture every capturePeriod frames
+		/// </summary>
+		public int capturePeriod = 1;
+
+		/// <summary>
+		/// Captures of a source still in flight before skipping it
+		/// </summary>
+		public int maxFramesInFlight = 4;
+
+		/// <summary>
+		/// Priority of the captures for the native scheduler
+		/// </summary>
+		public RequestPriority priority = RequestPriority.Normal;
+
+		/// <summary>
+		/// Called on the main thread for each captured frame, in Update()
+		/// </summary>
+		public event Action<CaptureFrame> FrameCaptured;
+
+		private class Source
+		{
+			public int cameraId;
+			public Texture texture;
+			public int frameIndex;
+			public int inFlight;
+			// Official api callback, created once
+			public Action<AsyncGPUReadbackRequest> callback;
+		}
+
+		private struct PendingCapture
+		{
+			public Source source;
+			public int frameIndex;
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		private struct CompletedRequest
+		{
+			public int eventId;
+			public int error;
+			public IntPtr data;
+			public long length;
+		}
+
+		private const int DrainSize = 64;
+
+		private List<Source> sources = new List<Source>();
+		private Dictionary<int, PendingCapture> pending = new Dictionary<int, PendingCapture>(64);
+		private CompletedRequest[] completed = new CompletedRequest[DrainSize];
+		private int[] completedIds = new int[DrainSize];
+
+		// Batch arguments, resized when sources are registered
+		private int[] batchTextures = new int[0];
+		private int[] batchWidths = new int[0];
+		private int[] batchHeights = new int[0];
+		private int[] batchEventIds = new int[0];
+		private Source[] batchSources = new Source[0];
+
+		private bool usePlugin;
+		// Native completion queue of the batches of this manager only
+		private int queueId;
+
+		void Awake()
+		{
+			usePlugin = !SystemInfo.supportsAsyncGPUReadback;
+			if (usePlugin && !isCompatible()) {
+				Debug.LogError("AsyncGPUReadback is not supported on your system.");
+				enabled = false;
+			}
+			else if (usePlugin) {
+				queueId = createCompletionQueue();
+			}
+		}
+
+		/// <summary>
+		/// Capture a texture, its frames are reported with cameraId
+		/// </summary>
+		public void Register(Texture texture, int cameraId)
+		{
+			Source source = new Source();
+			source.cameraId = cameraId;
+			source.texture = texture;
+			source.callback = (request) => OnOfficialRequestDone(source, request);
+			sources.Add(source);
+			ResizeBatch();
+		}
+
+		/// <summary>
+		/// Capture the target texture of a camera
+		/// </summary>
+		public void Register(Camera camera, int cameraId)
+		{
+			if (camera.targetTexture == null) {
+				throw new ArgumentException("The camera has no target texture", "camera");
+			}
+			Register(camera.targetTexture, cameraId);
+		}
+
+		/// <summary>
+		/// Stop capturing a source. Its frames in flight are still reported.
+		/// </summary>
+		public void Unregister(int cameraId)
+		{
+			sources.RemoveAll(source => source.cameraId == cameraId);
+			ResizeBatch();
+		}
+
+		private void ResizeBatch()
+		{
+			int count = sources.Count;
+			batchTextures = new int[count];
+			batchWidths = new int[count];
+			batchHeights = new int[count];
+			batchEventIds = new int[count];
+			batchSources = new Source[count];
+		}
+
+		void Update()
+		{
+			if (usePlugin) {
+				Drain();
+			}
+			if (capturePeriod <= 1 || Time.frameCount % capturePeriod == 0) {
+				Capture();
+			}
+			if (usePlugin) {
+				AsyncGPUReadbackPluginRequest.ScheduleFrame();
+				GL.IssuePluginEvent(getfunction_updateBatches_renderThread(), 0);
+			}
+		}
+
+		private void Capture()
+		{
+			if (!usePlugin) {
+				for (int i = 0; i < sources.Count; i++) {
+					Source source = sources[i];
+					if (source.texture != null && source.inFlight < maxFramesInFlight) {
+						source.inFlight++;
+						AsyncGPUReadback.Request(source.texture, 0, source.callback);
+					}
+				}
+				return;
+			}
+
+			int count = 0;
+			for (int i = 0; i < sources.Count; i++) {
+				Source source = sources[i];
+				if (source.texture == null || source.inFlight >= maxFramesInFlight) {
+					continue;
+				}
+				batchTextures[count] = (int)(source.texture.GetNativeTexturePtr());
+				batchWidths[count] = source.texture.width;
+				batchHeights[count] = source.texture.height;
+				batchSources[count] = source;
+				count++;
+			}
+			if (count == 0) {
+				return;
+			}
+
+			int batchId = makeQueuedRequestBatch_mainThread(queueId, batchTextures, batchWidths, batchHeights, count, (int)priority, batchEventIds);
+			GL.IssuePluginEvent(getfunction_makeRequestBatch_renderThread(), batchId);
+
+			for (int i = 0; i < count; i++) {
+				Source source = batchSources[i];
+				PendingCapture capture;
+				capture.source = source;
+				capture.frameIndex = source.frameIndex++;
+				source.inFlight++;
+				pending[batchEventIds[i]] = capture;
+				batchSources[i] = null;
+			}
+		}
+
+		/// <summary>
+		/// Report the completed captures of the native plugin, then dispose them all at once
+		/// </summary>
+		private unsafe void Drain()
+		{
+			int count;
+			do {
+				count = drainCompletionQueue(queueId, completed, DrainSize);
+				for (int i = 0; i < count; i++) {
+					PendingCapture capture;
+					if (pending.TryGetValue(completed[i].eventId, out capture)) {
+						pending.Remove(completed[i].eventId);
+						capture.source.inFlight--;
+
+						CaptureFrame frame;
+						frame.cameraId = capture.source.cameraId;
+						frame.frameIndex = capture.frameIndex;
+						frame.hasError = completed[i].error != 0 || (completed[i].data == IntPtr.Zero && completed[i].length > 0);
+						frame.data = frame.hasError ? default(NativeArray<byte>)
+							: NativeArrayUnsafeUtility.ConvertExistingDataToNativeArray<byte>(completed[i].data.ToPointer(), (int)completed[i].length, Allocator.None);
+#if ENABLE_UNITY_COLLECTIONS_CHECKS
+						AtomicSafetyHandle safety = AtomicSafetyHandle.Create();
+						if (!frame.hasError) {
+							NativeArrayUnsafeUtility.SetAtomicSafetyHandle(ref frame.data, safety);
+						}
+#endif
+						Report(frame);
+#if ENABLE_UNITY_COLLECTIONS_CHECKS
+						AtomicSafetyHandle.Release(safety);
+#endif
+					}
+					completedIds[i] = completed[i].eventId;
+				}
+				disposeRequests(completedIds, count);
+			} while (count == DrainSize);
+		}
+
+		private void OnOfficialRequestDone(Source source, AsyncGPUReadbackRequest request)
+		{
+			source.inFlight--;
+			CaptureFrame frame;
+			frame.cameraId = source.cameraId;
+			// The requests of a source complete in order
+			frame.frameIndex = source.frameIndex++;
+			frame.hasError = request.hasError;
+			frame.data = request.hasError ? default(NativeArray<byte>) : request.GetData<byte>();
+			Report(frame);
+		}
+
+		private void Report(CaptureFrame frame)
+		{
+			if (FrameCaptured != null) {
+				FrameCaptured(frame);
+			}
+		}
+
+		void OnDestroy()
+		{
+			if (usePlugin) {
+				foreach (int eventId in pending.Keys) {
+					dispose(eventId);
+				}
+				pending.Clear();
+				if (queueId != 0) {
+					closeCompletionQueue(queueId);
+					queueId = 0;
+				}
+			}
+		}
+
+
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern bool isCompatible();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int createCompletionQueue();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void closeCompletionQueue(int queue_id);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int makeQueuedRequestBatch_mainThread(int queue_id, int[] textures, int[] widths, int[] heights, int count, int priority, [Out] int[] event_ids);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_makeRequestBatch_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern IntPtr getfunction_updateBatches_renderThread();
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern int drainCompletionQueue(int queue_id, [Out] CompletedRequest[] completed, int max_count);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void disposeRequests(int[] event_ids, int count);
+		[DllImport ("AsyncGPUReadbackPlugin")]
+		private static extern void dispose(int event_id);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+// Headless OpenGL context (EGL, surfaceless) to drive the native plugin without Unity
+#include "../src/TypeHelpers.hpp"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+struct HeadlessContext {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+};
+
+/**
+ * @brief Create an OpenGL core context without any surface and make it current.
+ * Tries OpenGL 4.5 first, then 3.3.
+ *
+ * @return true if a context is current
+ */
+inline bool createHeadlessContext(HeadlessContext& headless) {
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT != NULL) {
+		headless.display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (headless.display == EGL_NO_DISPLAY) {
+		headless.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (headless.display == EGL_NO_DISPLAY || !eglInitialize(headless.display, NULL, NULL)) {
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint versions[][2] = { { 4, 5 }, { 3, 3 } };
+	for (int i = 0; i < 2 && headless.context == EGL_NO_CONTEXT; i++) {
+		EGLint attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, versions[i][0],
+			EGL_CONTEXT_MINOR_VERSION, versions[i][1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		headless.context = eglCreateContext(headless.display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+	}
+	if (headless.context == EGL_NO_CONTEXT) {
+		return false;
+	}
+	return eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless.context);
+}
+
+/**
+ * @brief Release and destroy the context
+ */
+inline void destroyHeadlessContext(HeadlessContext& headless) {
+	if (headless.context != EGL_NO_CONTEXT) {
+		eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(headless.display, headless.context);
+	}
+	if (headless.display != EGL_NO_DISPLAY) {
+		eglTerminate(headless.display);
+	}
+	headless = HeadlessContext();
+}
@@ -0,0 +1,121 @@
+#pragma once
+// Exported C API of libAsyncGPUReadbackPlugin, as called by the managed plugin
+#include <cstddef>
+#include <cstdint>
+#include "../src/TypeHelpers.hpp"
+
+// Same layouts as in AsyncGPUReadbackPlugin.cpp
+struct SchedulerStats {
+	int64_t budget_bytes;
+	int64_t last_frame_bytes;
+	int64_t deferred_requests;
+	int64_t deferred_bytes;
+	int64_t pending_requests;
+	int64_t pending_bytes;
+	int64_t expired_requests;
+	int64_t last_fence_latency_frames;
+	int64_t coalesced_requests;
+};
+
+struct CompletedRequest {
+	int32_t event_id;
+	int32_t error;
+	void* data;
+	int64_t length;
+};
+
+struct DiskWriterStats {
+	int64_t files_received;
+	int64_t files_written;
+	int64_t files_dropped;
+	int64_t errors;
+	int64_t bytes_written;
+	int32_t backend;
+	int32_t direct_io;
+};
+
+struct VideoSinkStats {
+	int64_t frames_captured;
+	int64_t frames_encoded;
+	int64_t frames_dropped;
+	int64_t errors;
+};
+
+struct BufferAllocatorStats {
+	int64_t bytes_in_use;
+	int64_t bytes_cached;
+	int64_t peak_bytes_in_use;
+	int64_t allocations;
+	int64_t reuses;
+	int64_t mmap_calls;
+	int64_t munmap_calls;
+	int64_t huge_page_allocations;
+};
+
+extern "C" {
+	bool isCompatible();
+	int makeRequest_mainThread(GLuint texture, int miplevel);
+	int makeRequestWithSize_mainThread(GLuint texture, int miplevel, int width, int height);
+	void setRequestRegion(int event_id, int x, int y, int width, int height);
+	void setRequestDestination(int event_id, void* buffer, long long capacity);
+	void setRequestPriority(int event_id, int priority, int deadline_ms);
+	void setRequestYuv(int event_id, int format);
+	void setRequestReduction(int event_id, int reduction, int bins);
+	void setRequestPoints(int event_id, const int* points, int count);
+	void setRequestChunks(int event_id, int chunk_rows, int chunks_per_frame);
+	float getRequestProgress(int event_id);
+	void makeRequest_renderThread(int event_id);
+	void submitRequest(int event_id);
+	void submitRequests(const int* event_ids, int count);
+	void scheduleFrame_renderThread(int event_id);
+	void setBulkBudget(long long bytes_per_frame);
+	void setFrameBudget(long long bytes_per_frame, int max_latency_frames);
+	void setCoalescing(bool enabled);
+	void setLazyMapping(bool enabled);
+	bool getDataRange_mainThread(int event_id, long long offset, int length, void* buffer);
+	void setPinnedMemory(bool enabled);
+	int getPinnedMemoryMode();
+	void getSchedulerStats(SchedulerStats* stats);
+	void update_renderThread(int event_id);
+	int makeRequestBatch_mainThread(const GLuint* textures, const int* widths, const int* heights, int count, int priority, int* event_ids);
+	void makeRequestBatch_renderThread(int batch_id);
+	void updateBatches_renderThread(int event_id);
+	int drainCompletedRequests(CompletedRequest* completed, int max_count);
+	int createCompletionQueue();
+	void closeCompletionQueue(int queue_id);
+	int makeQueuedRequestBatch_mainThread(int queue_id, const GLuint* textures, const int* widths, const int* heights, int count, int priority, int* event_ids);
+	int drainCompletionQueue(int queue_id, CompletedRequest* completed, int max_count);
+	void disposeRequests(const int* event_ids, int count);
+	void getData_mainThread(int event_id, void** buffer, size_t* length);
+	bool isRequestDone(int event_id);
+	bool isRequestError(int event_id);
+	int getRequestStatus(int event_id, void** buffer, int* length);
+	void dispose(int event_id);
+	void invalidateTextureInfo(GLuint texture);
+	void setFenceWaitStrategy(int strategy, int timeout_us);
+	void setTraceEnabled(bool enabled);
+	int dumpTrace(const char* path);
+	int createVideoSink(GLuint texture, int width, int height, const char* path, int fps, int encoder, const char* options);
+	void captureVideoSink_renderThread(int sink_id);
+	void closeVideoSink(int sink_id);
+	bool getVideoSinkStats(int sink_id, VideoSinkStats* stats);
+	int createMailbox(GLuint texture, int width, int height);
+	void captureMailbox_renderThread(int mailbox_id);
+	bool acquireMailboxFrame(int mailbox_id, void** buffer, int* length, uint32_t* frame);
+	void releaseMailboxFrame(int mailbox_id);
+	void closeMailbox(int mailbox_id);
+	int createDiskWriter(const char* path_format, int first_index, int backend, bool direct_io, int threads, int max_queued);
+	int setRequestDiskWriter(int event_id, int writer_id, int index);
+	bool getDiskWriterStats(int writer_id, DiskWriterStats* stats);
+	void setRequestHashing(int event_id, int stream);
+	void resetHashStream(int stream);
+	bool getRequestHash(int event_id, uint64_t* hash);
+	void setPboPoolSize(int count);
+	void setAllocatorOptions(int huge_pages, long long max_cached_bytes);
+	int reserveBuffers(int size, int count);
+	void getMemoryStats(BufferAllocatorStats* stats);
+	bool startCallRecording(const char* path);
+	void stopCallRecording();
+	bool closeDiskWriter(int writer_id, DiskWriterStats* stats);
+	void UnityPluginUnload();
+}
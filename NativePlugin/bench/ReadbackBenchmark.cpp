@@ -0,0 +1,659 @@
+/**
+ * Synthetic load benchmark of the native plugin.
+ *
+ * Drives the exported C API on a headless OpenGL context, the calling thread
+ * playing both Unity's main and render threads. Each frame clears the source
+ * texture (synthetic GPU load), runs the plugin scheduler, issues a batch of
+ * requests while the in-flight depth allows it, then updates every in-flight request and consumes the
+ * completed ones. Frames are not paced: the loop runs as fast as requests
+ * complete. Results are printed as JSON.
+ *
+ * Usage: ReadbackBenchmark [--quick] [--duration seconds] [--sweep name] [--output file] [--trace file] [--record file]
+ *   --sweep: all (default), resolution, format, depth, region, batch, strategy, budget, coalesce, lazy, chunked, pinned, disk, hash, submit
+ *   --trace: record the plugin trace events and write them as Chrome trace JSON
+ *   --record: record the calls into the plugin to a log for ReadbackReplay
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "HeadlessContext.hpp"
+#include "PluginApi.hpp"
+
+struct BenchCase {
+	std::string sweep;
+	int width;
+	int height;
+	GLint internal_format;
+	const char* format_name;
+	int depth;
+	int region_width;
+	int region_height;
+	int batch;
+	int strategy;
+	// Frame budget in frames worth of bytes (0 for no limit), adaptive if max_latency_frames > 0
+	int budget_frames;
+	int max_latency_frames;
+	// Let the requests of a frame share their read (off elsewhere: batches measure separate reads)
+	bool coalesce;
+	// Lazy mapping, the consumer then only copies the first row of each frame
+	bool lazy;
+	// Rows per chunk of chunked requests (0 for one read), 2 chunks per frame
+	int chunk_rows;
+	// Pixel buffers backed by host memory when supported (the plugin's default)
+	bool pinned;
+	// Frames written to files: by the consumer, or by a disk writer (see disk_modes)
+	int disk;
+	// Frames hashed by the plugin, and the duplicates of a scene changing every HASH_STILL_FRAMES frames suppressed
+	int hash;
+	// Requests submitted (submitRequest) instead of issued, alone or next to batches drained and disposed (see submit_modes)
+	int submit;
+};
+
+struct BenchResult {
+	long long issued = 0;
+	long long completed = 0;
+	long long errors = 0;
+	// Files the disk writer dropped, not counted in errors
+	long long dropped = 0;
+	long long throttled = 0;
+	long long deferred = 0;
+	long long coalesced = 0;
+	long long duplicates = 0;
+	long long frames = 0;
+	long long bytes = 0;
+	double elapsed = 0;
+	double latency_p50_ms = 0;
+	double latency_p90_ms = 0;
+	double latency_p99_ms = 0;
+	double latency_max_ms = 0;
+	// Longest frame of the loop (scheduling, issuing and completing)
+	double frame_max_ms = 0;
+	long peak_rss_kb = 0;
+	long rss_kb = 0;
+};
+
+struct InFlight {
+	int event_id;
+	// Bytes read by a partial consumer, 0 for the whole data
+	int row_size;
+	// File the consumer writes the data to, empty for none
+	std::string path;
+	std::chrono::steady_clock::time_point issued_at;
+};
+
+#define FORMAT(f) { f, #f }
+static const struct { GLint internal_format; const char* name; } formats[] = {
+	FORMAT(GL_R8), FORMAT(GL_R8_SNORM), FORMAT(GL_R16), FORMAT(GL_R16_SNORM),
+	FORMAT(GL_RG8), FORMAT(GL_RG8_SNORM), FORMAT(GL_RG16), FORMAT(GL_RG16_SNORM),
+	FORMAT(GL_RGB8), FORMAT(GL_RGB8_SNORM), FORMAT(GL_RGB16), FORMAT(GL_RGB16_SNORM),
+	FORMAT(GL_RGBA8), FORMAT(GL_RGBA8_SNORM), FORMAT(GL_RGBA16), FORMAT(GL_RGBA16_SNORM),
+	FORMAT(GL_SRGB8), FORMAT(GL_SRGB8_ALPHA8),
+	FORMAT(GL_R16F), FORMAT(GL_RG16F), FORMAT(GL_RGB16F), FORMAT(GL_RGBA16F),
+	FORMAT(GL_R32F), FORMAT(GL_RG32F), FORMAT(GL_RGB32F), FORMAT(GL_RGBA32F),
+	FORMAT(GL_R8I), FORMAT(GL_R8UI), FORMAT(GL_R16I), FORMAT(GL_R16UI), FORMAT(GL_R32I), FORMAT(GL_R32UI),
+	FORMAT(GL_RG8I), FORMAT(GL_RG8UI), FORMAT(GL_RG16I), FORMAT(GL_RG16UI), FORMAT(GL_RG32I), FORMAT(GL_RG32UI),
+	FORMAT(GL_RGB8I), FORMAT(GL_RGB8UI), FORMAT(GL_RGB16I), FORMAT(GL_RGB16UI), FORMAT(GL_RGB32I), FORMAT(GL_RGB32UI),
+	FORMAT(GL_RGBA8I), FORMAT(GL_RGBA8UI), FORMAT(GL_RGBA16I), FORMAT(GL_RGBA16UI), FORMAT(GL_RGBA32I), FORMAT(GL_RGBA32UI),
+};
+#undef FORMAT
+
+static const char* strategy_names[] = { "poll", "client_wait", "thread" };
+
+enum DiskMode {
+	DISK_NONE = 0,
+	// The consumer writes each frame with fwrite, as File.WriteAllBytes would
+	DISK_CONSUMER = 1,
+	DISK_IO_URING = 2,
+	DISK_THREADS = 3
+};
+static const char* disk_modes[] = { "none", "consumer", "io_uring", "threads" };
+// Files written per case, reused in turn to bound the disk usage
+static const int DISK_FILES = 8;
+
+enum HashMode {
+	HASH_NONE = 0,
+	HASH_ONLY = 1,
+	HASH_SUPPRESS = 2
+};
+static const char* hash_modes[] = { "none", "hash", "suppress" };
+// Frames the texture stays the same for, when duplicates are suppressed
+static const int HASH_STILL_FRAMES = 4;
+
+enum SubmitMode {
+	SUBMIT_NONE = 0,
+	SUBMIT_ALONE = 1,
+	// A batch per frame, drained and disposed like a CaptureManager: the submitted requests must stay valid
+	SUBMIT_WITH_BATCHES = 2
+};
+static const char* submit_modes[] = { "none", "alone", "with_batches" };
+
+static double percentile(std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static long currentRssKb() {
+	long pages = 0, resident = 0;
+	FILE* statm = std::fopen("/proc/self/statm", "r");
+	if (statm != NULL) {
+		if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		std::fclose(statm);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * @brief Consume a completed request
+ * @return true if the request was done (and is now disposed)
+ */
+static bool consume(const InFlight& request, BenchResult& result, std::vector<double>& latencies) {
+	update_renderThread(request.event_id);
+	if (!isRequestDone(request.event_id) && !isRequestError(request.event_id)) {
+		return false;
+	}
+
+	std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - request.issued_at;
+	if (isRequestError(request.event_id)) {
+		result.errors++;
+	}
+	else if (getRequestStatus(request.event_id, NULL, NULL) & 16) {
+		// Duplicate: nothing to consume
+		result.duplicates++;
+		result.completed++;
+		latencies.push_back(latency.count());
+	}
+	else {
+		void* buffer = NULL;
+		size_t length = 0;
+		if (request.row_size > 0) {
+			int lazy_length = 0;
+			getRequestStatus(request.event_id, NULL, &lazy_length);
+			std::vector<char> row(request.row_size);
+			getDataRange_mainThread(request.event_id, 0, request.row_size, row.data());
+			length = lazy_length;
+		}
+		else {
+			getData_mainThread(request.event_id, &buffer, &length);
+		}
+		if (!request.path.empty()) {
+			FILE* file = std::fopen(request.path.c_str(), "wb");
+			if (file == NULL || std::fwrite(buffer, 1, length, file) != length) {
+				result.errors++;
+			}
+			if (file != NULL) {
+				std::fclose(file);
+			}
+		}
+		result.bytes += length;
+		result.completed++;
+		latencies.push_back(latency.count());
+	}
+	dispose(request.event_id);
+	return true;
+}
+
+static BenchResult runCase(const BenchCase& c, double duration) {
+	BenchResult result;
+	std::vector<double> latencies;
+	std::deque<InFlight> in_flight;
+
+	setFenceWaitStrategy(c.strategy, 1000);
+	int pixel_size = getPixelSizeFromFormatAndType(getFormatFromInternalFormat(c.internal_format), getTypeFromInternalFormat(c.internal_format));
+	long long frame_size = (long long)c.width * c.height * pixel_size;
+	setFrameBudget(c.budget_frames * frame_size, c.max_latency_frames);
+	setCoalescing(c.coalesce);
+	setLazyMapping(c.lazy);
+	setPinnedMemory(c.pinned);
+	SchedulerStats stats_before;
+	getSchedulerStats(&stats_before);
+
+	GLenum format = getFormatFromInternalFormat(c.internal_format);
+	GLenum type = getTypeFromInternalFormat(c.internal_format);
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, c.internal_format, c.width, c.height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int region_width = std::min(c.region_width > 0 ? c.region_width : c.width, c.width);
+	int region_height = std::min(c.region_height > 0 ? c.region_height : c.height, c.height);
+	int region_x = (c.width - region_width) / 2;
+	int region_y = (c.height - region_height) / 2;
+
+	// Files written in a temporary directory
+	std::string disk_directory;
+	int disk_writer = 0;
+	int disk_max_queued = 2 * c.depth;
+	if (c.disk != DISK_NONE) {
+		char directory[] = "/tmp/ReadbackBenchmarkXXXXXX";
+		if (mkdtemp(directory) != NULL) {
+			disk_directory = directory;
+		}
+	}
+	if (!disk_directory.empty() && (c.disk == DISK_IO_URING || c.disk == DISK_THREADS)) {
+		disk_writer = createDiskWriter((disk_directory + "/frame_%d.raw").c_str(), 0, c.disk == DISK_IO_URING ? 0 : 1, true, 4, disk_max_queued);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed(0);
+	unsigned char clear_color[16] = { 0 };
+	int batch_in_flight = 0;
+	std::vector<CompletedRequest> completed(16);
+	std::vector<int> completed_ids(completed.size());
+
+	while (elapsed.count() < duration || !in_flight.empty() || batch_in_flight > 0) {
+		std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+		// Files waiting for the disk: requests are not issued while they would be dropped,
+		// so the disk sweep measures the writes
+		long long disk_queued = 0;
+		if (disk_writer != 0) {
+			DiskWriterStats disk_stats;
+			getDiskWriterStats(disk_writer, &disk_stats);
+			disk_queued = disk_stats.files_received - disk_stats.files_written - disk_stats.files_dropped - disk_stats.errors;
+		}
+		bool disk_full = disk_writer != 0 && disk_queued + (long long)in_flight.size() >= disk_max_queued;
+		bool issuing = elapsed.count() < duration && (int)in_flight.size() < c.depth && !disk_full;
+
+		// Synthetic GPU load: rewrite the whole texture before reading it
+		if (issuing) {
+			clear_color[0] = (unsigned char)((c.hash == HASH_SUPPRESS) ? result.frames / HASH_STILL_FRAMES : result.frames);
+			glClearTexImage(texture, 0, format, type, clear_color);
+		}
+		scheduleFrame_renderThread(0);
+
+		for (int i = 0; elapsed.count() < duration && i < c.batch; i++) {
+			if ((int)in_flight.size() >= c.depth || (disk_writer != 0 && disk_queued + (long long)in_flight.size() >= disk_max_queued)) {
+				result.throttled++;
+				continue;
+			}
+			InFlight request;
+			request.event_id = makeRequestWithSize_mainThread(texture, 0, c.width, c.height);
+			if (region_width != c.width || region_height != c.height) {
+				setRequestRegion(request.event_id, region_x, region_y, region_width, region_height);
+			}
+			if (c.chunk_rows > 0) {
+				setRequestChunks(request.event_id, c.chunk_rows, 2);
+			}
+			if (c.hash != HASH_NONE) {
+				setRequestHashing(request.event_id, (c.hash == HASH_SUPPRESS) ? 1 : 0);
+			}
+			request.row_size = c.lazy ? region_width * pixel_size : 0;
+			if (disk_writer != 0) {
+				setRequestDiskWriter(request.event_id, disk_writer, (int)(result.issued % DISK_FILES));
+			}
+			else if (!disk_directory.empty()) {
+				request.path = disk_directory + "/frame_" + std::to_string(result.issued % DISK_FILES) + ".raw";
+			}
+			request.issued_at = std::chrono::steady_clock::now();
+			if (c.submit != SUBMIT_NONE) {
+				submitRequest(request.event_id);
+			}
+			else {
+				makeRequest_renderThread(request.event_id);
+			}
+			in_flight.push_back(request);
+			result.issued++;
+		}
+		if (c.submit == SUBMIT_WITH_BATCHES && issuing) {
+			int event_ids[1];
+			makeRequestBatch_renderThread(makeRequestBatch_mainThread(&texture, &c.width, &c.height, 1, 1, event_ids));
+			batch_in_flight++;
+		}
+		glFlush();
+
+		// The batch owner disposes whatever it drains
+		if (c.submit == SUBMIT_WITH_BATCHES) {
+			updateBatches_renderThread(0);
+			int count = drainCompletedRequests(completed.data(), (int)completed.size());
+			for (int i = 0; i < count; i++) {
+				completed_ids[i] = completed[i].event_id;
+			}
+			disposeRequests(completed_ids.data(), count);
+			batch_in_flight -= count;
+		}
+
+		for (std::deque<InFlight>::iterator it = in_flight.begin(); it != in_flight.end();) {
+			if (consume(*it, result, latencies)) {
+				it = in_flight.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		// Nothing to do until a request completes: let the readback thread and the driver run
+		if (disk_full) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		else if (!issuing) {
+			std::this_thread::yield();
+		}
+
+		result.frames++;
+		std::chrono::steady_clock::time_point frame_end = std::chrono::steady_clock::now();
+		result.frame_max_ms = std::max(result.frame_max_ms, std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+		elapsed = frame_end - start;
+	}
+
+	// The capture is over once the files are written
+	if (disk_writer != 0) {
+		DiskWriterStats disk_stats;
+		closeDiskWriter(disk_writer, &disk_stats);
+		// The requests of the dropped files are in error too
+		result.dropped = disk_stats.files_dropped;
+		result.errors += disk_stats.errors - disk_stats.files_dropped;
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	if (!disk_directory.empty()) {
+		for (int i = 0; i < DISK_FILES; i++) {
+			unlink((disk_directory + "/frame_" + std::to_string(i) + ".raw").c_str());
+		}
+		rmdir(disk_directory.c_str());
+	}
+
+	glDeleteTextures(1, &texture);
+	invalidateTextureInfo(texture);
+	resetHashStream(1);
+	SchedulerStats stats_after;
+	getSchedulerStats(&stats_after);
+	result.deferred = stats_after.deferred_requests - stats_before.deferred_requests;
+	result.coalesced = stats_after.coalesced_requests - stats_before.coalesced_requests;
+	setFrameBudget(0, 0);
+	setCoalescing(true);
+	setLazyMapping(false);
+	setPinnedMemory(true);
+
+	result.elapsed = elapsed.count();
+	std::sort(latencies.begin(), latencies.end());
+	result.latency_p50_ms = percentile(latencies, 0.50);
+	result.latency_p90_ms = percentile(latencies, 0.90);
+	result.latency_p99_ms = percentile(latencies, 0.99);
+	result.latency_max_ms = latencies.empty() ? 0 : latencies.back();
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result.peak_rss_kb = usage.ru_maxrss;
+	result.rss_kb = currentRssKb();
+	return result;
+}
+
+static void writeResult(FILE* out, const BenchCase& c, const BenchResult& r, bool last) {
+	std::fprintf(out,
+		"    {\"sweep\": \"%s\", \"width\": %d, \"height\": %d, \"format\": \"%s\", "
+		"\"in_flight_depth\": %d, \"region_width\": %d, \"region_height\": %d, \"batch\": %d, \"strategy\": \"%s\", "
+		"\"budget_frames\": %d, \"max_latency_frames\": %d, \"coalesce\": %s, \"lazy\": %s, \"chunk_rows\": %d, \"pinned\": %s, \"disk\": \"%s\", \"hash\": \"%s\", \"submit\": \"%s\", "
+		"\"frames\": %lld, \"issued\": %lld, \"completed\": %lld, \"errors\": %lld, \"dropped\": %lld, \"throttled\": %lld, \"deferred\": %lld, \"coalesced\": %lld, \"duplicates\": %lld, "
+		"\"elapsed_s\": %.4f, \"requests_per_s\": %.2f, \"mb_per_s\": %.2f, "
+		"\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, \"frame_max_ms\": %.3f, "
+		"\"peak_rss_kb\": %ld, \"rss_kb\": %ld}%s\n",
+		c.sweep.c_str(), c.width, c.height, c.format_name,
+		c.depth, c.region_width > 0 ? c.region_width : c.width, c.region_height > 0 ? c.region_height : c.height,
+		c.batch, strategy_names[c.strategy], c.budget_frames, c.max_latency_frames, c.coalesce ? "true" : "false", c.lazy ? "true" : "false", c.chunk_rows,
+		c.pinned ? "true" : "false", disk_modes[c.disk], hash_modes[c.hash], submit_modes[c.submit],
+		r.frames, r.issued, r.completed, r.errors, r.dropped, r.throttled, r.deferred, r.coalesced, r.duplicates,
+		r.elapsed, r.completed / r.elapsed, r.bytes / r.elapsed / 1e6,
+		r.latency_p50_ms, r.latency_p90_ms, r.latency_p99_ms, r.latency_max_ms, r.frame_max_ms,
+		r.peak_rss_kb, r.rss_kb, last ? "" : ",");
+	std::fflush(out);
+}
+
+int main(int argc, char** argv) {
+	bool quick = false;
+	double duration = 1.0;
+	std::string sweep = "all";
+	const char* output = NULL;
+	const char* trace = NULL;
+	const char* record = NULL;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--quick") {
+			quick = true;
+			duration = 0.2;
+		}
+		else if (arg == "--duration" && i + 1 < argc) {
+			duration = std::atof(argv[++i]);
+		}
+		else if (arg == "--sweep" && i + 1 < argc) {
+			sweep = argv[++i];
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			trace = argv[++i];
+		}
+		else if (arg == "--record" && i + 1 < argc) {
+			record = argv[++i];
+		}
+		else {
+			std::fprintf(stderr, "Usage: %s [--quick] [--duration seconds] [--sweep all|resolution|format|depth|region|batch|strategy|budget|coalesce|lazy|chunked|pinned|disk|hash|submit] [--output file] [--trace file] [--record file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	HeadlessContext headless;
+	if (!createHeadlessContext(headless)) {
+		std::fprintf(stderr, "Could not create a headless OpenGL context\n");
+		return 1;
+	}
+
+	// Every sweep varies one parameter around this baseline
+	BenchCase base;
+	base.width = 1920;
+	base.height = 1080;
+	base.internal_format = GL_RGBA8;
+	base.format_name = "GL_RGBA8";
+	base.depth = 4;
+	base.region_width = 0;
+	base.region_height = 0;
+	base.batch = 1;
+	base.strategy = 0;
+	base.budget_frames = 0;
+	base.max_latency_frames = 0;
+	base.coalesce = false;
+	base.lazy = false;
+	base.chunk_rows = 0;
+	base.pinned = true;
+	base.disk = DISK_NONE;
+	base.hash = HASH_NONE;
+	base.submit = SUBMIT_NONE;
+
+	std::vector<BenchCase> cases;
+	if (sweep == "all" || sweep == "resolution") {
+		const int resolutions[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 } };
+		int count = quick ? 2 : 5;
+		for (int i = 0; i < count; i++) {
+			BenchCase c = base;
+			c.sweep = "resolution";
+			c.width = resolutions[i][0];
+			c.height = resolutions[i][1];
+			// Bound staging memory for the largest frames
+			c.depth = (c.width * c.height > 3840 * 2160) ? 2 : base.depth;
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "format") {
+		for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+			if (quick && formats[i].internal_format != GL_RGBA8 && formats[i].internal_format != GL_RGBA16F
+				&& formats[i].internal_format != GL_R32F) {
+				continue;
+			}
+			BenchCase c = base;
+			c.sweep = "format";
+			c.internal_format = formats[i].internal_format;
+			c.format_name = formats[i].name;
+			if (getFormatFromInternalFormat(c.internal_format) != 0 && getTypeFromInternalFormat(c.internal_format) != 0) {
+				cases.push_back(c);
+			}
+		}
+	}
+	if (sweep == "all" || sweep == "depth") {
+		const int depths[] = { 1, 2, 4, 8, 16 };
+		for (int i = 0; i < (quick ? 3 : 5); i++) {
+			BenchCase c = base;
+			c.sweep = "depth";
+			c.depth = depths[i];
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "region") {
+		const int regions[] = { 64, 256, 1024 };
+		for (int i = 0; i < 3; i++) {
+			BenchCase c = base;
+			c.sweep = "region";
+			c.region_width = regions[i];
+			c.region_height = regions[i];
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "batch") {
+		const int batches[] = { 1, 2, 4, 8 };
+		for (int i = 0; i < (quick ? 2 : 4); i++) {
+			BenchCase c = base;
+			c.sweep = "batch";
+			c.batch = batches[i];
+			c.depth = std::max(base.depth, 2 * c.batch);
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "strategy") {
+		for (int strategy = 0; strategy < 3; strategy++) {
+			BenchCase c = base;
+			c.sweep = "strategy";
+			c.strategy = strategy;
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "budget") {
+		// Batches of 4 frames against a budget of 0 (no limit), 1 or 2 frames, then adaptive
+		const int budgets[][2] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 2, 1 } };
+		for (int i = 0; i < 4; i++) {
+			BenchCase c = base;
+			c.sweep = "budget";
+			c.batch = 4;
+			c.depth = 8;
+			c.budget_frames = budgets[i][0];
+			c.max_latency_frames = budgets[i][1];
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "coalesce") {
+		// Batches of 4 requests of the same texture, read separately then shared
+		for (int i = 0; i < 2; i++) {
+			BenchCase c = base;
+			c.sweep = "coalesce";
+			c.batch = 4;
+			c.depth = 8;
+			c.coalesce = (i == 1);
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "lazy") {
+		// Consumers reading the whole frame, then only its first row from the mapped buffer
+		for (int i = 0; i < 2; i++) {
+			BenchCase c = base;
+			c.sweep = "lazy";
+			c.lazy = (i == 1);
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "chunked") {
+		// 8K frames read at once, then by bands of 540 rows
+		for (int i = 0; i < 2; i++) {
+			BenchCase c = base;
+			c.sweep = "chunked";
+			c.width = 7680;
+			c.height = 4320;
+			c.depth = 2;
+			c.chunk_rows = (i == 1) ? 540 : 0;
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "pinned") {
+		// Frames mapped and copied, then written by the GPU in host memory
+		for (int i = 0; i < 2; i++) {
+			BenchCase c = base;
+			c.sweep = "pinned";
+			c.pinned = (i == 1);
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "disk") {
+		// Frames written to files by the consumer, then by the io_uring and thread disk writers (O_DIRECT)
+		for (int i = DISK_CONSUMER; i <= DISK_THREADS; i++) {
+			BenchCase c = base;
+			c.sweep = "disk";
+			c.disk = i;
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "hash") {
+		// Frames copied, then hashed while copied, then with the duplicates of a mostly still scene suppressed
+		for (int i = HASH_NONE; i <= HASH_SUPPRESS; i++) {
+			BenchCase c = base;
+			c.sweep = "hash";
+			c.hash = i;
+			cases.push_back(c);
+		}
+	}
+	if (sweep == "all" || sweep == "submit") {
+		// Requests submitted from any thread, then next to batches: drained batches must not take them
+		for (int i = SUBMIT_ALONE; i <= SUBMIT_WITH_BATCHES; i++) {
+			BenchCase c = base;
+			c.sweep = "submit";
+			c.submit = i;
+			cases.push_back(c);
+		}
+	}
+	if (cases.empty()) {
+		std::fprintf(stderr, "Unknown sweep %s\n", sweep.c_str());
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (output != NULL) {
+		out = std::fopen(output, "w");
+		if (out == NULL) {
+			std::fprintf(stderr, "Could not open %s\n", output);
+			return 1;
+		}
+	}
+
+	setTraceEnabled(trace != NULL);
+	if (record != NULL && !startCallRecording(record)) {
+		std::fprintf(stderr, "Could not create %s\n", record);
+		return 1;
+	}
+
+	std::fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"gl_version\": \"%s\",\n  \"duration_s\": %.3f,\n  \"results\": [\n",
+		(const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION), duration);
+	for (size_t i = 0; i < cases.size(); i++) {
+		BenchResult result = runCase(cases[i], duration);
+		writeResult(out, cases[i], result, i + 1 == cases.size());
+	}
+	std::fprintf(out, "  ]\n}\n");
+
+	if (out != stdout) {
+		std::fclose(out);
+	}
+	if (trace != NULL) {
+		std::fprintf(stderr, "%d trace events written to %s\n", dumpTrace(trace), trace);
+	}
+	stopCallRecording();
+	UnityPluginUnload();
+	destroyHeadlessContext(headless);
+	return 0;
+}
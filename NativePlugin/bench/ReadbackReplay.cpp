@@ -0,0 +1,900 @@
+/**
+ * Replays a call log of the native plugin on a headless OpenGL context.
+ *
+ * The log is recorded in production with startCallRecording (or ReadbackBenchmark --record):
+ * every call into the exported C API, with its timestamp, and the size and format of the
+ * textures read. The replayer creates textures of the same sizes and formats, then makes the
+ * same calls in the same order, from one thread, at the recorded pace (or faster, see --speed).
+ * Request, batch, sink, mailbox and disk writer ids are mapped to the replayed ones. Destinations
+ * are allocated by the replayer; disk writers and video sinks write to a temporary directory,
+ * video sinks with the raw NV12 encoder. The texture contents are not recorded.
+ * Plugin settings can be overridden, to compare pool sizes, budgets and strategies on the same
+ * traffic: the recorded calls setting them are then skipped. Results are printed as JSON.
+ *
+ * Usage: ReadbackReplay log [--speed factor] [--strategy poll|client_wait|thread] [--timeout-us us]
+ *   [--frame-budget bytes] [--max-latency-frames frames] [--bulk-budget bytes] [--coalesce on|off]
+ *   [--lazy on|off] [--pinned on|off] [--pbo-pool count] [--max-cached-bytes bytes] [--rewrite]
+ *   [--output file] [--trace file]
+ *   --speed: 1 for the recorded pace (default), 2 for twice as fast, 0 for as fast as possible
+ *   --rewrite: rewrite every texture at each scheduleFrame_renderThread, so that frames differ
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "HeadlessContext.hpp"
+#include "PluginApi.hpp"
+#include "../src/CallRecorder.hpp"
+
+static const char* strategy_names[] = { "poll", "client_wait", "thread" };
+// Same values as the native RequestStatus
+static const int STATUS_DONE = 4;
+static const int STATUS_ERROR = 8;
+// Raw NV12 VideoEncoderType
+static const int VIDEO_ENCODER_RAW_NV12 = 1;
+
+/**
+ * Settings given on the command line, replacing the recorded ones
+ */
+struct Overrides {
+	int strategy = -1;
+	int timeout_us = 1000;
+	long long frame_budget = -1;
+	int max_latency_frames = 0;
+	long long bulk_budget = -1;
+	int coalesce = -1;
+	int lazy = -1;
+	int pinned = -1;
+	int pbo_pool = -1;
+	long long max_cached_bytes = -1;
+};
+
+/**
+ * Texture of the log, as created for the replay
+ */
+struct ReplayTexture {
+	GLuint texture = 0;
+	// Level 0
+	int width = 0;
+	int height = 0;
+	int levels = 1;
+	GLint internal_format = GL_RGBA8;
+};
+
+/**
+ * Replayed request, from its creation to its disposal
+ */
+struct ReplayRequest {
+	std::chrono::steady_clock::time_point created_at;
+	bool completed = false;
+	bool counted = false;
+	std::vector<char> destination;
+};
+
+struct CallStats {
+	long long count = 0;
+	double total_ms = 0;
+	double max_ms = 0;
+};
+
+struct ReplayResult {
+	long long calls = 0;
+	long long skipped = 0;
+	long long requests = 0;
+	long long completed = 0;
+	long long errors = 0;
+	long long bytes = 0;
+	double recorded_s = 0;
+	double elapsed_s = 0;
+	// Longest time the replay was behind the recorded pace
+	double max_lag_ms = 0;
+	double call_ms = 0;
+	double render_thread_ms = 0;
+	std::vector<double> latencies;
+	CallStats per_call[RECORDED_CALL_COUNT];
+};
+
+class Replayer {
+public:
+	Replayer(const Overrides& overrides, bool rewrite) : overrides(overrides), rewrite(rewrite) {}
+
+	/**
+	 * @brief Replay the calls of a log, in order
+	 */
+	ReplayResult run(const std::vector<LoggedCall>& calls, double speed) {
+		char directory[] = "/tmp/ReadbackReplayXXXXXX";
+		if (mkdtemp(directory) != NULL) {
+			files_directory = directory;
+		}
+		scanTextures(calls);
+		applyOverrides();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < calls.size(); i++) {
+			const LoggedCall& call = calls[i];
+			if (speed > 0) {
+				std::chrono::steady_clock::time_point target = start
+					+ std::chrono::nanoseconds((long long)(call.timestamp_ns / speed));
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if (target > now) {
+					std::this_thread::sleep_until(target);
+				}
+				else {
+					result.max_lag_ms = std::max(result.max_lag_ms, std::chrono::duration<double, std::milli>(now - target).count());
+				}
+			}
+			if (call.call >= RECORDED_CALL_COUNT) {
+				result.skipped++;
+				continue;
+			}
+
+			std::chrono::steady_clock::time_point call_start = std::chrono::steady_clock::now();
+			bool replayed = replay(call);
+			double call_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - call_start).count();
+			if (!replayed) {
+				result.skipped++;
+				continue;
+			}
+			result.calls++;
+			result.call_ms += call_ms;
+			if (std::strstr(recorded_call_names[call.call], "_renderThread") != NULL) {
+				result.render_thread_ms += call_ms;
+			}
+			CallStats& stats = result.per_call[call.call];
+			stats.count++;
+			stats.total_ms += call_ms;
+			stats.max_ms = std::max(stats.max_ms, call_ms);
+		}
+		result.recorded_s = calls.empty() ? 0 : calls.back().timestamp_ns / 1e9;
+		result.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		cleanup();
+		return result;
+	}
+
+private:
+	Overrides overrides;
+	bool rewrite;
+	ReplayResult result;
+	std::string files_directory;
+	int next_file = 0;
+	// Recorded ids to replayed ones
+	std::map<int64_t,ReplayTexture> textures;
+	std::map<int64_t,int> events;
+	std::map<int,ReplayRequest> requests;
+	std::map<int64_t,int> batches;
+	std::map<int64_t,int> completion_queues;
+	std::map<int64_t,int> video_sinks;
+	std::map<int64_t,int> mailboxes;
+	std::map<int64_t,int> disk_writers;
+	std::vector<char> scratch;
+	std::vector<CompletedRequest> completed;
+	unsigned char rewrite_value = 1;
+
+	static int mapId(const std::map<int64_t,int>& ids, int64_t id) {
+		std::map<int64_t,int>::const_iterator it = ids.find(id);
+		return (it != ids.end()) ? it->second : 0;
+	}
+
+	/**
+	 * @brief Size and format of each texture of the log, from the first level the plugin read
+	 */
+	void scanTextures(const std::vector<LoggedCall>& calls) {
+		for (size_t i = 0; i < calls.size(); i++) {
+			const LoggedCall& call = calls[i];
+			if (call.call != CALL_TEXTURE || call.values.size() < 6) {
+				continue;
+			}
+			int miplevel = (int)call.values[1];
+			std::map<int64_t,ReplayTexture>::iterator it = textures.find(call.values[0]);
+			if (it == textures.end()) {
+				ReplayTexture& texture = textures[call.values[0]];
+				texture.width = std::max(1, (int)call.values[2] << miplevel);
+				texture.height = std::max(1, (int)call.values[3] << miplevel);
+				texture.levels = miplevel + 1;
+				texture.internal_format = (GLint)call.values[5];
+			}
+			else {
+				it->second.levels = std::max(it->second.levels, miplevel + 1);
+			}
+		}
+	}
+
+	void createTexture(ReplayTexture& texture) {
+		GLenum format = getFormatFromInternalFormat(texture.internal_format);
+		GLenum type = getTypeFromInternalFormat(texture.internal_format);
+		if (format == 0 || type == 0) {
+			// Not readable by the plugin anyway, keep the requests failing the same way
+			texture.internal_format = GL_RGBA8;
+			format = GL_RGBA;
+			type = GL_UNSIGNED_BYTE;
+		}
+		glGenTextures(1, &texture.texture);
+		glBindTexture(GL_TEXTURE_2D, texture.texture);
+		glTexStorage2D(GL_TEXTURE_2D, texture.levels, texture.internal_format, texture.width, texture.height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		unsigned char value[16] = { 0x40, 0x80, 0xC0, 0xFF };
+		for (int level = 0; level < texture.levels; level++) {
+			glClearTexImage(texture.texture, level, format, type, value);
+		}
+		invalidateTextureInfo(texture.texture);
+	}
+
+	/**
+	 * @brief Replayed texture of a recorded one, created the first time.
+	 * A texture the plugin never read (e.g. its requests were disposed before) gets the given size
+	 */
+	GLuint mapTexture(int64_t recorded, int width, int height) {
+		ReplayTexture& texture = textures[recorded];
+		if (texture.texture == 0) {
+			if (texture.width == 0) {
+				texture.width = std::max(width, 1);
+				texture.height = std::max(height, 1);
+			}
+			createTexture(texture);
+		}
+		return texture.texture;
+	}
+
+	/**
+	 * @brief A texture changed size or format in the recording (e.g. a resized render target):
+	 * create it again. It happens after the first read of the new texture, which used the old one
+	 */
+	void updateTexture(const LoggedCall& call) {
+		int miplevel = (int)call.values[1];
+		int width = std::max(1, (int)call.values[2] << miplevel);
+		int height = std::max(1, (int)call.values[3] << miplevel);
+		ReplayTexture& texture = textures[call.values[0]];
+		if (texture.texture == 0 || (texture.width == width && texture.height == height
+			&& texture.internal_format == (GLint)call.values[5])) {
+			return;
+		}
+		glDeleteTextures(1, &texture.texture);
+		invalidateTextureInfo(texture.texture);
+		texture.width = width;
+		texture.height = height;
+		texture.levels = std::max(texture.levels, miplevel + 1);
+		texture.internal_format = (GLint)call.values[5];
+		createTexture(texture);
+	}
+
+	void rewriteTextures() {
+		rewrite_value++;
+		for (std::map<int64_t,ReplayTexture>::iterator it = textures.begin(); it != textures.end(); ++it) {
+			if (it->second.texture != 0) {
+				unsigned char value[16] = { rewrite_value, rewrite_value, rewrite_value, 0xFF };
+				glClearTexImage(it->second.texture, 0, getFormatFromInternalFormat(it->second.internal_format),
+					getTypeFromInternalFormat(it->second.internal_format), value);
+			}
+		}
+	}
+
+	void applyOverrides() {
+		if (overrides.strategy >= 0) {
+			setFenceWaitStrategy(overrides.strategy, overrides.timeout_us);
+		}
+		if (overrides.frame_budget >= 0) {
+			setFrameBudget(overrides.frame_budget, overrides.max_latency_frames);
+		}
+		if (overrides.bulk_budget >= 0) {
+			setBulkBudget(overrides.bulk_budget);
+		}
+		if (overrides.coalesce >= 0) {
+			setCoalescing(overrides.coalesce != 0);
+		}
+		if (overrides.lazy >= 0) {
+			setLazyMapping(overrides.lazy != 0);
+		}
+		if (overrides.pinned >= 0) {
+			setPinnedMemory(overrides.pinned != 0);
+		}
+		if (overrides.pbo_pool >= 0) {
+			setPboPoolSize(overrides.pbo_pool);
+		}
+		if (overrides.max_cached_bytes >= 0) {
+			setAllocatorOptions(0, overrides.max_cached_bytes);
+		}
+	}
+
+	void addRequest(int64_t recorded, int event_id) {
+		events[recorded] = event_id;
+		requests[event_id].created_at = std::chrono::steady_clock::now();
+		result.requests++;
+	}
+
+	/**
+	 * @brief A replayed call saw the state of a request: count its completion the first time
+	 * @param length Size of the data, -1 if the call doesn't give it
+	 */
+	void observe(int event_id, bool done, bool error, long long length) {
+		std::map<int,ReplayRequest>::iterator it = requests.find(event_id);
+		if (it == requests.end()) {
+			return;
+		}
+		ReplayRequest& request = it->second;
+		if ((done || error) && !request.completed) {
+			request.completed = true;
+			if (error) {
+				result.errors++;
+			}
+			else {
+				result.completed++;
+				result.latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request.created_at).count());
+			}
+		}
+		if (done && !error && length > 0 && !request.counted) {
+			request.counted = true;
+			result.bytes += length;
+		}
+	}
+
+	void forget(int event_id) {
+		requests.erase(event_id);
+	}
+
+	std::string replayPath(const char* name, const char* suffix) {
+		return files_directory + "/" + name + std::to_string(next_file++) + suffix;
+	}
+
+	/**
+	 * @brief Replay one call
+	 * @return false if it was skipped
+	 */
+	bool replay(const LoggedCall& call) {
+		const std::vector<int64_t>& v = call.values;
+		// Values of the call, 0 for the missing ones of a damaged record
+		#define VALUE(i) ((size_t)(i) < v.size() ? v[(i)] : 0)
+		switch (call.call) {
+			case CALL_TEXTURE:
+				if (v.size() < 6) {
+					return false;
+				}
+				updateTexture(call);
+				return false;
+			case CALL_IS_COMPATIBLE:
+				isCompatible();
+				return true;
+			case CALL_MAKE_REQUEST:
+				addRequest(VALUE(2), makeRequest_mainThread(mapTexture(VALUE(0), 0, 0), (int)VALUE(1)));
+				return true;
+			case CALL_MAKE_REQUEST_WITH_SIZE: {
+				GLuint texture = mapTexture(VALUE(0), (int)VALUE(2), (int)VALUE(3));
+				addRequest(VALUE(4), makeRequestWithSize_mainThread(texture, (int)VALUE(1), (int)VALUE(2), (int)VALUE(3)));
+				return true;
+			}
+			case CALL_SET_REQUEST_REGION:
+				setRequestRegion(mapId(events, VALUE(0)), (int)VALUE(1), (int)VALUE(2), (int)VALUE(3), (int)VALUE(4));
+				return true;
+			case CALL_SET_REQUEST_DESTINATION: {
+				int event_id = mapId(events, VALUE(0));
+				std::map<int,ReplayRequest>::iterator it = requests.find(event_id);
+				if (it == requests.end() || VALUE(1) <= 0) {
+					setRequestDestination(event_id, NULL, 0);
+					return true;
+				}
+				it->second.destination.resize((size_t)VALUE(1));
+				setRequestDestination(event_id, it->second.destination.data(), VALUE(1));
+				return true;
+			}
+			case CALL_SET_REQUEST_PRIORITY:
+				setRequestPriority(mapId(events, VALUE(0)), (int)VALUE(1), (int)VALUE(2));
+				return true;
+			case CALL_SET_REQUEST_YUV:
+				setRequestYuv(mapId(events, VALUE(0)), (int)VALUE(1));
+				return true;
+			case CALL_SET_REQUEST_REDUCTION:
+				setRequestReduction(mapId(events, VALUE(0)), (int)VALUE(1), (int)VALUE(2));
+				return true;
+			case CALL_SET_REQUEST_POINTS: {
+				std::vector<int> points;
+				for (int64_t i = 0; i < VALUE(1); i++) {
+					points.push_back((int)VALUE(2 + i));
+				}
+				setRequestPoints(mapId(events, VALUE(0)), points.data(), (int)points.size() / 2);
+				return true;
+			}
+			case CALL_SET_REQUEST_CHUNKS:
+				setRequestChunks(mapId(events, VALUE(0)), (int)VALUE(1), (int)VALUE(2));
+				return true;
+			case CALL_SET_REQUEST_DISK_WRITER:
+				setRequestDiskWriter(mapId(events, VALUE(0)), mapId(disk_writers, VALUE(1)), (int)VALUE(2));
+				return true;
+			case CALL_SET_REQUEST_HASHING:
+				setRequestHashing(mapId(events, VALUE(0)), (int)VALUE(1));
+				return true;
+			case CALL_RESET_HASH_STREAM:
+				resetHashStream((int)VALUE(0));
+				return true;
+			case CALL_MAKE_REQUEST_RENDER_THREAD:
+				makeRequest_renderThread(mapId(events, VALUE(0)));
+				return true;
+			case CALL_SUBMIT_REQUEST:
+				submitRequest(mapId(events, VALUE(0)));
+				return true;
+			case CALL_SUBMIT_REQUESTS: {
+				std::vector<int> event_ids;
+				for (int64_t i = 0; i < VALUE(0); i++) {
+					event_ids.push_back(mapId(events, VALUE(1 + i)));
+				}
+				submitRequests(event_ids.data(), (int)event_ids.size());
+				return true;
+			}
+			case CALL_SCHEDULE_FRAME:
+				if (rewrite) {
+					rewriteTextures();
+				}
+				scheduleFrame_renderThread((int)VALUE(0));
+				return true;
+			case CALL_UPDATE:
+				update_renderThread(mapId(events, VALUE(0)));
+				return true;
+			case CALL_MAKE_REQUEST_BATCH: {
+				// priority, batch_id, then the textures, widths, heights and event_ids arrays
+				int count = (int)VALUE(2);
+				std::vector<GLuint> batch_textures(count);
+				std::vector<int> widths(count), heights(count), event_ids(count);
+				for (int i = 0; i < count; i++) {
+					widths[i] = (int)VALUE(3 + (count + 1) + i);
+					heights[i] = (int)VALUE(3 + 2 * (count + 1) + i);
+					batch_textures[i] = mapTexture(VALUE(3 + i), widths[i], heights[i]);
+				}
+				int batch_id = makeRequestBatch_mainThread(batch_textures.data(), widths.data(), heights.data(), count,
+					(int)VALUE(0), event_ids.data());
+				batches[VALUE(1)] = batch_id;
+				for (int i = 0; i < count; i++) {
+					addRequest(VALUE(3 + 3 * (count + 1) + i), event_ids[i]);
+				}
+				return true;
+			}
+			case CALL_MAKE_REQUEST_BATCH_RENDER_THREAD:
+				makeRequestBatch_renderThread(mapId(batches, VALUE(0)));
+				return true;
+			case CALL_UPDATE_BATCHES:
+				updateBatches_renderThread((int)VALUE(0));
+				return true;
+			case CALL_DRAIN_COMPLETED_REQUESTS: {
+				completed.resize(std::max<int64_t>(VALUE(0), 0));
+				int count = drainCompletedRequests(completed.data(), (int)completed.size());
+				for (int i = 0; i < count; i++) {
+					observe(completed[i].event_id, true, completed[i].error != 0, completed[i].length);
+				}
+				return true;
+			}
+			case CALL_DISPOSE_REQUESTS: {
+				std::vector<int> event_ids;
+				for (int64_t i = 0; i < VALUE(0); i++) {
+					event_ids.push_back(mapId(events, VALUE(1 + i)));
+				}
+				disposeRequests(event_ids.data(), (int)event_ids.size());
+				for (size_t i = 0; i < event_ids.size(); i++) {
+					forget(event_ids[i]);
+				}
+				return true;
+			}
+			case CALL_GET_DATA: {
+				int event_id = mapId(events, VALUE(0));
+				void* buffer = NULL;
+				size_t length = 0;
+				getData_mainThread(event_id, &buffer, &length);
+				if (buffer != NULL) {
+					observe(event_id, true, false, (long long)length);
+				}
+				return true;
+			}
+			case CALL_GET_DATA_RANGE:
+				scratch.resize(std::max<int64_t>(VALUE(2), 1));
+				getDataRange_mainThread(mapId(events, VALUE(0)), VALUE(1), (int)VALUE(2), scratch.data());
+				return true;
+			case CALL_IS_REQUEST_DONE: {
+				int event_id = mapId(events, VALUE(0));
+				if (isRequestDone(event_id)) {
+					observe(event_id, true, isRequestError(event_id), -1);
+				}
+				return true;
+			}
+			case CALL_IS_REQUEST_ERROR: {
+				int event_id = mapId(events, VALUE(0));
+				if (isRequestError(event_id)) {
+					observe(event_id, false, true, -1);
+				}
+				return true;
+			}
+			case CALL_GET_REQUEST_PROGRESS:
+				getRequestProgress(mapId(events, VALUE(0)));
+				return true;
+			case CALL_GET_REQUEST_HASH: {
+				uint64_t hash;
+				getRequestHash(mapId(events, VALUE(0)), &hash);
+				return true;
+			}
+			case CALL_GET_REQUEST_STATUS: {
+				int event_id = mapId(events, VALUE(0));
+				void* buffer = NULL;
+				int length = 0;
+				int status = getRequestStatus(event_id, &buffer, &length);
+				observe(event_id, (status & STATUS_DONE) != 0, (status & STATUS_ERROR) != 0, length);
+				return true;
+			}
+			case CALL_DISPOSE: {
+				int event_id = mapId(events, VALUE(0));
+				dispose(event_id);
+				forget(event_id);
+				return true;
+			}
+			case CALL_SET_BULK_BUDGET:
+				if (overrides.bulk_budget >= 0) {
+					return false;
+				}
+				setBulkBudget(VALUE(0));
+				return true;
+			case CALL_SET_FRAME_BUDGET:
+				if (overrides.frame_budget >= 0) {
+					return false;
+				}
+				setFrameBudget(VALUE(0), (int)VALUE(1));
+				return true;
+			case CALL_GET_SCHEDULER_STATS: {
+				SchedulerStats stats;
+				getSchedulerStats(&stats);
+				return true;
+			}
+			case CALL_SET_COALESCING:
+				if (overrides.coalesce >= 0) {
+					return false;
+				}
+				setCoalescing(VALUE(0) != 0);
+				return true;
+			case CALL_SET_LAZY_MAPPING:
+				if (overrides.lazy >= 0) {
+					return false;
+				}
+				setLazyMapping(VALUE(0) != 0);
+				return true;
+			case CALL_SET_PINNED_MEMORY:
+				if (overrides.pinned >= 0) {
+					return false;
+				}
+				setPinnedMemory(VALUE(0) != 0);
+				return true;
+			case CALL_GET_PINNED_MEMORY_MODE:
+				getPinnedMemoryMode();
+				return true;
+			case CALL_SET_FENCE_WAIT_STRATEGY:
+				if (overrides.strategy >= 0) {
+					return false;
+				}
+				setFenceWaitStrategy((int)VALUE(0), (int)VALUE(1));
+				return true;
+			case CALL_INVALIDATE_TEXTURE_INFO: {
+				std::map<int64_t,ReplayTexture>::iterator it = textures.find(VALUE(0));
+				if (VALUE(0) == 0 || it != textures.end()) {
+					invalidateTextureInfo(VALUE(0) == 0 ? 0 : it->second.texture);
+				}
+				return true;
+			}
+			case CALL_SET_ALLOCATOR_OPTIONS:
+				if (overrides.max_cached_bytes >= 0) {
+					return false;
+				}
+				setAllocatorOptions((int)VALUE(0), VALUE(1));
+				return true;
+			case CALL_RESERVE_BUFFERS:
+				reserveBuffers((int)VALUE(0), (int)VALUE(1));
+				return true;
+			case CALL_SET_PBO_POOL_SIZE:
+				if (overrides.pbo_pool >= 0) {
+					return false;
+				}
+				setPboPoolSize((int)VALUE(0));
+				return true;
+			case CALL_CREATE_VIDEO_SINK: {
+				if (files_directory.empty()) {
+					return false;
+				}
+				GLuint texture = mapTexture(VALUE(0), (int)VALUE(1), (int)VALUE(2));
+				std::string path = replayPath("video_", ".nv12");
+				video_sinks[VALUE(5)] = createVideoSink(texture, (int)VALUE(1), (int)VALUE(2), path.c_str(), (int)VALUE(3),
+					VIDEO_ENCODER_RAW_NV12, NULL);
+				return true;
+			}
+			case CALL_CAPTURE_VIDEO_SINK:
+				captureVideoSink_renderThread(mapId(video_sinks, VALUE(0)));
+				return true;
+			case CALL_CLOSE_VIDEO_SINK:
+				closeVideoSink(mapId(video_sinks, VALUE(0)));
+				return true;
+			case CALL_GET_VIDEO_SINK_STATS: {
+				VideoSinkStats stats;
+				getVideoSinkStats(mapId(video_sinks, VALUE(0)), &stats);
+				return true;
+			}
+			case CALL_CREATE_MAILBOX:
+				mailboxes[VALUE(3)] = createMailbox(mapTexture(VALUE(0), (int)VALUE(1), (int)VALUE(2)), (int)VALUE(1), (int)VALUE(2));
+				return true;
+			case CALL_CAPTURE_MAILBOX:
+				captureMailbox_renderThread(mapId(mailboxes, VALUE(0)));
+				return true;
+			case CALL_ACQUIRE_MAILBOX_FRAME: {
+				void* buffer = NULL;
+				int length = 0;
+				uint32_t frame = 0;
+				acquireMailboxFrame(mapId(mailboxes, VALUE(0)), &buffer, &length, &frame);
+				return true;
+			}
+			case CALL_RELEASE_MAILBOX_FRAME:
+				releaseMailboxFrame(mapId(mailboxes, VALUE(0)));
+				return true;
+			case CALL_CLOSE_MAILBOX:
+				closeMailbox(mapId(mailboxes, VALUE(0)));
+				return true;
+			case CALL_CREATE_DISK_WRITER: {
+				if (files_directory.empty()) {
+					return false;
+				}
+				std::string path = replayPath("disk_", "_%d.raw");
+				disk_writers[VALUE(5)] = createDiskWriter(path.c_str(), (int)VALUE(0), (int)VALUE(1), VALUE(2) != 0,
+					(int)VALUE(3), (int)VALUE(4));
+				return true;
+			}
+			case CALL_GET_DISK_WRITER_STATS: {
+				DiskWriterStats stats;
+				getDiskWriterStats(mapId(disk_writers, VALUE(0)), &stats);
+				return true;
+			}
+			case CALL_CLOSE_DISK_WRITER:
+				closeDiskWriter(mapId(disk_writers, VALUE(0)), NULL);
+				return true;
+			case CALL_GET_MEMORY_STATS: {
+				BufferAllocatorStats stats;
+				getMemoryStats(&stats);
+				return true;
+			}
+			case CALL_CREATE_COMPLETION_QUEUE:
+				completion_queues[VALUE(0)] = createCompletionQueue();
+				return true;
+			case CALL_CLOSE_COMPLETION_QUEUE:
+				closeCompletionQueue(mapId(completion_queues, VALUE(0)));
+				return true;
+			case CALL_MAKE_QUEUED_REQUEST_BATCH: {
+				int count = (int)VALUE(3);
+				std::vector<GLuint> batch_textures(count);
+				std::vector<int> widths(count), heights(count), event_ids(count);
+				for (int i = 0; i < count; i++) {
+					widths[i] = (int)VALUE(4 + (count + 1) + i);
+					heights[i] = (int)VALUE(4 + 2 * (count + 1) + i);
+					batch_textures[i] = mapTexture(VALUE(4 + i), widths[i], heights[i]);
+				}
+				int batch_id = makeQueuedRequestBatch_mainThread(mapId(completion_queues, VALUE(0)), batch_textures.data(),
+					widths.data(), heights.data(), count, (int)VALUE(1), event_ids.data());
+				batches[VALUE(2)] = batch_id;
+				for (int i = 0; i < count; i++) {
+					addRequest(VALUE(4 + 3 * (count + 1) + i), event_ids[i]);
+				}
+				return true;
+			}
+			case CALL_DRAIN_COMPLETION_QUEUE: {
+				completed.resize(std::max<int64_t>(VALUE(1), 0));
+				int count = drainCompletionQueue(mapId(completion_queues, VALUE(0)), completed.data(), (int)completed.size());
+				for (int i = 0; i < count; i++) {
+					observe(completed[i].event_id, true, completed[i].error != 0, completed[i].length);
+				}
+				return true;
+			}
+			default:
+				return false;
+		}
+		#undef VALUE
+	}
+
+	/**
+	 * @brief Dispose what the log left, close the sinks and writers and delete the files
+	 */
+	void cleanup() {
+		for (std::map<int,ReplayRequest>::iterator it = requests.begin(); it != requests.end(); ++it) {
+			dispose(it->first);
+		}
+		requests.clear();
+		for (std::map<int64_t,int>::iterator it = video_sinks.begin(); it != video_sinks.end(); ++it) {
+			closeVideoSink(it->second);
+		}
+		for (std::map<int64_t,int>::iterator it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+			closeMailbox(it->second);
+		}
+		for (std::map<int64_t,int>::iterator it = disk_writers.begin(); it != disk_writers.end(); ++it) {
+			closeDiskWriter(it->second, NULL);
+		}
+		for (std::map<int64_t,int>::iterator it = completion_queues.begin(); it != completion_queues.end(); ++it) {
+			closeCompletionQueue(it->second);
+		}
+		for (std::map<int64_t,ReplayTexture>::iterator it = textures.begin(); it != textures.end(); ++it) {
+			if (it->second.texture != 0) {
+				glDeleteTextures(1, &it->second.texture);
+				invalidateTextureInfo(it->second.texture);
+			}
+		}
+		if (!files_directory.empty()) {
+			DIR* directory = opendir(files_directory.c_str());
+			if (directory != NULL) {
+				struct dirent* entry;
+				while ((entry = readdir(directory)) != NULL) {
+					if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) {
+						unlink((files_directory + "/" + entry->d_name).c_str());
+					}
+				}
+				closedir(directory);
+			}
+			rmdir(files_directory.c_str());
+		}
+	}
+};
+
+static double percentile(std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static bool parseSwitch(const char* value, int& flag) {
+	if (std::strcmp(value, "on") == 0 || std::strcmp(value, "off") == 0) {
+		flag = (std::strcmp(value, "on") == 0) ? 1 : 0;
+		return true;
+	}
+	return false;
+}
+
+static void writeResult(FILE* out, const char* log, double speed, const Overrides& overrides, ReplayResult& r) {
+	SchedulerStats stats;
+	getSchedulerStats(&stats);
+	std::sort(r.latencies.begin(), r.latencies.end());
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	std::fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"gl_version\": \"%s\",\n  \"log\": \"%s\",\n  \"speed\": %.3f,\n",
+		(const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION), log, speed);
+	std::fprintf(out, "  \"overrides\": {\"strategy\": \"%s\", \"frame_budget\": %lld, \"max_latency_frames\": %d, \"bulk_budget\": %lld, "
+		"\"coalesce\": %d, \"lazy\": %d, \"pinned\": %d, \"pbo_pool\": %d, \"max_cached_bytes\": %lld},\n",
+		overrides.strategy >= 0 ? strategy_names[overrides.strategy] : "recorded", overrides.frame_budget, overrides.max_latency_frames,
+		overrides.bulk_budget, overrides.coalesce, overrides.lazy, overrides.pinned, overrides.pbo_pool, overrides.max_cached_bytes);
+	std::fprintf(out, "  \"calls\": %lld, \"skipped\": %lld, \"requests\": %lld, \"completed\": %lld, \"errors\": %lld, "
+		"\"deferred\": %lld, \"expired\": %lld, \"coalesced\": %lld,\n",
+		r.calls, r.skipped, r.requests, r.completed, r.errors,
+		(long long)stats.deferred_requests, (long long)stats.expired_requests, (long long)stats.coalesced_requests);
+	std::fprintf(out, "  \"recorded_s\": %.4f, \"elapsed_s\": %.4f, \"max_lag_ms\": %.3f, \"mb_per_s\": %.2f, "
+		"\"call_ms\": %.3f, \"render_thread_ms\": %.3f,\n",
+		r.recorded_s, r.elapsed_s, r.max_lag_ms, r.elapsed_s > 0 ? r.bytes / r.elapsed_s / 1e6 : 0, r.call_ms, r.render_thread_ms);
+	std::fprintf(out, "  \"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, \"peak_rss_kb\": %ld,\n",
+		percentile(r.latencies, 0.50), percentile(r.latencies, 0.90), percentile(r.latencies, 0.99),
+		r.latencies.empty() ? 0 : r.latencies.back(), usage.ru_maxrss);
+	std::fprintf(out, "  \"per_call\": {");
+	bool first = true;
+	for (int i = 0; i < RECORDED_CALL_COUNT; i++) {
+		const CallStats& call = r.per_call[i];
+		if (call.count == 0) {
+			continue;
+		}
+		std::fprintf(out, "%s\n    \"%s\": {\"count\": %lld, \"total_ms\": %.3f, \"max_ms\": %.3f}",
+			first ? "" : ",", recorded_call_names[i], call.count, call.total_ms, call.max_ms);
+		first = false;
+	}
+	std::fprintf(out, "\n  }\n}\n");
+}
+
+int main(int argc, char** argv) {
+	const char* log = NULL;
+	const char* output = NULL;
+	const char* trace = NULL;
+	double speed = 1.0;
+	bool rewrite = false;
+	Overrides overrides;
+	bool usage = (argc < 2);
+	for (int i = 1; i < argc && !usage; i++) {
+		std::string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if (arg == "--speed" && has_value) {
+			speed = std::atof(argv[++i]);
+		}
+		else if (arg == "--strategy" && has_value) {
+			std::string name = argv[++i];
+			for (int s = 0; s < 3; s++) {
+				if (name == strategy_names[s]) {
+					overrides.strategy = s;
+				}
+			}
+			usage = (overrides.strategy < 0);
+		}
+		else if (arg == "--timeout-us" && has_value) {
+			overrides.timeout_us = std::atoi(argv[++i]);
+		}
+		else if (arg == "--frame-budget" && has_value) {
+			overrides.frame_budget = std::atoll(argv[++i]);
+		}
+		else if (arg == "--max-latency-frames" && has_value) {
+			overrides.max_latency_frames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--bulk-budget" && has_value) {
+			overrides.bulk_budget = std::atoll(argv[++i]);
+		}
+		else if (arg == "--coalesce" && has_value) {
+			usage = !parseSwitch(argv[++i], overrides.coalesce);
+		}
+		else if (arg == "--lazy" && has_value) {
+			usage = !parseSwitch(argv[++i], overrides.lazy);
+		}
+		else if (arg == "--pinned" && has_value) {
+			usage = !parseSwitch(argv[++i], overrides.pinned);
+		}
+		else if (arg == "--pbo-pool" && has_value) {
+			overrides.pbo_pool = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--max-cached-bytes" && has_value) {
+			overrides.max_cached_bytes = std::max(0LL, std::atoll(argv[++i]));
+		}
+		else if (arg == "--rewrite") {
+			rewrite = true;
+		}
+		else if (arg == "--output" && has_value) {
+			output = argv[++i];
+		}
+		else if (arg == "--trace" && has_value) {
+			trace = argv[++i];
+		}
+		else if (arg[0] != '-' && log == NULL) {
+			log = argv[i];
+		}
+		else {
+			usage = true;
+		}
+	}
+	if (usage || log == NULL) {
+		std::fprintf(stderr, "Usage: %s log [--speed factor] [--strategy poll|client_wait|thread] [--timeout-us us] "
+			"[--frame-budget bytes] [--max-latency-frames frames] [--bulk-budget bytes] [--coalesce on|off] [--lazy on|off] "
+			"[--pinned on|off] [--pbo-pool count] [--max-cached-bytes bytes] [--rewrite] [--output file] [--trace file]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<LoggedCall> calls;
+	if (!callLogRead(log, calls)) {
+		std::fprintf(stderr, "Could not read the call log %s\n", log);
+		return 1;
+	}
+
+	HeadlessContext headless;
+	if (!createHeadlessContext(headless)) {
+		std::fprintf(stderr, "Could not create a headless OpenGL context\n");
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (output != NULL) {
+		out = std::fopen(output, "w");
+		if (out == NULL) {
+			std::fprintf(stderr, "Could not open %s\n", output);
+			return 1;
+		}
+	}
+
+	setTraceEnabled(trace != NULL);
+	Replayer replayer(overrides, rewrite);
+	ReplayResult result = replayer.run(calls, speed);
+	writeResult(out, log, speed, overrides, result);
+
+	if (out != stdout) {
+		std::fclose(out);
+	}
+	if (trace != NULL) {
+		std::fprintf(stderr, "%d trace events written to %s\n", dumpTrace(trace), trace);
+	}
+	UnityPluginUnload();
+	destroyHeadlessContext(headless);
+	return 0;
+}
@@ -1,49 +1,463 @@
 #include <cstddef>
+#include <cstdint>
+#include <climits>
 #include <map>
+#include <deque>
 #include <mutex>
 #include <memory>
 #include <cstring>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 #include "Unity/IUnityInterface.h"
 #include "Unity/IUnityGraphics.h"
 #include <iostream>
 #include "TypeHelpers.hpp"
+#include "SharedContext.hpp"
+#include "TraceRecorder.hpp"
+#include "CallRecorder.hpp"
+#include "BufferAllocator.hpp"
+#include "PinnedMemory.hpp"
+#include "VideoSink.hpp"
+#include "DiskWriter.hpp"
+#include "FrameHash.hpp"
+#include "YuvConversion.hpp"
+#include "Reduction.hpp"
+#include "PixelGather.hpp"
 
-#define DEBUG 1
+// Built with -DDEBUG (make DEBUG=1): OpenGL debug output logged to /tmp
 #ifdef DEBUG
 	#include <fstream>
-	#include <thread>
 #endif
 
-struct Task {
-	GLuint texture;
-	GLuint fbo;
+/**
+ * How the completion of the fence of a request is detected
+ */
+enum FenceWaitStrategy {
+	// Non-blocking glGetSynciv on each update_renderThread (default)
+	FENCE_WAIT_POLL = 0,
+	// glClientWaitSync bounded by a timeout on each update_renderThread
+	FENCE_WAIT_CLIENT_WAIT = 1,
+	// A readback thread with a shared context blocks on fences, maps and copies
+	// the buffers as soon as they signal. The render thread only issues the reads.
+	FENCE_WAIT_THREAD = 2
+};
+
+/**
+ * Urgency of a request, the most urgent pending requests are issued first
+ */
+enum RequestPriority {
+	// Background captures, limited by the bulk budget of each frame
+	PRIORITY_BULK = 0,
+	// Issued right away (default)
+	PRIORITY_NORMAL = 1,
+	// Issued right away, before any other pending request
+	PRIORITY_HIGH = 2
+};
+
+/**
+ * Flags returned by getRequestStatus
+ */
+enum RequestStatus {
+	REQUEST_STATUS_VALID = 1,
+	// The read has been issued to the GPU
+	REQUEST_STATUS_ISSUED = 2,
+	REQUEST_STATUS_DONE = 4,
+	REQUEST_STATUS_ERROR = 8,
+	// Same data as the previous frame of its hash stream, delivered without data (setRequestHashing)
+	REQUEST_STATUS_DUPLICATE = 16
+};
+
+// Issued tasks whose fence has not been seen signaled yet
+static std::atomic<int> tasks_in_flight(0);
+
+// Pixel buffer holding the data of a released request: left mapped by
+// a lazy request (setLazyMapping), pinned (setPinnedMemory), or still
+// written by the GPU (disposed in flight, its fence not deleted yet)
+struct MappedPbo {
 	GLuint pbo;
+	size_t size;
+	bool dsa;
+	bool pinned;
+	PinnedBuffer pinned_buffer;
+	bool mapped;
 	GLsync fence;
-	bool initialized = false;
-	bool error = false;
-	bool done = false;
-	void* data;
+};
+// Pixel buffers of the lazy, pinned and in flight requests released from any thread,
+// unmapped and given back to their pool by the render thread (see releaseMappedPbos)
+static std::vector<MappedPbo> released_mapped_pbos;
+static std::mutex released_mapped_pbos_mutex;
+static std::atomic<bool> lazy_mapping_enabled(false);
+
+/**
+ * Buffer the chunks of a chunked request (setRequestChunks) are written to,
+ * shared by the request and its chunks
+ */
+struct ChunkedRead {
+	// Destination of the request, or allocated
+	void* data = nullptr;
+	bool allocated = false;
+	// Held while writing a chunk, so that once the request is disposed it is not written anymore
+	std::mutex mutex;
+	bool disposed = false;
+
+	~ChunkedRead() {
+		if (allocated) {
+			bufferRelease(data);
+		}
+	}
+};
+
+struct Task {
+	int event_id = 0;
+	GLuint texture;
+	GLuint fbo = 0;
+	GLuint pbo = 0;
+	// Until deleted, once the task is completed
+	GLsync fence = 0;
+	std::atomic<bool> initialized{false};
+	std::atomic<bool> error{false};
+	std::atomic<bool> done{false};
+	bool dsa = false;
+	FenceWaitStrategy wait_strategy = FENCE_WAIT_POLL;
+	void* data = nullptr;
+	// Caller-provided destination (setRequestDestination), written instead of an allocated buffer
+	void* destination = nullptr;
+	size_t destination_capacity = 0;
+	// Held while writing to the destination, so that once dispose returns it is not written anymore
+	std::mutex destination_mutex;
+	// Lazy mapping: once done, the pbo stays mapped and data is only copied when asked for
+	bool lazy = false;
+	void* mapped = nullptr;
+	// The pbo is backed by host memory, which is the data once done (setPinnedMemory)
+	bool pinned = false;
+	PinnedBuffer pinned_buffer;
+	// Held while copying the mapped pbo to data
+	std::mutex data_mutex;
+	std::atomic<bool> disposed{false};
 	int miplevel;
-	int size;
+	int expected_width = 0;
+	int expected_height = 0;
+	int region_x = 0;
+	int region_y = 0;
+	int region_width = 0;
+	int region_height = 0;
+	YuvFormat yuv_format = YUV_FORMAT_NONE;
+	ReductionType reduction = REDUCTION_NONE;
+	int reduction_bins = 0;
+	// x, y of the points to gather, instead of the whole level (setRequestPoints)
+	std::vector<int> points;
+	int priority = PRIORITY_NORMAL;
+	bool has_deadline = false;
+	std::chrono::steady_clock::time_point deadline;
+	// Already counted in the deferred counters
+	bool deferred = false;
+	// Scheduler frame the read was issued in, while counted in tasks_in_flight
+	uint32_t issue_frame = 0;
+	std::atomic<bool> in_flight{false};
+	// Video sink the frame is pushed to instead of being kept in data (captureVideoSink_renderThread)
+	std::shared_ptr<VideoSink> sink;
+	// Disk writer the data is written to instead of being kept (setRequestDiskWriter)
+	std::shared_ptr<DiskWriter> disk_writer;
+	int disk_index = 0;
+	// Hash of the data, computed while it is copied out of the pbo (setRequestHashing)
+	bool hashing = false;
+	// Stream the data is compared with, 0 for none
+	int hash_stream = 0;
+	uint64_t hash = 0;
+	// Same data as the previous frame of the stream, not delivered
+	bool duplicate = false;
+	// Coalesced request: the task doing the read, whose data is shared (kept alive by this reference)
+	std::shared_ptr<Task> shared_read;
+	// Other requests share this read, it is issued even if disposed. Render thread only
+	bool shared = false;
+	uint32_t submit_frame = 0;
+	// Chunked read: the region is read by bands of chunk_rows rows, chunks_per_frame per frame
+	std::shared_ptr<ChunkedRead> chunked;
+	int chunk_rows = 0;
+	int chunks_per_frame = 1;
+	// Chunks of the request, render thread only
+	std::vector<std::shared_ptr<Task>> chunks;
+	size_t next_chunk = 0;
+	uint32_t chunk_frame = 0;
+	std::atomic<int> chunk_count{0};
+	std::atomic<int> chunks_done{0};
+	// Chunk of a chunked request: the buffer its destination points into
+	std::shared_ptr<ChunkedRead> chunk_target;
+	size_t size;
 	int height;
 	int width;
 	int depth;
 	GLint internal_format;
+	GLenum format;
+	GLenum type;
+
+	~Task() {
+		if (in_flight) {
+			tasks_in_flight--;
+		}
+		if (destination == nullptr && shared_read == nullptr && chunked == nullptr && !pinned) {
+			bufferRelease(data);
+		}
+		if (mapped != nullptr) {
+			std::lock_guard<std::mutex> lock(released_mapped_pbos_mutex);
+			released_mapped_pbos.push_back({ pbo, size, dsa, false, PinnedBuffer(), true, 0 });
+		}
+		// Disposed before its fence was seen signaled (or failed): the pbo is given back
+		// once the GPU is done writing to it
+		else if (fence != 0) {
+			std::lock_guard<std::mutex> lock(released_mapped_pbos_mutex);
+			released_mapped_pbos.push_back({ pbo, size, dsa, pinned, pinned_buffer, false, fence });
+		}
+		else if (pinned) {
+			std::lock_guard<std::mutex> lock(released_mapped_pbos_mutex);
+			released_mapped_pbos.push_back({ pbo, size, dsa, true, pinned_buffer, false, 0 });
+		}
+	}
 };
 
 static IUnityInterfaces* unity_interfaces = NULL;
 static IUnityGraphics* graphics = NULL;
 static UnityGfxRenderer renderer = kUnityGfxRendererNull;
 
-static std::map<int,std::shared_ptr<Task>> tasks;
-static std::mutex tasks_mutex;
-int next_event_id = 1;
+/**
+ * Texture level informations and derived read descriptor,
+ * cached per (texture id, miplevel)
+ */
+struct TextureInfo {
+	GLint width;
+	GLint height;
+	GLint depth;
+	GLint internal_format;
+	GLenum format;
+	GLenum type;
+	int pixel_size;
+	// 0 if it doesn't fit in memory
+	size_t size;
+};
+
+/**
+ * Requests by event_id. Split in shards, each with its own lock, so that
+ * requests made, queried and disposed from many threads rarely wait for each other.
+ */
+struct alignas(64) TaskShard {
+	std::mutex mutex;
+	std::map<int,std::shared_ptr<Task>> tasks;
+};
+static const int TASK_SHARD_COUNT = 16;
+static TaskShard task_shards[TASK_SHARD_COUNT];
+static std::atomic<int> next_event_id(1);
+
+inline TaskShard& getTaskShard(int event_id) {
+	return task_shards[(unsigned int)event_id % TASK_SHARD_COUNT];
+}
+
+static void addTask(const std::shared_ptr<Task>& task) {
+	TaskShard& shard = getTaskShard(task->event_id);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	shard.tasks[task->event_id] = task;
+}
+
+/**
+ * @return The task of event_id, null if it doesn't exist or has been disposed
+ */
+static std::shared_ptr<Task> findTask(int event_id) {
+	TaskShard& shard = getTaskShard(event_id);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::map<int,std::shared_ptr<Task>>::iterator it = shard.tasks.find(event_id);
+	if (it == shard.tasks.end()) {
+		return nullptr;
+	}
+	return it->second;
+}
+
+static std::shared_ptr<Task> removeTask(int event_id) {
+	TaskShard& shard = getTaskShard(event_id);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::map<int,std::shared_ptr<Task>>::iterator it = shard.tasks.find(event_id);
+	if (it == shard.tasks.end()) {
+		return nullptr;
+	}
+	std::shared_ptr<Task> task = it->second;
+	shard.tasks.erase(it);
+	return task;
+}
+
+/**
+ * Requests submitted from any thread with submitRequest, until the next
+ * scheduleFrame_renderThread event. One queue per submitting thread, living
+ * until the plugin is unloaded, so that submitting threads don't contend with each other.
+ */
+struct SubmitQueue {
+	std::mutex mutex;
+	std::vector<int> event_ids;
+};
+static std::vector<SubmitQueue*> submit_queues;
+static std::mutex submit_queues_mutex;
+static thread_local SubmitQueue* submit_queue = NULL;
+
+/**
+ * A completed request returned by drainCompletedRequests, also read by the managed plugin (keep it blittable)
+ */
+struct CompletedRequest {
+	int32_t event_id;
+	int32_t error;
+	void* data;
+	int64_t length;
+};
+
+// Batches not issued yet by the render thread, and requests of batches not drained yet,
+// by completion queue (0 is the default queue of drainCompletedRequests)
+static std::map<int,std::vector<std::shared_ptr<Task>>> batches;
+static std::map<int,std::vector<std::shared_ptr<Task>>> completion_queues;
+// Submitted requests (submitRequests) not done yet: completed, never drained
+static std::vector<std::shared_ptr<Task>> submitted_tasks;
+static std::mutex batches_mutex;
+static int next_batch_id = 1;
+static int next_completion_queue_id = 1;
+
+/**
+ * A video sink and what feeds it
+ */
+struct VideoSinkSource {
+	std::shared_ptr<VideoSink> sink;
+	GLuint texture;
+	int width;
+	int height;
+	// Issued captures, only accessed from the render thread
+	std::vector<std::shared_ptr<Task>> in_flight;
+};
+static const int VIDEO_SINK_MAX_IN_FLIGHT = 4;
+static const int VIDEO_SINK_MAX_QUEUED = 8;
+static std::map<int,std::shared_ptr<VideoSinkSource>> video_sinks;
+static std::mutex video_sinks_mutex;
+static int next_video_sink_id = 1;
+
+// Disk writers (createDiskWriter)
+static const int DISK_WRITER_MAX_THREADS = 64;
+static std::map<int,std::shared_ptr<DiskWriter>> disk_writers;
+static std::mutex disk_writers_mutex;
+static int next_disk_writer_id = 1;
+
+// Hash of the last completed frame of each stream (setRequestHashing)
+static std::map<int,uint64_t> stream_hashes;
+static std::mutex stream_hashes_mutex;
+
+/**
+ * Latest-frame mailbox of a texture (createMailbox): captures are read continuously,
+ * the consumer only ever gets the newest completed frame
+ */
+struct Mailbox {
+	GLuint texture;
+	int width;
+	int height;
+	// Issued captures, only accessed from the render thread
+	std::vector<std::shared_ptr<Task>> in_flight;
+	// Guards latest and acquired, shared with the consumer
+	std::mutex mutex;
+	// Newest completed frame not acquired yet
+	std::shared_ptr<Task> latest;
+	// Frame held by the consumer, until released or superseded by the next acquire
+	std::shared_ptr<Task> acquired;
+};
+// Frames of a mailbox: in flight, latest and acquired
+static const int MAILBOX_SLOTS = 3;
+static std::map<int,std::shared_ptr<Mailbox>> mailboxes;
+static std::mutex mailboxes_mutex;
+static int next_mailbox_id = 1;
+
+// Prepared tasks not issued yet, only accessed from the render thread
+static std::vector<std::shared_ptr<Task>> pending_tasks;
+// Chunked tasks with chunks left to queue, only accessed from the render thread
+static std::vector<std::shared_ptr<Task>> chunked_tasks;
+static std::atomic<long long> bulk_budget_bytes(0);
+static long long frame_bulk_bytes = 0;
+
+/**
+ * Transfer scheduler counters, also read by the managed plugin (keep it blittable)
+ */
+struct SchedulerStats {
+	// Current bytes per frame budget, lowered while fences are late. 0 if unlimited
+	int64_t budget_bytes;
+	// Bytes issued during the last frame
+	int64_t last_frame_bytes;
+	// Requests and bytes that had to wait for a later frame
+	int64_t deferred_requests;
+	int64_t deferred_bytes;
+	// Requests and bytes waiting right now
+	int64_t pending_requests;
+	int64_t pending_bytes;
+	int64_t expired_requests;
+	// Highest fence latency seen during the last frame, in frames. -1 if no fence signaled
+	int64_t last_fence_latency_frames;
+	// Requests that shared the read of another one
+	int64_t coalesced_requests;
+};
+
+// Budget of all the non high priority tasks (setFrameBudget)
+static std::atomic<long long> frame_budget_bytes(0);
+static std::atomic<int> max_fence_latency_frames(0);
+static long long effective_budget_bytes = 0;
+static long long frame_bytes = 0;
+static std::atomic<uint32_t> frame_index(0);
+static std::atomic<int> frame_fence_latency(-1);
+static SchedulerStats scheduler_stats = {};
+static std::mutex scheduler_stats_mutex;
+
+// Reads requested during the current frame, that later requests of the same frame can share
+static std::atomic<bool> coalescing_enabled(true);
+static std::vector<std::weak_ptr<Task>> frame_reads;
+
+static std::map<std::pair<GLuint,int>,TextureInfo> texture_infos;
+static std::mutex texture_infos_mutex;
+// Texture levels already written to the call log (startCallRecording)
+static std::map<std::pair<GLuint,int>,TextureInfo> recorded_texture_infos;
+static bool dsa_checked = false;
+static bool dsa_supported = false;
+static std::atomic<bool> pinned_memory_enabled(true);
+// Probed on the device initialization or on the first read
+static std::atomic<int> pinned_memory_mode(PINNED_MEMORY_NONE);
+static bool pinned_memory_checked = false;
+
+static std::atomic<int> wait_strategy(FENCE_WAIT_POLL);
+static std::atomic<long long> client_wait_timeout_ns(1000000);
+
+// Readback thread (FENCE_WAIT_THREAD)
+static SharedContext readback_context;
+static std::thread readback_thread;
+static std::mutex readback_mutex;
+static std::condition_variable readback_condition;
+static std::deque<std::shared_ptr<Task>> readback_queue;
+static bool readback_running = false;
+// The shared context could not be created or made current: tasks are polled instead
+static bool readback_failed = false;
+
+static void closeVideoSinks();
+static void closeDiskWriters();
+static void stopReadbackThread();
+static void clearPboPool();
+static void releaseMappedPbos();
+
+// Pixel buffers of completed tasks, kept for reuse by the next requests of the same size (setPboPoolSize)
+static std::atomic<int> pbo_pool_max(8);
+static std::multimap<size_t,GLuint> pbo_pool;
+static std::mutex pbo_pool_mutex;
 
 static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType);
 
 
 
 
+static bool debug_callback_installed = false;
+// Debug state of Unity's context while the trace records GL errors, restored when it stops
+static bool trace_callback_installed = false;
+static GLDEBUGPROC previous_debug_callback = NULL;
+static const void* previous_debug_user_param = NULL;
+static bool previous_debug_output = false;
+
 #ifdef DEBUG
 std::ofstream logMain, logRender;
 
@@ -58,6 +472,7 @@ void logToFile(std::string message) {
 	outfile << "GL CALLBACK: " << message  << std::endl;
 	outfile.close();
 }
+#endif
 
 /**
  * OpenGL debug message callback
@@ -71,10 +486,48 @@ void GLAPIENTRY DebugMessageCallback( GLenum source,
                  const void* userParam)
 {
 	if (type == GL_DEBUG_TYPE_ERROR) {
-		logRender << "GL CALLBACK: " << message  << std::endl;
+		traceInstant(TRACE_GL_ERROR, 0, id);
+		#ifdef DEBUG
+			logRender << "GL CALLBACK: " << message  << std::endl;
+		#endif
+	}
+	// Unity's own callback still gets every message
+	if (previous_debug_callback != NULL) {
+		previous_debug_callback(source, type, id, severity, length, message, previous_debug_user_param);
 	}
 }
-#endif
+
+/**
+ * @brief Record GL errors in the trace while it is enabled: chain the debug callback
+ * in front of Unity's one, and put Unity's debug state back once the trace stops.
+ * Has to be called from the render thread
+ */
+static void updateTraceDebugCallback() {
+	bool tracing = trace_enabled.load(std::memory_order_relaxed);
+	if (tracing == trace_callback_installed || debug_callback_installed) {
+		return;
+	}
+	if (tracing) {
+		GLvoid* callback = NULL;
+		GLvoid* user_param = NULL;
+		glGetPointerv(GL_DEBUG_CALLBACK_FUNCTION, &callback);
+		glGetPointerv(GL_DEBUG_CALLBACK_USER_PARAM, &user_param);
+		previous_debug_callback = (GLDEBUGPROC)callback;
+		previous_debug_user_param = user_param;
+		previous_debug_output = glIsEnabled(GL_DEBUG_OUTPUT);
+		glEnable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(DebugMessageCallback, 0);
+	}
+	else {
+		glDebugMessageCallback(previous_debug_callback, previous_debug_user_param);
+		if (!previous_debug_output) {
+			glDisable(GL_DEBUG_OUTPUT);
+		}
+		previous_debug_callback = NULL;
+		previous_debug_user_param = NULL;
+	}
+	trace_callback_installed = tracing;
+}
 
 /**
  * Unity plugin load event
@@ -88,6 +541,7 @@ extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
 
 		glEnable              ( GL_DEBUG_OUTPUT );
 		glDebugMessageCallback( DebugMessageCallback, 0 );
+		debug_callback_installed = true;
 	#endif
 
     unityInterfaces = unityInterfaces;
@@ -105,7 +559,26 @@ extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
  */
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginUnload()
 {
-	graphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
+	if (graphics != NULL) {
+		graphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
+	}
+	stopReadbackThread();
+	closeVideoSinks();
+	closeDiskWriters();
+	callLogStop();
+	bufferConfigure(HUGE_PAGES_NONE, 0);
+}
+
+/**
+ * @brief Mark the tasks that can't complete anymore in error, e.g. once the device is gone
+ */
+static void failTasks(const std::vector<std::shared_ptr<Task>>& tasks) {
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (!tasks[i]->done) {
+			tasks[i]->error = true;
+			tasks[i]->done = true;
+		}
+	}
 }
 
 /**
@@ -117,225 +590,2685 @@ static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType ev
 	if (eventType == kUnityGfxDeviceEventInitialize)
 	{
 		renderer = graphics->GetRenderer();
+		// Pinned memory is probed by the first request issued on the render thread:
+		// this also runs from UnityPluginLoad, on the main thread, without a context
 	}
 
 	// Cleanup graphics API implementation upon shutdown
 	if (eventType == kUnityGfxDeviceEventShutdown)
 	{
 		renderer = kUnityGfxRendererNull;
+		stopReadbackThread();
+		mailboxes_mutex.lock();
+		for (std::map<int,std::shared_ptr<Mailbox>>::iterator it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+			it->second->in_flight.clear();
+			std::lock_guard<std::mutex> lock(it->second->mutex);
+			it->second->latest.reset();
+		}
+		mailboxes_mutex.unlock();
+		// Deferred, chunked and issued requests never complete: fail them rather than leaving them pending
+		failTasks(pending_tasks);
+		failTasks(chunked_tasks);
+		std::vector<std::shared_ptr<Task>> reads;
+		for (size_t i = 0; i < frame_reads.size(); i++) {
+			std::shared_ptr<Task> task = frame_reads[i].lock();
+			if (task != nullptr) {
+				reads.push_back(task);
+			}
+		}
+		failTasks(reads);
+		pending_tasks.clear();
+		chunked_tasks.clear();
+		frame_reads.clear();
+		video_sinks_mutex.lock();
+		for (std::map<int,std::shared_ptr<VideoSinkSource>>::iterator it = video_sinks.begin(); it != video_sinks.end(); ++it) {
+			it->second->in_flight.clear();
+		}
+		video_sinks_mutex.unlock();
+		batches_mutex.lock();
+		for (std::map<int,std::vector<std::shared_ptr<Task>>>::iterator it = batches.begin(); it != batches.end(); ++it) {
+			failTasks(it->second);
+		}
+		// Failed rather than forgotten, so that they are still drained
+		for (std::map<int,std::vector<std::shared_ptr<Task>>>::iterator it = completion_queues.begin(); it != completion_queues.end(); ++it) {
+			failTasks(it->second);
+		}
+		failTasks(submitted_tasks);
+		batches.clear();
+		submitted_tasks.clear();
+		batches_mutex.unlock();
+		// Every fence signals, so that the pixel buffers released in flight are deleted too
+		glFinish();
+		releaseMappedPbos();
+		clearPboPool();
+		clearPinnedBuffers();
+		clearYuvResources();
+		clearReductionResources();
+		clearGatherResources();
+		texture_infos_mutex.lock();
+		texture_infos.clear();
+		texture_infos_mutex.unlock();
+		dsa_checked = false;
+		// The debug state went with the context
+		trace_callback_installed = false;
+		previous_debug_callback = NULL;
+		previous_debug_user_param = NULL;
+		pinned_memory_checked = false;
+		pinned_memory_mode = PINNED_MEMORY_NONE;
 	}
 }
 
-
 /**
- * Check if plugin is compatible with this system
- * This plugin is only compatible with opengl core
+ * @brief Check (once) if the context supports direct state access
+ * (OpenGL 4.5 or GL_ARB_direct_state_access).
+ * Has to be called from the render thread
  */
-extern "C" bool isCompatible() {
-	return (renderer == kUnityGfxRendererOpenGLCore);
+static bool hasDirectStateAccess() {
+	if (dsa_checked) {
+		return dsa_supported;
+	}
+	dsa_checked = true;
+	dsa_supported = false;
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 5)) {
+		dsa_supported = true;
+		return dsa_supported;
+	}
+
+	GLint num_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+	for (GLint i = 0; i < num_extensions; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && std::strcmp(extension, "GL_ARB_direct_state_access") == 0) {
+			dsa_supported = true;
+			break;
+		}
+	}
+	return dsa_supported;
 }
 
 /**
- * @brief Init of the make request action.
- * You then have to call makeRequest_renderThread
- * via GL.IssuePluginEvent with the returned event_id
- * 
- * @param texture OpenGL texture id
- * @return event_id to give to other functions and to IssuePluginEvent
+ * @brief Size in bytes of a read of width x height x depth pixels, without overflow
+ * @return 0 if a dimension is not positive or the size doesn't fit in a buffer
  */
-extern "C" int makeRequest_mainThread(GLuint texture, int miplevel) {
-	// Create the task
-	std::shared_ptr<Task> task = std::make_shared<Task>();
-	task->texture = texture;
-	task->miplevel = miplevel;
-	int event_id = next_event_id;
-	next_event_id++;
-
-	// Save it (lock because possible vector resize)
-	tasks_mutex.lock();
-	tasks[event_id] = task;
-	tasks_mutex.unlock();
-
-	return event_id;
+static size_t getReadSize(int width, int height, int depth, int pixel_size) {
+	if (width <= 0 || height <= 0 || depth <= 0 || pixel_size <= 0) {
+		return 0;
+	}
+	const size_t max_size = PTRDIFF_MAX;
+	size_t size = pixel_size;
+	const int factors[3] = { width, height, depth };
+	for (int i = 0; i < 3; i++) {
+		if (size > max_size / (size_t)factors[i]) {
+			return 0;
+		}
+		size *= (size_t)factors[i];
+	}
+	return size;
 }
 
 /**
- * @brief Create a a read texture request
- * Has to be called by GL.IssuePluginEvent
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Get the informations of a texture level, from the cache if possible.
+ * The cached entry is dropped and queried again if it doesn't match the size
+ * the caller expects (texture recreated by Unity with the same id).
+ * Has to be called from the render thread
+ *
+ * @param expected_width Width known by the caller, 0 if unknown (always query)
+ * @param expected_height Height known by the caller, 0 if unknown (always query)
  */
-extern "C" void UNITY_INTERFACE_API makeRequest_renderThread(int event_id) {
-	// Get task back
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	tasks_mutex.unlock();
+static TextureInfo getTextureInfo(GLuint texture, int miplevel, int expected_width, int expected_height) {
+	std::pair<GLuint,int> key(texture, miplevel);
+	bool known_size = (expected_width > 0 && expected_height > 0);
 
-	// Get texture informations
-	glBindTexture(GL_TEXTURE_2D, task->texture);
-	glGetTexLevelParameteriv(GL_TEXTURE_2D, task->miplevel, GL_TEXTURE_WIDTH, &(task->width));
-	glGetTexLevelParameteriv(GL_TEXTURE_2D, task->miplevel, GL_TEXTURE_HEIGHT, &(task->height));
-	glGetTexLevelParameteriv(GL_TEXTURE_2D, task->miplevel, GL_TEXTURE_DEPTH, &(task->depth));
-	glGetTexLevelParameteriv(GL_TEXTURE_2D, task->miplevel, GL_TEXTURE_INTERNAL_FORMAT, &(task->internal_format));
-	task->size = task->depth * task->width * task->height * getPixelSizeFromInternalFormat(task->internal_format);
-
-	// Check for errors
-	if (task->size == 0
-		|| getFormatFromInternalFormat(task->internal_format) == 0
-		|| getTypeFromInternalFormat(task->internal_format) == 0) {
-		task->error = true;
-		return;
+	if (known_size) {
+		std::lock_guard<std::mutex> lock(texture_infos_mutex);
+		std::map<std::pair<GLuint,int>,TextureInfo>::iterator it = texture_infos.find(key);
+		if (it != texture_infos.end()
+			&& it->second.width == expected_width
+			&& it->second.height == expected_height) {
+			return it->second;
+		}
 	}
 
-	// Allocate the final data buffer !!! WARNING: free, will have to be done on script side !!!!
-	task->data = std::malloc(task->size);
-
-	// Create the fbo (frame buffer object) from the given texture
-	task->fbo;
-	glGenFramebuffers(1, &(task->fbo));
+	TextureInfo info;
+	if (hasDirectStateAccess()) {
+		// Query without binding anything
+		glGetTextureLevelParameteriv(texture, miplevel, GL_TEXTURE_WIDTH, &(info.width));
+		glGetTextureLevelParameteriv(texture, miplevel, GL_TEXTURE_HEIGHT, &(info.height));
+		glGetTextureLevelParameteriv(texture, miplevel, GL_TEXTURE_DEPTH, &(info.depth));
+		glGetTextureLevelParameteriv(texture, miplevel, GL_TEXTURE_INTERNAL_FORMAT, &(info.internal_format));
+	}
+	else {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_WIDTH, &(info.width));
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_HEIGHT, &(info.height));
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_DEPTH, &(info.depth));
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_INTERNAL_FORMAT, &(info.internal_format));
+	}
+	info.format = getFormatFromInternalFormat(info.internal_format);
+	info.type = getTypeFromInternalFormat(info.internal_format);
+	info.pixel_size = getPixelSizeFromFormatAndType(info.format, info.type);
+	info.size = getReadSize(info.width, info.height, info.depth, info.pixel_size);
 
-	// Bind the texture to the fbo
-	glBindFramebuffer(GL_FRAMEBUFFER, task->fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, task->texture, 0);
+	// Only cache textures whose size the caller can check next time
+	if (known_size) {
+		std::lock_guard<std::mutex> lock(texture_infos_mutex);
+		texture_infos[key] = info;
+	}
 
-	// Create and bind pbo (pixel buffer object) to fbo
-	task->pbo;
-	glGenBuffers(1, &(task->pbo));
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, task->pbo);
-	glBufferData(GL_PIXEL_PACK_BUFFER, task->size, 0, GL_DYNAMIC_READ);
+	// The replayer creates the textures from the log
+	if (isRecording()) {
+		std::lock_guard<std::mutex> lock(texture_infos_mutex);
+		std::map<std::pair<GLuint,int>,TextureInfo>::iterator it = recorded_texture_infos.find(key);
+		if (it == recorded_texture_infos.end() || it->second.width != info.width || it->second.height != info.height
+			|| it->second.depth != info.depth || it->second.internal_format != info.internal_format) {
+			recorded_texture_infos[key] = info;
+			recordCall(CALL_TEXTURE, { texture, miplevel, info.width, info.height, info.depth, info.internal_format });
+		}
+	}
+	return info;
+}
 
-	// Start the read request
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-	glReadPixels(0, 0, task->width, task->height, getFormatFromInternalFormat(task->internal_format), getTypeFromInternalFormat(task->internal_format), 0);
+/**
+ * @brief Get a pixel buffer of the given size from the pool, or create one.
+ * Has to be called from the render thread
+ */
+static GLuint acquirePbo(size_t size, bool dsa) {
+	{
+		std::lock_guard<std::mutex> lock(pbo_pool_mutex);
+		std::multimap<size_t,GLuint>::iterator it = pbo_pool.find(size);
+		if (it != pbo_pool.end()) {
+			GLuint pbo = it->second;
+			pbo_pool.erase(it);
+			return pbo;
+		}
+	}
 
-	// Unbind buffers
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLuint pbo = 0;
+	if (dsa) {
+		glCreateBuffers(1, &pbo);
+		glNamedBufferData(pbo, size, 0, GL_DYNAMIC_READ);
+	}
+	else {
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	return pbo;
+}
 
-	// Fence to know when it's ready
-	task->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-	
-	// Done init
-	task->initialized = true;
+/**
+ * @brief Give back a pixel buffer to the pool, delete it if the pool is full.
+ * Has to be called from a thread with Unity's context or the shared context current
+ */
+static void releasePbo(GLuint pbo, size_t size) {
+	{
+		std::lock_guard<std::mutex> lock(pbo_pool_mutex);
+		if ((int)pbo_pool.size() < pbo_pool_max.load()) {
+			pbo_pool.insert(std::make_pair(size, pbo));
+			return;
+		}
+	}
+	glDeleteBuffers(1, &pbo);
 }
-extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_makeRequest_renderThread() {
-	return makeRequest_renderThread;
+
+/**
+ * @brief Unmap the pixel buffers of the released lazy requests and give them back to the pool,
+ * with those of the requests released in flight whose fence has signaled since.
+ * Has to be called from the render thread
+ */
+static void releaseMappedPbos() {
+	std::vector<MappedPbo> released;
+	{
+		std::lock_guard<std::mutex> lock(released_mapped_pbos_mutex);
+		if (released_mapped_pbos.empty()) {
+			return;
+		}
+		released.swap(released_mapped_pbos);
+	}
+	std::vector<MappedPbo> writing;
+	for (size_t i = 0; i < released.size(); i++) {
+		if (released[i].fence != 0) {
+			GLint status = 0;
+			GLsizei length = 0;
+			glGetSynciv(released[i].fence, GL_SYNC_STATUS, sizeof(GLint), &length, &status);
+			// Check again on the next call, a failed fence is not waited for
+			if (length > 0 && status != GL_SIGNALED) {
+				writing.push_back(released[i]);
+				continue;
+			}
+			glDeleteSync(released[i].fence);
+		}
+		if (released[i].pinned) {
+			releasePinnedBuffer(released[i].pinned_buffer);
+			continue;
+		}
+		if (released[i].mapped && released[i].dsa) {
+			glUnmapNamedBuffer(released[i].pbo);
+		}
+		else if (released[i].mapped) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, released[i].pbo);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		releasePbo(released[i].pbo, released[i].size);
+	}
+	if (!writing.empty()) {
+		std::lock_guard<std::mutex> lock(released_mapped_pbos_mutex);
+		released_mapped_pbos.insert(released_mapped_pbos.end(), writing.begin(), writing.end());
+	}
 }
 
 /**
- * @brief check if data is ready
- * Has to be called by GL.IssuePluginEvent
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Delete every pooled pixel buffer
+ * Has to be called from a thread with Unity's context or the shared context current
  */
-extern "C" void UNITY_INTERFACE_API update_renderThread(int event_id) {
-	// Get task back
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	tasks_mutex.unlock();
+static void clearPboPool() {
+	std::lock_guard<std::mutex> lock(pbo_pool_mutex);
+	for (std::multimap<size_t,GLuint>::iterator it = pbo_pool.begin(); it != pbo_pool.end(); ++it) {
+		glDeleteBuffers(1, &(it->second));
+	}
+	pbo_pool.clear();
+}
 
-	// Check if task has not been already deleted by main thread
-	if(task == nullptr) {
+/**
+ * @brief Set the hash of a completed task, and record it as the last frame of its stream
+ */
+static void setTaskHash(Task* task, uint64_t hash) {
+	task->hash = hash;
+	if (task->hash_stream <= 0) {
 		return;
 	}
+	std::lock_guard<std::mutex> lock(stream_hashes_mutex);
+	std::map<int,uint64_t>::iterator it = stream_hashes.find(task->hash_stream);
+	task->duplicate = (it != stream_hashes.end() && it->second == hash);
+	stream_hashes[task->hash_stream] = hash;
+}
 
-	// Do something only if initialized (thread safety)
-	if (!task->initialized || task->done) {
+/**
+ * @brief Copy the pbo of a task whose fence has signaled to its data buffer,
+ * delete its GL objects and mark it as done.
+ * Has to be called from a thread with Unity's context or the shared context current
+ */
+static void completeTask(Task* task) {
+	// Record the fence latency for the adaptive budget
+	if (task->in_flight.exchange(false)) {
+		tasks_in_flight--;
+		int latency = (int)(frame_index.load() - task->issue_frame);
+		int current = frame_fence_latency.load();
+		while (latency > current && !frame_fence_latency.compare_exchange_weak(current, latency)) {
+		}
+	}
+
+	// The GPU wrote the data in place
+	if (task->pinned) {
+		glDeleteSync(task->fence);
+		task->fence = 0;
+		task->data = task->pinned_buffer.data;
+		if (task->hashing) {
+			setTaskHash(task, hashData(task->data, task->size));
+			if (task->duplicate) {
+				task->data = nullptr;
+			}
+		}
+		task->done = true;
 		return;
 	}
 
-	// Check fence state
-	GLint status = 0;
-	GLsizei length = 0;
-	glGetSynciv(task->fence, GL_SYNC_STATUS, sizeof(GLint), &length, &status);
-	if (length <= 0) {
+	// Get the final data buffer, released by dispose, unless the caller gave one,
+	// the frame goes to a video sink or a disk writer, or the copy is left to the consumer
+	if (task->sink != nullptr || task->disk_writer != nullptr || task->lazy) {
+		task->data = nullptr;
+	}
+	else if (task->destination != nullptr) {
+		task->data = task->destination;
+	}
+	else {
+		task->data = bufferAllocate(task->size);
+	}
+	if (task->sink == nullptr && task->disk_writer == nullptr && !task->lazy && task->data == NULL) {
+		glDeleteSync(task->fence);
+		task->fence = 0;
+		releasePbo(task->pbo, task->size);
 		task->error = true;
 		task->done = true;
 		return;
 	}
 
-	// When it's done
-	if (status == GL_SIGNALED) {
-
-		// Bind back the pbo
+	// Map the buffer
+	void* ptr;
+	uint64_t trace_start = traceBegin();
+	if (task->dsa) {
+		ptr = glMapNamedBufferRange(task->pbo, 0, task->size, GL_MAP_READ_BIT);
+	}
+	else {
 		glBindBuffer(GL_PIXEL_PACK_BUFFER, task->pbo);
+		ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, task->size, GL_MAP_READ_BIT);
+	}
+	traceEnd(TRACE_MAP, task->event_id, trace_start, task->size);
+
+	// Keep the pbo mapped until the task is released, see getTaskData
+	if (task->lazy) {
+		if (!task->dsa) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		glDeleteSync(task->fence);
+		task->fence = 0;
+		if (ptr == NULL) {
+			glDeleteBuffers(1, &(task->pbo));
+		}
+		task->mapped = ptr;
+		task->error = (ptr == NULL);
+		task->done = true;
+		return;
+	}
 
-		// Map the buffer and copy it to data
-		void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, task->size, GL_MAP_READ_BIT);
-		std::memcpy(task->data, ptr, task->size);
+	// Copy it to data
+	bool dropped = false;
+	if (ptr != NULL) {
+		trace_start = traceBegin();
+		if (task->sink != nullptr && task->yuv_format == YUV_FORMAT_NV12) {
+			task->sink->pushNv12Frame((const uint8_t*)ptr, task->width, task->height);
+		}
+		else if (task->sink != nullptr) {
+			task->sink->pushFrame((const uint8_t*)ptr, task->width, task->height);
+		}
+		else if (task->disk_writer != nullptr) {
+			// A duplicate is not written, its index is skipped
+			if (task->hashing) {
+				setTaskHash(task, hashData(ptr, task->size));
+			}
+			if (!task->duplicate) {
+				dropped = !task->disk_writer->pushFile(ptr, task->size, task->disk_index);
+			}
+		}
+		else if (task->chunk_target != nullptr) {
+			std::lock_guard<std::mutex> lock(task->chunk_target->mutex);
+			if (!task->chunk_target->disposed) {
+				std::memcpy(task->data, ptr, task->size);
+			}
+		}
+		else if (task->destination != nullptr) {
+			std::lock_guard<std::mutex> lock(task->destination_mutex);
+			if (!task->disposed && task->hashing) {
+				setTaskHash(task, copyAndHash(task->data, ptr, task->size));
+				if (task->duplicate) {
+					task->data = nullptr;
+				}
+			}
+			else if (!task->disposed) {
+				std::memcpy(task->data, ptr, task->size);
+			}
+		}
+		else if (task->hashing) {
+			// Hashed while copied: the mapped pbo is only read once
+			setTaskHash(task, copyAndHash(task->data, ptr, task->size));
+			if (task->duplicate) {
+				bufferRelease(task->data);
+				task->data = nullptr;
+			}
+		}
+		else {
+			std::memcpy(task->data, ptr, task->size);
+		}
+		traceEnd(TRACE_COPY, task->event_id, trace_start, task->size);
+	}
 
-		// Unmap and unbind
-		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	// Unmap and unbind
+	if (task->dsa) {
+		if (ptr != NULL) {
+			glUnmapNamedBuffer(task->pbo);
+		}
+	}
+	else {
+		if (ptr != NULL) {
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
 		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
 
-		// Clear buffers
-		glDeleteFramebuffers(1, &(task->fbo));
+	// Clear buffers
+	glDeleteSync(task->fence);
+	task->fence = 0;
+	if (ptr != NULL) {
+		releasePbo(task->pbo, task->size);
+	}
+	else {
 		glDeleteBuffers(1, &(task->pbo));
-		glDeleteSync(task->fence);
-
-		// yeah task is done!
-		task->done = true;
 	}
-}
-extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_update_renderThread() {
-	return update_renderThread;
+
+	// yeah task is done!
+	task->error = (ptr == NULL || dropped);
+	task->done = true;
 }
 
 /**
- * @brief Get data from the main thread
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Readback thread main loop.
+ * Blocks on the fence of the queued tasks, in order, and completes them.
  */
-extern "C" void getData_mainThread(int event_id, void** buffer, size_t* length) {
-	// Get task back
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	tasks_mutex.unlock();
-
-	// Do something only if initialized (thread safety)
-	if (!task->done) {
+static void readbackThreadMain() {
+	if (!makeSharedContextCurrent(readback_context)) {
+		// Without a context, fail the queued tasks and wait to be stopped
+		std::unique_lock<std::mutex> lock(readback_mutex);
+		readback_failed = true;
+		for (size_t i = 0; i < readback_queue.size(); i++) {
+			readback_queue[i]->error = true;
+			readback_queue[i]->done = true;
+		}
+		readback_queue.clear();
+		readback_condition.wait(lock, [] { return !readback_running; });
 		return;
 	}
+	traceThreadName("Readback thread");
+
+	while (true) {
+		std::shared_ptr<Task> task;
+		{
+			std::unique_lock<std::mutex> lock(readback_mutex);
+			readback_condition.wait(lock, [] { return !readback_running || !readback_queue.empty(); });
+			if (!readback_running) {
+				break;
+			}
+			task = readback_queue.front();
+			readback_queue.pop_front();
+		}
+
+		// Wait by slices to be able to stop
+		GLenum result = GL_TIMEOUT_EXPIRED;
+		uint64_t trace_start = traceBegin();
+		while (result == GL_TIMEOUT_EXPIRED) {
+			result = glClientWaitSync(task->fence, 0, 10000000);
+			std::lock_guard<std::mutex> lock(readback_mutex);
+			if (!readback_running) {
+				break;
+			}
+		}
+		traceEnd(TRACE_FENCE_CHECK, task->event_id, trace_start, result);
+
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+			traceInstant(TRACE_SIGNAL, task->event_id);
+			completeTask(task.get());
+			// Make the unmap visible to the render thread before it reuses the pbo
+			glFlush();
+		}
+		else {
+			// Wait failed, or stopped while waiting
+			task->error = true;
+			task->done = true;
+		}
+	}
 
-	// Copy the pointer. Warning: free will have to be done on script side
-	*length = task->size;
-	*buffer = task->data;
+	// Pooled buffers may have been released by this context, make sure to leave none behind
+	clearPboPool();
+	releaseSharedContext(readback_context);
 }
 
 /**
- * @brief Check if request is done
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Start the readback thread if not already running.
+ * Has to be called from the render thread
+ * @return false if the shared context could not be created
  */
-extern "C" bool isRequestDone(int event_id) {
-	// Get task back
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	tasks_mutex.unlock();
-
-	return task->done;
+static bool startReadbackThread() {
+	if (readback_running) {
+		std::lock_guard<std::mutex> lock(readback_mutex);
+		return !readback_failed;
+	}
+	if (readback_failed) {
+		return false;
+	}
+	if (!createSharedContext(readback_context)) {
+		destroySharedContext(readback_context);
+		readback_failed = true;
+		return false;
+	}
+	readback_running = true;
+	readback_thread = std::thread(readbackThreadMain);
+	return true;
 }
 
 /**
- * @brief Check if request is in error
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Stop the readback thread and destroy its context.
+ * Tasks still waiting are marked in error.
  */
-extern "C" bool isRequestError(int event_id) {
-	// Get task back
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	tasks_mutex.unlock();
+static void stopReadbackThread() {
+	{
+		std::lock_guard<std::mutex> lock(readback_mutex);
+		if (!readback_running) {
+			return;
+		}
+		readback_running = false;
+		for (size_t i = 0; i < readback_queue.size(); i++) {
+			readback_queue[i]->error = true;
+			readback_queue[i]->done = true;
+		}
+		readback_queue.clear();
+	}
+	readback_condition.notify_one();
+	readback_thread.join();
+	destroySharedContext(readback_context);
+	readback_failed = false;
+}
 
-	return task->error;
+/**
+ * Check if plugin is compatible with this system
+ * This plugin is only compatible with opengl core
+ */
+extern "C" bool isCompatible() {
+	recordCall(CALL_IS_COMPATIBLE, {});
+	return (renderer == kUnityGfxRendererOpenGLCore);
 }
 
 /**
- * @brief clear data for a frame
- * Warning : Buffer is never cleaned, it has to be cleaned from script side 
- * Has to be called by GL.IssuePluginEvent
- * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @brief Create a task and register it under a new event_id
  */
-extern "C" void dispose(int event_id) {
-	// Remove from tasks
-	tasks_mutex.lock();
-	std::shared_ptr<Task> task = tasks[event_id];
-	std::free(task->data);
-	tasks.erase(event_id);
-	tasks_mutex.unlock();
-}
\ No newline at end of file
+static std::shared_ptr<Task> createTask(GLuint texture, int miplevel, int width, int height) {
+	std::shared_ptr<Task> task = std::make_shared<Task>();
+	task->texture = texture;
+	task->miplevel = miplevel;
+	task->expected_width = width;
+	task->expected_height = height;
+	task->lazy = lazy_mapping_enabled;
+	task->event_id = next_event_id++;
+	traceInstant(TRACE_REQUEST, task->event_id);
+
+	addTask(task);
+	return task;
+}
+
+/**
+ * @brief Init of the make request action, giving the size of the texture
+ * level as known by Unity. It lets the render thread reuse cached texture
+ * informations instead of querying OpenGL, and detect when the texture has
+ * been recreated with another size.
+ * You then have to call makeRequest_renderThread
+ * via GL.IssuePluginEvent with the returned event_id, or submitRequest.
+ * Like the other request functions, it can be called from any thread.
+ *
+ * @param texture OpenGL texture id
+ * @param width Width of the texture level, 0 if unknown
+ * @param height Height of the texture level, 0 if unknown
+ * @return event_id to give to other functions and to IssuePluginEvent
+ */
+extern "C" int makeRequestWithSize_mainThread(GLuint texture, int miplevel, int width, int height) {
+	int event_id = createTask(texture, miplevel, width, height)->event_id;
+	recordCall(CALL_MAKE_REQUEST_WITH_SIZE, { texture, miplevel, width, height, event_id });
+	return event_id;
+}
+
+/**
+ * @brief Init of the make request action.
+ * You then have to call makeRequest_renderThread
+ * via GL.IssuePluginEvent with the returned event_id
+ * 
+ * @param texture OpenGL texture id
+ * @return event_id to give to other functions and to IssuePluginEvent
+ */
+extern "C" int makeRequest_mainThread(GLuint texture, int miplevel) {
+	int event_id = createTask(texture, miplevel, 0, 0)->event_id;
+	recordCall(CALL_MAKE_REQUEST, { texture, miplevel, event_id });
+	return event_id;
+}
+
+/**
+ * @brief Only read a region of the texture level instead of the whole level.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ * The request is in error if the region is outside of the texture level.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" void setRequestRegion(int event_id, int x, int y, int width, int height) {
+	recordCall(CALL_SET_REQUEST_REGION, { event_id, x, y, width, height });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->region_x = x;
+	task->region_y = y;
+	task->region_width = width;
+	task->region_height = height;
+}
+
+/**
+ * @brief Copy the result straight into memory owned by the caller (a NativeArray,
+ * a pinned array, a shared memory slot...) instead of a buffer allocated by the plugin.
+ * The memory has to stay valid until the request is done or disposed.
+ * The request is in error if the result doesn't fit in capacity.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param buffer Destination of the data, getData_mainThread will return it
+ * @param capacity Size of buffer in bytes
+ */
+extern "C" void setRequestDestination(int event_id, void* buffer, long long capacity) {
+	recordCall(CALL_SET_REQUEST_DESTINATION, { event_id, capacity });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->destination = buffer;
+	task->destination_capacity = (capacity > 0) ? (size_t)capacity : 0;
+}
+
+/**
+ * @brief Convert the texture to YUV 4:2:0 on the GPU before reading it back
+ * (compute shader pass, OpenGL 4.3), so that the data is 1.5 bytes per pixel:
+ * the Y plane then the chroma planes, bottom-up rows as the other requests.
+ * The request is in error if the size is odd, or the texture is an integer or 3D one.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param format A YuvFormat value
+ */
+extern "C" void setRequestYuv(int event_id, int format) {
+	recordCall(CALL_SET_REQUEST_YUV, { event_id, format });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->yuv_format = (format == YUV_FORMAT_NV12 || format == YUV_FORMAT_I420) ? (YuvFormat)format : YUV_FORMAT_NONE;
+}
+
+/**
+ * @brief Reduce the texture on the GPU (compute shaders, OpenGL 4.3) and only read back
+ * the result: a ReductionStats (minimum, maximum and mean of each channel) for
+ * REDUCTION_STATS, 4 histograms (R, G, B, luminance) of bins uint32 counts for REDUCTION_HISTOGRAM.
+ * Reduced values are the ones a read gives (sRGB encoded). The request is in error if
+ * the number of bins is not in [1, REDUCTION_MAX_BINS], or the texture is an integer or 3D one.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param reduction A ReductionType value
+ * @param bins Number of bins of the histograms
+ */
+extern "C" void setRequestReduction(int event_id, int reduction, int bins) {
+	recordCall(CALL_SET_REQUEST_REDUCTION, { event_id, reduction, bins });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->reduction = (reduction == REDUCTION_STATS || reduction == REDUCTION_HISTOGRAM) ? (ReductionType)reduction : REDUCTION_NONE;
+	task->reduction_bins = bins;
+}
+
+/**
+ * @brief Only read the texels at a list of points (e.g. picking, probes), gathered on
+ * the GPU (compute shader, OpenGL 4.3): the data is then 16 bytes per point, the RGBA
+ * value as 4 floats, or 4 ints / uints for integer textures. Points outside the
+ * level give zeros. The request is in error with a region, or for a 3D texture.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param points x, y coordinates of each point in the level, origin at the bottom left (copied)
+ * @param count Number of points
+ */
+extern "C" void setRequestPoints(int event_id, const int* points, int count) {
+	if (isRecording()) {
+		CallRecord(CALL_SET_REQUEST_POINTS).add(event_id).addArray(points, 2 * count).write();
+	}
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	if (points != NULL && count > 0) {
+		task->points.assign(points, points + 2 * count);
+	}
+	else {
+		task->points.clear();
+	}
+}
+
+/**
+ * @brief Read a large region (atlases, lightmaps, screenshots) by bands of rows spread
+ * across frames, instead of in one read: chunks_per_frame bands are queued per frame
+ * (see scheduleFrame_renderThread), each one also under the frame budgets, and written
+ * into the data of the request (or its destination) as they complete. It trades latency
+ * for smooth frame times and bounded pixel buffers. See getRequestProgress.
+ * The request is in error with YUV, a reduction, points or a 3D texture.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param chunk_rows Rows per band, 0 to read the region at once (default)
+ * @param chunks_per_frame Bands queued per frame, at least 1
+ */
+extern "C" void setRequestChunks(int event_id, int chunk_rows, int chunks_per_frame) {
+	recordCall(CALL_SET_REQUEST_CHUNKS, { event_id, chunk_rows, chunks_per_frame });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	if (chunk_rows > 0) {
+		task->chunked = std::make_shared<ChunkedRead>();
+		task->chunk_rows = chunk_rows;
+		task->chunks_per_frame = std::max(chunks_per_frame, 1);
+	}
+	else {
+		task->chunked = nullptr;
+		task->chunk_rows = 0;
+	}
+}
+
+/**
+ * @brief Write the data of a request to a file of a disk writer (createDiskWriter) once read,
+ * instead of keeping it: getData_mainThread gives no data, the request is in error if the
+ * file is dropped. The data is written as read, bottom-up rows. The request is in error
+ * with a destination or chunks.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param writer_id given by createDiskWriter
+ * @param index Index of the file in the path format, negative for the next index of the writer
+ * @return Index of the file, -1 if the request or the writer doesn't exist
+ */
+extern "C" int setRequestDiskWriter(int event_id, int writer_id, int index) {
+	recordCall(CALL_SET_REQUEST_DISK_WRITER, { event_id, writer_id, index });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return -1;
+	}
+
+	std::shared_ptr<DiskWriter> writer;
+	{
+		std::lock_guard<std::mutex> lock(disk_writers_mutex);
+		std::map<int,std::shared_ptr<DiskWriter>>::iterator it = disk_writers.find(writer_id);
+		if (it == disk_writers.end()) {
+			return -1;
+		}
+		writer = it->second;
+	}
+	task->disk_writer = writer;
+	task->disk_index = (index >= 0) ? index : writer->takeIndex();
+	return task->disk_index;
+}
+
+/**
+ * @brief Hash the data of a request while it is copied out of the pixel buffer (see getRequestHash),
+ * and optionally compare it with the previous completed frame of a stream. A frame with the same
+ * hash is a duplicate: it is done without data (REQUEST_STATUS_DUPLICATE), and not written by
+ * a disk writer. The request is not lazy, and is in error with chunks.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param stream Stream of the request, > 0 to suppress duplicates, 0 to only hash
+ */
+extern "C" void setRequestHashing(int event_id, int stream) {
+	recordCall(CALL_SET_REQUEST_HASHING, { event_id, stream });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->hashing = true;
+	task->hash_stream = (stream > 0) ? stream : 0;
+}
+
+/**
+ * @brief Forget the last frame of a hash stream, its next frame is never a duplicate
+ * @param stream Stream given to setRequestHashing
+ */
+extern "C" void resetHashStream(int stream) {
+	recordCall(CALL_RESET_HASH_STREAM, { stream });
+	std::lock_guard<std::mutex> lock(stream_hashes_mutex);
+	stream_hashes.erase(stream);
+}
+
+/**
+ * @brief Set the urgency of a request.
+ * Has to be called after makeRequest_mainThread and before
+ * the makeRequest_renderThread event is issued.
+ *
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param priority A RequestPriority value
+ * @param deadline_ms If the read is still not issued this long after this call,
+ * the request is dropped (in error). 0 for no deadline
+ */
+extern "C" void setRequestPriority(int event_id, int priority, int deadline_ms) {
+	recordCall(CALL_SET_REQUEST_PRIORITY, { event_id, priority, deadline_ms });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	task->priority = priority;
+	task->has_deadline = (deadline_ms > 0);
+	if (task->has_deadline) {
+		task->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadline_ms);
+	}
+}
+
+/**
+ * @brief Compute what a task has to read: texture informations, region and size.
+ * Has to be called from the render thread
+ * @return false if the task is in error
+ */
+static bool prepareTask(Task* task) {
+	// Get texture informations
+	TextureInfo info = getTextureInfo(task->texture, task->miplevel, task->expected_width, task->expected_height);
+	task->width = info.width;
+	task->height = info.height;
+	task->depth = info.depth;
+	task->internal_format = info.internal_format;
+	task->format = info.format;
+	task->type = info.type;
+	task->size = info.size;
+
+	// Restrict to the requested region
+	if (task->region_width > 0 && task->region_height > 0) {
+		if (task->region_x < 0 || task->region_y < 0
+			|| task->region_x + task->region_width > info.width
+			|| task->region_y + task->region_height > info.height) {
+			return false;
+		}
+		task->width = task->region_width;
+		task->height = task->region_height;
+		task->size = getReadSize(task->width, task->height, task->depth, info.pixel_size);
+	}
+
+	// Converted to YUV 4:2:0 before the read: 1.5 bytes per pixel
+	if (task->yuv_format != YUV_FORMAT_NONE) {
+		bool integer = (info.format == GL_RED_INTEGER || info.format == GL_RG_INTEGER
+			|| info.format == GL_RGB_INTEGER || info.format == GL_RGBA_INTEGER);
+		if (integer || task->depth != 1 || task->width % 2 != 0 || task->height % 2 != 0) {
+			return false;
+		}
+		task->size = (size_t)task->width * task->height * 3 / 2;
+	}
+
+	// Reduced on the GPU: only the result is read
+	if (task->reduction != REDUCTION_NONE) {
+		bool integer = (info.format == GL_RED_INTEGER || info.format == GL_RG_INTEGER
+			|| info.format == GL_RGB_INTEGER || info.format == GL_RGBA_INTEGER);
+		if (integer || task->depth != 1 || task->yuv_format != YUV_FORMAT_NONE) {
+			return false;
+		}
+		task->size = getReductionResultSize(task->reduction, task->reduction_bins);
+	}
+
+	// Only the points are gathered on the GPU and read
+	if (!task->points.empty()) {
+		if (task->depth != 1 || task->region_width > 0 || task->yuv_format != YUV_FORMAT_NONE || task->reduction != REDUCTION_NONE) {
+			return false;
+		}
+		task->size = (task->points.size() / 2) * GATHER_VALUE_SIZE;
+	}
+
+	// Read by bands of rows, each one a plain read
+	if (task->chunked != nullptr) {
+		if (task->depth != 1 || task->yuv_format != YUV_FORMAT_NONE || task->reduction != REDUCTION_NONE || !task->points.empty()) {
+			return false;
+		}
+		task->lazy = false;
+	}
+
+	// The data is written to the destination right away
+	if (task->destination != nullptr) {
+		task->lazy = false;
+	}
+
+	// Hashed while copied out of the pbo
+	if (task->hashing) {
+		if (task->chunked != nullptr) {
+			return false;
+		}
+		task->lazy = false;
+	}
+
+	// The data goes to a file, it is not kept
+	if (task->disk_writer != nullptr) {
+		if (task->destination != nullptr || task->chunked != nullptr) {
+			return false;
+		}
+		task->lazy = false;
+	}
+
+	// The caller's destination has to hold the whole result
+	if (task->destination != nullptr && task->destination_capacity < task->size) {
+		return false;
+	}
+
+	// Check for errors. A single read takes a GLsizei size (and drivers overflow past it):
+	// larger data has to be chunked
+	if (task->size == 0 || info.format == 0 || info.type == 0) {
+		return false;
+	}
+	if (task->size > (size_t)INT_MAX && task->chunked == nullptr) {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Issue the read of a prepared task into a pbo, and its fence.
+ * Has to be called from the render thread
+ */
+static void issueTask(const std::shared_ptr<Task>& task) {
+	uint64_t trace_start = traceBegin();
+
+	// Passes see the encoded values of sRGB textures, as the reads
+	bool srgb = (task->internal_format == GL_SRGB8_ALPHA8 || task->internal_format == GL_SRGB8);
+
+	// What is read: the region of the texture level, or its YUV planes
+	GLuint read_texture = task->texture;
+	int read_level = task->miplevel;
+	int read_x = task->region_x;
+	int read_y = task->region_y;
+	int read_height = task->height;
+	GLenum read_format = task->format;
+	GLenum read_type = task->type;
+	GLint pack_alignment = 4;
+	if (task->yuv_format != YUV_FORMAT_NONE) {
+		read_texture = convertToYuv(task->texture, task->miplevel, task->region_x, task->region_y, task->width, task->height,
+			task->yuv_format, srgb);
+		if (read_texture == 0) {
+			task->error = true;
+			task->done = true;
+			return;
+		}
+		read_level = 0;
+		read_x = 0;
+		read_y = 0;
+		read_height = task->height * 3 / 2;
+		read_format = GL_RED;
+		read_type = GL_UNSIGNED_BYTE;
+		// Rows of the planes are not 4 bytes aligned
+		glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	}
+
+	if ((task->reduction != REDUCTION_NONE && !reductionProgramsReady()) || (!task->points.empty() && !gatherProgramsReady())) {
+		task->error = true;
+		task->done = true;
+		return;
+	}
+
+	// Get a pbo (pixel buffer object), recycled from a previous request if possible.
+	// When the data is kept by the plugin, a pbo backed by host memory spares the map and copy.
+	// Only for pixel reads: compute passes write their results through storage buffers,
+	// which drivers do not support on host memory
+	task->dsa = hasDirectStateAccess();
+	if (!pinned_memory_checked) {
+		pinned_memory_mode = probePinnedMemory();
+		pinned_memory_checked = true;
+	}
+	PinnedMemoryMode pinned_mode = (PinnedMemoryMode)pinned_memory_mode.load();
+	if (pinned_memory_enabled && pinned_mode != PINNED_MEMORY_NONE
+		&& task->destination == nullptr && task->sink == nullptr && task->disk_writer == nullptr && !task->lazy
+		&& task->reduction == REDUCTION_NONE && task->points.empty()
+		&& acquirePinnedBuffer(pinned_mode, task->size, task->dsa, task->pinned_buffer)) {
+		task->pinned = true;
+		task->pbo = task->pinned_buffer.pbo;
+	}
+	else {
+		task->pbo = acquirePbo(task->size, task->dsa);
+	}
+
+	if (task->reduction != REDUCTION_NONE) {
+		// The reduction writes its result straight into the pbo
+		runReduction(task->texture, task->miplevel, task->region_x, task->region_y, task->width, task->height, srgb,
+			task->reduction, task->reduction_bins, task->pbo);
+	}
+	else if (!task->points.empty()) {
+		// So does the gather
+		runGather(task->texture, task->miplevel, task->width, task->height, task->points, srgb,
+			getGatherValueType(task->format, task->type), task->pbo);
+	}
+	else if (task->dsa) {
+		// Read the texture straight into the pbo: no fbo, no texture bind
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, task->pbo);
+		glGetTextureSubImage(read_texture, read_level, read_x, read_y, 0, task->width, read_height, task->depth,
+			read_format, read_type, (GLsizei)task->size, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	else {
+		// Create the fbo (frame buffer object) from the given texture
+		glGenFramebuffers(1, &(task->fbo));
+
+		// Bind the texture to the fbo
+		glBindFramebuffer(GL_FRAMEBUFFER, task->fbo);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, read_texture, read_level);
+
+		// Bind pbo to fbo
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, task->pbo);
+
+		// Start the read request
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(read_x, read_y, task->width, read_height, read_format, read_type, 0);
+
+		// Unbind buffers
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// The fbo is not needed anymore once the read is issued
+		// (and can't be deleted from the shared context)
+		glDeleteFramebuffers(1, &(task->fbo));
+		task->fbo = 0;
+	}
+	if (task->yuv_format != YUV_FORMAT_NONE) {
+		glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+	}
+
+	// Fence to know when it's ready
+	task->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	task->wait_strategy = (FenceWaitStrategy)wait_strategy.load();
+	if (task->wait_strategy == FENCE_WAIT_THREAD) {
+		if (startReadbackThread()) {
+			// The fence has to reach the GPU before another context can wait on it
+			glFlush();
+		}
+		else {
+			task->wait_strategy = FENCE_WAIT_POLL;
+		}
+	}
+
+	task->issue_frame = frame_index.load();
+	task->in_flight = true;
+	tasks_in_flight++;
+
+	// Done init
+	task->initialized = true;
+	traceEnd(TRACE_ISSUE, task->event_id, trace_start, task->size);
+
+	if (task->wait_strategy == FENCE_WAIT_THREAD) {
+		std::lock_guard<std::mutex> lock(readback_mutex);
+		if (readback_failed) {
+			task->wait_strategy = FENCE_WAIT_POLL;
+		}
+		else {
+			readback_queue.push_back(task);
+			readback_condition.notify_one();
+		}
+	}
+}
+
+static bool hasHigherPriority(const std::shared_ptr<Task>& a, const std::shared_ptr<Task>& b) {
+	if (a->priority != b->priority) {
+		return a->priority > b->priority;
+	}
+	return a->event_id < b->event_id;
+}
+
+/**
+ * @brief Tell if a task fits in what is left of a budget.
+ * The first task of a frame always fits, so that large tasks are not stuck.
+ */
+static bool fitsInBudget(long long used, long long budget, size_t size) {
+	return budget <= 0 || used == 0 || used + (long long)size <= budget;
+}
+
+/**
+ * @brief Issue the pending tasks, most urgent first.
+ * Expired and disposed tasks are dropped. Except high priority ones, tasks are
+ * issued only while they fit in the budget of the frame, and bulk tasks also in
+ * the bulk budget (at least one per frame).
+ * Has to be called from the render thread
+ */
+static void schedulePendingTasks() {
+	if (pending_tasks.empty()) {
+		return;
+	}
+	std::stable_sort(pending_tasks.begin(), pending_tasks.end(), hasHigherPriority);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	long long bulk_budget = bulk_budget_bytes.load();
+	std::vector<std::shared_ptr<Task>> deferred;
+	long long deferred_bytes = 0;
+	int64_t newly_deferred_requests = 0;
+	int64_t newly_deferred_bytes = 0;
+	int64_t expired = 0;
+
+	for (size_t i = 0; i < pending_tasks.size(); i++) {
+		std::shared_ptr<Task>& task = pending_tasks[i];
+		if (task->disposed && !task->shared) {
+			continue;
+		}
+		if (task->has_deadline && now > task->deadline) {
+			traceInstant(TRACE_EXPIRE, task->event_id);
+			task->error = true;
+			task->done = true;
+			expired++;
+			continue;
+		}
+		if (task->priority != PRIORITY_HIGH) {
+			bool fits = fitsInBudget(frame_bytes, effective_budget_bytes, task->size);
+			if (fits && task->priority == PRIORITY_BULK) {
+				fits = fitsInBudget(frame_bulk_bytes, bulk_budget, task->size);
+			}
+			if (!fits) {
+				if (!task->deferred) {
+					task->deferred = true;
+					newly_deferred_requests++;
+					newly_deferred_bytes += task->size;
+				}
+				deferred_bytes += task->size;
+				deferred.push_back(task);
+				continue;
+			}
+			frame_bytes += task->size;
+			if (task->priority == PRIORITY_BULK) {
+				frame_bulk_bytes += task->size;
+			}
+		}
+		issueTask(task);
+	}
+	pending_tasks.swap(deferred);
+
+	std::lock_guard<std::mutex> lock(scheduler_stats_mutex);
+	scheduler_stats.deferred_requests += newly_deferred_requests;
+	scheduler_stats.deferred_bytes += newly_deferred_bytes;
+	scheduler_stats.expired_requests += expired;
+	scheduler_stats.pending_requests = pending_tasks.size();
+	scheduler_stats.pending_bytes = deferred_bytes;
+}
+
+/**
+ * @brief Adapt the frame budget to the fence latency of the last frame:
+ * halve it when fences take longer than max_fence_latency_frames,
+ * grow it back slowly to the configured budget otherwise.
+ * Has to be called from the render thread, once per frame
+ */
+static void adaptFrameBudget() {
+	long long configured = frame_budget_bytes.load();
+	int max_latency = max_fence_latency_frames.load();
+	int latency = frame_fence_latency.exchange(-1);
+
+	if (configured <= 0 || max_latency <= 0 || effective_budget_bytes <= 0) {
+		// Not adaptive, or start from the configured budget
+		effective_budget_bytes = configured;
+	}
+	else if (latency > max_latency) {
+		long long lowest = std::max(configured / 16, 1LL);
+		effective_budget_bytes = std::max(effective_budget_bytes / 2, lowest);
+	}
+	else if (latency >= 0 || tasks_in_flight == 0) {
+		// Nothing late, but don't grow while fences are outstanding and none signaled
+		effective_budget_bytes = std::min(effective_budget_bytes + std::max(configured / 8, 1LL), configured);
+	}
+	if (effective_budget_bytes > configured) {
+		effective_budget_bytes = configured;
+	}
+
+	std::lock_guard<std::mutex> lock(scheduler_stats_mutex);
+	scheduler_stats.budget_bytes = effective_budget_bytes;
+	scheduler_stats.last_frame_bytes = frame_bytes;
+	scheduler_stats.last_fence_latency_frames = latency;
+}
+
+/**
+ * @brief Check if two requests read the same pixels the same way
+ */
+static bool isSameRead(const Task* a, const Task* b) {
+	return a->texture == b->texture && a->miplevel == b->miplevel
+		&& a->region_x == b->region_x && a->region_y == b->region_y
+		&& a->width == b->width && a->height == b->height && a->depth == b->depth
+		&& a->yuv_format == b->yuv_format && a->format == b->format && a->type == b->type
+		&& a->reduction == b->reduction && a->reduction_bins == b->reduction_bins && a->points == b->points
+		&& a->lazy == b->lazy && a->disk_writer == b->disk_writer
+		&& a->hashing == b->hashing && a->hash_stream == b->hash_stream;
+}
+
+/**
+ * @brief Share the read of an earlier request of the frame for the same texture,
+ * level, region and format, instead of issuing another one.
+ * Requests with a destination, a deadline or a hash stream, and reads already done, are not shared.
+ * The shared read has to be at least as urgent as the request.
+ * @return true if the task was coalesced, and must not be issued
+ */
+static bool coalesceTask(const std::shared_ptr<Task>& task) {
+	if (!coalescing_enabled || task->destination != nullptr || task->has_deadline || task->chunked != nullptr
+		|| task->disk_writer != nullptr || task->hash_stream > 0) {
+		return false;
+	}
+	task->submit_frame = frame_index.load();
+
+	// Forget the reads of the previous frames and the disposed ones
+	std::shared_ptr<Task> read;
+	size_t kept = 0;
+	for (size_t i = 0; i < frame_reads.size(); i++) {
+		std::shared_ptr<Task> candidate = frame_reads[i].lock();
+		if (candidate == nullptr || candidate->submit_frame != task->submit_frame) {
+			continue;
+		}
+		frame_reads[kept++] = frame_reads[i];
+		if (read == nullptr && !candidate->done && !candidate->error && isSameRead(candidate.get(), task.get())
+			&& candidate->priority >= task->priority && !candidate->has_deadline) {
+			read = candidate;
+		}
+	}
+	frame_reads.resize(kept);
+
+	if (read == nullptr) {
+		frame_reads.push_back(task);
+		return false;
+	}
+	read->shared = true;
+	task->shared_read = read;
+	traceInstant(TRACE_COALESCE, task->event_id, read->event_id);
+	std::lock_guard<std::mutex> lock(scheduler_stats_mutex);
+	scheduler_stats.coalesced_requests++;
+	return true;
+}
+
+/**
+ * @brief Split the region of a prepared chunked task in bands of chunk_rows rows, whose
+ * reads are written one after the other in its buffer: the task's destination, or allocated.
+ * @return false if the buffer could not be allocated or a band is invalid
+ */
+static bool splitChunks(Task* task) {
+	ChunkedRead* chunked = task->chunked.get();
+	if (task->destination != nullptr) {
+		chunked->data = task->destination;
+	}
+	else {
+		chunked->data = bufferAllocate(task->size);
+		chunked->allocated = (chunked->data != NULL);
+		if (chunked->data == NULL) {
+			return false;
+		}
+	}
+
+	int x = (task->region_width > 0) ? task->region_x : 0;
+	int y = (task->region_height > 0) ? task->region_y : 0;
+	size_t offset = 0;
+	for (int row = 0; row < task->height; row += task->chunk_rows) {
+		std::shared_ptr<Task> chunk = std::make_shared<Task>();
+		chunk->event_id = task->event_id;
+		chunk->texture = task->texture;
+		chunk->miplevel = task->miplevel;
+		chunk->expected_width = task->expected_width;
+		chunk->expected_height = task->expected_height;
+		chunk->region_x = x;
+		chunk->region_y = y + row;
+		chunk->region_width = task->width;
+		chunk->region_height = std::min(task->chunk_rows, task->height - row);
+		chunk->priority = task->priority;
+		chunk->has_deadline = task->has_deadline;
+		chunk->deadline = task->deadline;
+		if (!prepareTask(chunk.get()) || chunk->size > task->size - offset) {
+			return false;
+		}
+		chunk->destination = (char*)chunked->data + offset;
+		chunk->destination_capacity = chunk->size;
+		chunk->chunk_target = task->chunked;
+		offset += chunk->size;
+		task->chunks.push_back(chunk);
+	}
+	task->chunk_count = (int)task->chunks.size();
+	return true;
+}
+
+/**
+ * @brief Queue the next chunks of a chunked task for the frame.
+ * The chunks of a disposed task are dropped.
+ */
+static void issueChunks(Task* task) {
+	if (task->disposed) {
+		for (size_t i = task->next_chunk; i < task->chunks.size(); i++) {
+			task->chunks[i]->disposed = true;
+		}
+		task->next_chunk = task->chunks.size();
+		return;
+	}
+	for (int i = 0; i < task->chunks_per_frame && task->next_chunk < task->chunks.size(); i++) {
+		pending_tasks.push_back(task->chunks[task->next_chunk++]);
+	}
+	task->chunk_frame = frame_index.load();
+	task->initialized = true;
+}
+
+/**
+ * @brief Queue the chunks of the frame of every chunked task
+ * not done queuing them, once per frame
+ */
+static void scheduleChunks() {
+	uint32_t frame = frame_index.load();
+	size_t kept = 0;
+	for (size_t i = 0; i < chunked_tasks.size(); i++) {
+		std::shared_ptr<Task>& task = chunked_tasks[i];
+		if (task->chunk_frame != frame) {
+			issueChunks(task.get());
+		}
+		if (task->next_chunk < task->chunks.size()) {
+			chunked_tasks[kept++].swap(task);
+		}
+	}
+	chunked_tasks.resize(kept);
+}
+
+/**
+ * @brief Prepare a task and hand it to the scheduler.
+ * Has to be called from the render thread
+ */
+static void submitTask(const std::shared_ptr<Task>& task) {
+	updateTraceDebugCallback();
+	if (!prepareTask(task.get())) {
+		task->error = true;
+		task->done = true;
+		return;
+	}
+	if (task->chunked != nullptr) {
+		if (!splitChunks(task.get())) {
+			task->error = true;
+			task->done = true;
+			return;
+		}
+		issueChunks(task.get());
+		if (task->next_chunk < task->chunks.size()) {
+			chunked_tasks.push_back(task);
+		}
+		return;
+	}
+	if (coalesceTask(task)) {
+		return;
+	}
+	pending_tasks.push_back(task);
+}
+
+/**
+ * @brief Create a a read texture request
+ * The read is issued right away, unless it is over
+ * the budgets of the frame (see setFrameBudget and setBulkBudget)
+ * Has to be called by GL.IssuePluginEvent
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" void UNITY_INTERFACE_API makeRequest_renderThread(int event_id) {
+	recordCall(CALL_MAKE_REQUEST_RENDER_THREAD, { event_id });
+	// Get task back
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return;
+	}
+
+	submitTask(task);
+	schedulePendingTasks();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_makeRequest_renderThread() {
+	return makeRequest_renderThread;
+}
+
+/**
+ * @brief Add requests to the submit queue of the calling thread
+ */
+static void queueSubmits(const int* event_ids, int count) {
+	if (submit_queue == NULL) {
+		submit_queue = new SubmitQueue();
+		std::lock_guard<std::mutex> lock(submit_queues_mutex);
+		submit_queues.push_back(submit_queue);
+	}
+	std::lock_guard<std::mutex> lock(submit_queue->mutex);
+	submit_queue->event_ids.insert(submit_queue->event_ids.end(), event_ids, event_ids + count);
+}
+
+/**
+ * @brief Submit requests from any thread (e.g. job worker threads), instead of
+ * issuing makeRequest_renderThread events: they are created by the next
+ * scheduleFrame_renderThread event. Like batches, they are then completed
+ * by updateBatches_renderThread, and queried with getRequestStatus: they are
+ * not drained, so owners of batches never collect nor dispose them.
+ * Requests have to be set up (region, destination...) before being submitted.
+ * @param event_ids given by makeRequest_mainThread
+ * @param count Number of requests
+ */
+extern "C" void submitRequests(const int* event_ids, int count) {
+	if (isRecording()) {
+		CallRecord(CALL_SUBMIT_REQUESTS).addArray(event_ids, count).write();
+	}
+	queueSubmits(event_ids, count);
+}
+
+/**
+ * @brief Submit a request from any thread, see submitRequests
+ * @param event_id given by makeRequest_mainThread
+ */
+extern "C" void submitRequest(int event_id) {
+	recordCall(CALL_SUBMIT_REQUEST, { event_id });
+	queueSubmits(&event_id, 1);
+}
+
+/**
+ * @brief Create the requests of the submit queues of every thread
+ */
+static void drainSubmitQueues() {
+	std::vector<SubmitQueue*> queues;
+	{
+		std::lock_guard<std::mutex> lock(submit_queues_mutex);
+		queues = submit_queues;
+	}
+
+	std::vector<std::shared_ptr<Task>> submitted;
+	std::vector<int> event_ids;
+	for (size_t i = 0; i < queues.size(); i++) {
+		{
+			std::lock_guard<std::mutex> lock(queues[i]->mutex);
+			event_ids.swap(queues[i]->event_ids);
+		}
+		for (size_t j = 0; j < event_ids.size(); j++) {
+			std::shared_ptr<Task> task = findTask(event_ids[j]);
+			if (task != nullptr) {
+				submitTask(task);
+				submitted.push_back(task);
+			}
+		}
+		event_ids.clear();
+	}
+
+	if (!submitted.empty()) {
+		std::lock_guard<std::mutex> lock(batches_mutex);
+		submitted_tasks.insert(submitted_tasks.end(), submitted.begin(), submitted.end());
+	}
+}
+
+/**
+ * @brief Start a new frame for the scheduler: adapt and reset the budgets,
+ * create the requests submitted from other threads (submitRequests)
+ * and issue the requests deferred by the previous frames.
+ * Has to be called by GL.IssuePluginEvent, once per frame
+ * @param event_id unused
+ */
+extern "C" void UNITY_INTERFACE_API scheduleFrame_renderThread(int event_id) {
+	recordCall(CALL_SCHEDULE_FRAME, { event_id });
+	releaseMappedPbos();
+	adaptFrameBudget();
+	frame_index++;
+	frame_bytes = 0;
+	frame_bulk_bytes = 0;
+	updateTraceDebugCallback();
+	drainSubmitQueues();
+	scheduleChunks();
+	schedulePendingTasks();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_scheduleFrame_renderThread() {
+	return scheduleFrame_renderThread;
+}
+
+/**
+ * @brief Check the fence of a task, and complete it once signaled.
+ * Has to be called from the render thread
+ */
+static void updateTask(Task* task);
+
+/**
+ * @brief Update the queued chunks of a chunked task, it is done once they all are,
+ * in error as soon as one is
+ */
+static void updateChunks(Task* task) {
+	if (!task->initialized || task->done) {
+		return;
+	}
+	int done = 0;
+	for (size_t i = 0; i < task->next_chunk; i++) {
+		Task* chunk = task->chunks[i].get();
+		updateTask(chunk);
+		if (chunk->error) {
+			task->error = true;
+			task->done = true;
+			return;
+		}
+		if (chunk->done) {
+			done++;
+		}
+	}
+	task->chunks_done = done;
+	if (done == (int)task->chunks.size()) {
+		task->chunks.clear();
+		task->data = task->chunked->data;
+		task->done = true;
+	}
+}
+
+static void updateTask(Task* task) {
+	// A coalesced request completes with the read it shares
+	if (task->shared_read != nullptr && !task->done) {
+		Task* read = task->shared_read.get();
+		updateTask(read);
+		if (read->initialized) {
+			task->initialized = true;
+		}
+		if (read->done) {
+			task->size = read->size;
+			task->data = read->data;
+			task->hash = read->hash;
+			task->error = read->error.load();
+			task->done = true;
+		}
+		return;
+	}
+
+	// A chunked request completes with its last chunk
+	if (task->chunked != nullptr) {
+		updateChunks(task);
+		return;
+	}
+
+	// Do something only if initialized (thread safety)
+	if (!task->initialized || task->done) {
+		return;
+	}
+
+	// The readback thread completes the task by itself
+	if (task->wait_strategy == FENCE_WAIT_THREAD) {
+		return;
+	}
+
+	// Check fence state
+	uint64_t trace_start = traceBegin();
+	bool signaled = false;
+	if (task->wait_strategy == FENCE_WAIT_CLIENT_WAIT) {
+		GLenum result = glClientWaitSync(task->fence, GL_SYNC_FLUSH_COMMANDS_BIT, client_wait_timeout_ns.load());
+		if (result == GL_WAIT_FAILED) {
+			task->error = true;
+			task->done = true;
+			return;
+		}
+		signaled = (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+	}
+	else {
+		GLint status = 0;
+		GLsizei length = 0;
+		glGetSynciv(task->fence, GL_SYNC_STATUS, sizeof(GLint), &length, &status);
+		if (length <= 0) {
+			task->error = true;
+			task->done = true;
+			return;
+		}
+		signaled = (status == GL_SIGNALED);
+	}
+	traceEnd(TRACE_FENCE_CHECK, task->event_id, trace_start, signaled);
+
+	// When it's done
+	if (signaled) {
+		traceInstant(TRACE_SIGNAL, task->event_id);
+		completeTask(task);
+	}
+}
+
+/**
+ * @brief check if data is ready
+ * Has to be called by GL.IssuePluginEvent
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" void UNITY_INTERFACE_API update_renderThread(int event_id) {
+	recordCall(CALL_UPDATE, { event_id });
+	// Get task back
+	std::shared_ptr<Task> task = findTask(event_id);
+
+	// Check if task has not been already deleted by main thread
+	if(task == nullptr) {
+		releaseMappedPbos();
+		return;
+	}
+	updateTask(task.get());
+	releaseMappedPbos();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_update_renderThread() {
+	return update_renderThread;
+}
+
+/**
+ * @brief Create the requests of a batch, completed through the given completion queue
+ * @return batch_id
+ */
+static int makeBatch(int queue_id, const GLuint* textures, const int* widths, const int* heights, int count,
+	int priority, int* event_ids) {
+	std::vector<std::shared_ptr<Task>> batch_tasks(count);
+	for (int i = 0; i < count; i++) {
+		batch_tasks[i] = createTask(textures[i], 0, widths[i], heights[i]);
+		batch_tasks[i]->priority = priority;
+		event_ids[i] = batch_tasks[i]->event_id;
+	}
+
+	std::lock_guard<std::mutex> lock(batches_mutex);
+	int batch_id = next_batch_id++;
+	std::vector<std::shared_ptr<Task>>& queue = completion_queues[queue_id];
+	queue.insert(queue.end(), batch_tasks.begin(), batch_tasks.end());
+	batches[batch_id].swap(batch_tasks);
+	return batch_id;
+}
+
+/**
+ * @brief Request many textures at once, e.g. all the cameras of a rig for a frame.
+ * You then have to call makeRequestBatch_renderThread via GL.IssuePluginEvent
+ * with the returned batch_id. Completed requests of batches are then
+ * collected with drainCompletedRequests instead of one by one.
+ *
+ * @param textures OpenGL texture ids
+ * @param widths Widths of the textures, 0 if unknown
+ * @param heights Heights of the textures, 0 if unknown
+ * @param count Number of textures
+ * @param priority RequestPriority of the requests
+ * @param event_ids Receives the event_id of each request
+ * @return batch_id to give to IssuePluginEvent
+ */
+extern "C" int makeRequestBatch_mainThread(const GLuint* textures, const int* widths, const int* heights, int count,
+	int priority, int* event_ids) {
+	int batch_id = makeBatch(0, textures, widths, heights, count, priority, event_ids);
+	if (isRecording()) {
+		CallRecord(CALL_MAKE_REQUEST_BATCH).add(priority).add(batch_id).addArray(textures, count)
+			.addArray(widths, count).addArray(heights, count).addArray(event_ids, count).write();
+	}
+	return batch_id;
+}
+
+/**
+ * @brief Create a completion queue, so that each owner of batches (e.g. each CaptureManager)
+ * only drains its own requests: see makeQueuedRequestBatch_mainThread and drainCompletionQueue
+ * @return queue_id
+ */
+extern "C" int createCompletionQueue() {
+	int queue_id;
+	{
+		std::lock_guard<std::mutex> lock(batches_mutex);
+		queue_id = next_completion_queue_id++;
+		completion_queues[queue_id];
+	}
+	recordCall(CALL_CREATE_COMPLETION_QUEUE, { queue_id });
+	return queue_id;
+}
+
+/**
+ * @brief Forget a completion queue. Its requests are not drained anymore, dispose them
+ * @param queue_id given by createCompletionQueue
+ */
+extern "C" void closeCompletionQueue(int queue_id) {
+	recordCall(CALL_CLOSE_COMPLETION_QUEUE, { queue_id });
+	if (queue_id == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(batches_mutex);
+	completion_queues.erase(queue_id);
+}
+
+/**
+ * @brief Same as makeRequestBatch_mainThread, but the requests are collected
+ * with drainCompletionQueue on the given queue instead of drainCompletedRequests
+ * @param queue_id given by createCompletionQueue
+ */
+extern "C" int makeQueuedRequestBatch_mainThread(int queue_id, const GLuint* textures, const int* widths, const int* heights,
+	int count, int priority, int* event_ids) {
+	{
+		std::lock_guard<std::mutex> lock(batches_mutex);
+		if (completion_queues.find(queue_id) == completion_queues.end()) {
+			queue_id = 0;
+		}
+	}
+	int batch_id = makeBatch(queue_id, textures, widths, heights, count, priority, event_ids);
+	if (isRecording()) {
+		CallRecord(CALL_MAKE_QUEUED_REQUEST_BATCH).add(queue_id).add(priority).add(batch_id).addArray(textures, count)
+			.addArray(widths, count).addArray(heights, count).addArray(event_ids, count).write();
+	}
+	return batch_id;
+}
+
+/**
+ * @brief Create the read texture requests of a batch
+ * Has to be called by GL.IssuePluginEvent
+ * @param batch_id given by makeRequestBatch_mainThread
+ */
+extern "C" void UNITY_INTERFACE_API makeRequestBatch_renderThread(int batch_id) {
+	recordCall(CALL_MAKE_REQUEST_BATCH_RENDER_THREAD, { batch_id });
+	std::vector<std::shared_ptr<Task>> batch_tasks;
+	batches_mutex.lock();
+	std::map<int,std::vector<std::shared_ptr<Task>>>::iterator it = batches.find(batch_id);
+	if (it != batches.end()) {
+		batch_tasks.swap(it->second);
+		batches.erase(it);
+	}
+	batches_mutex.unlock();
+
+	for (size_t i = 0; i < batch_tasks.size(); i++) {
+		if (!batch_tasks[i]->disposed) {
+			submitTask(batch_tasks[i]);
+		}
+	}
+	schedulePendingTasks();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_makeRequestBatch_renderThread() {
+	return makeRequestBatch_renderThread;
+}
+
+/**
+ * @brief check if the requests of every batch, and the submitted requests, are ready
+ * Has to be called by GL.IssuePluginEvent, once per frame
+ * @param event_id unused
+ */
+extern "C" void UNITY_INTERFACE_API updateBatches_renderThread(int event_id) {
+	recordCall(CALL_UPDATE_BATCHES, { event_id });
+	batches_mutex.lock();
+	// Forget the disposed requests, in case nobody drains them
+	std::vector<std::shared_ptr<Task>> watched;
+	for (std::map<int,std::vector<std::shared_ptr<Task>>>::iterator it = completion_queues.begin(); it != completion_queues.end(); ++it) {
+		std::vector<std::shared_ptr<Task>>& queue = it->second;
+		queue.erase(std::remove_if(queue.begin(), queue.end(),
+			[](const std::shared_ptr<Task>& task) { return task->disposed.load(); }), queue.end());
+		watched.insert(watched.end(), queue.begin(), queue.end());
+	}
+	// Submitted requests are only watched until completed
+	submitted_tasks.erase(std::remove_if(submitted_tasks.begin(), submitted_tasks.end(),
+		[](const std::shared_ptr<Task>& task) { return task->disposed.load() || task->done.load() || task->error.load(); }), submitted_tasks.end());
+	watched.insert(watched.end(), submitted_tasks.begin(), submitted_tasks.end());
+	batches_mutex.unlock();
+
+	for (size_t i = 0; i < watched.size(); i++) {
+		if (!watched[i]->disposed) {
+			updateTask(watched[i].get());
+		}
+	}
+	releaseMappedPbos();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_updateBatches_renderThread() {
+	return updateBatches_renderThread;
+}
+
+/**
+ * @brief Data of a done task. The data of a lazy task is copied from its
+ * mapped pbo the first time, it then stays valid until the task is released
+ * @return NULL on error
+ */
+static void* getTaskData(Task* task) {
+	if (task->shared_read != nullptr) {
+		return getTaskData(task->shared_read.get());
+	}
+	if (!task->lazy) {
+		return task->data;
+	}
+
+	std::lock_guard<std::mutex> lock(task->data_mutex);
+	if (task->data == nullptr && task->mapped != nullptr) {
+		void* data = bufferAllocate(task->size);
+		if (data != NULL) {
+			uint64_t trace_start = traceBegin();
+			std::memcpy(data, task->mapped, task->size);
+			traceEnd(TRACE_COPY, task->event_id, trace_start, task->size);
+		}
+		task->data = data;
+	}
+	return task->data;
+}
+
+/**
+ * @brief Take the completed requests of a completion queue
+ */
+static int drainQueue(int queue_id, CompletedRequest* completed, int max_count) {
+	std::lock_guard<std::mutex> lock(batches_mutex);
+	std::map<int,std::vector<std::shared_ptr<Task>>>::iterator it = completion_queues.find(queue_id);
+	if (it == completion_queues.end()) {
+		return 0;
+	}
+	std::vector<std::shared_ptr<Task>>& queue = it->second;
+	int count = 0;
+	size_t kept = 0;
+	for (size_t i = 0; i < queue.size(); i++) {
+		Task* task = queue[i].get();
+		if (task->disposed) {
+			continue;
+		}
+		if (count < max_count && (task->done || task->error)) {
+			// Lazy and coalesced requests get their data here, never a NULL pointer with a length
+			void* data = (task->error || task->duplicate) ? NULL : getTaskData(task);
+			bool error = task->error || (data == NULL && !task->duplicate);
+			completed[count].event_id = task->event_id;
+			completed[count].error = error ? 1 : 0;
+			completed[count].data = data;
+			completed[count].length = (error || task->duplicate) ? 0 : (int64_t)task->size;
+			count++;
+			continue;
+		}
+		queue[kept++].swap(queue[i]);
+	}
+	queue.resize(kept);
+	return count;
+}
+
+/**
+ * @brief Collect the requests of batches that are done or in error since the last call,
+ * in one call. Their data is valid until they are disposed (see disposeRequests).
+ * Only the batches of makeRequestBatch_mainThread, see drainCompletionQueue for the others.
+ * @param completed Receives the completed requests
+ * @param max_count Size of completed
+ * @return Number of completed requests written
+ */
+extern "C" int drainCompletedRequests(CompletedRequest* completed, int max_count) {
+	recordCall(CALL_DRAIN_COMPLETED_REQUESTS, { max_count });
+	return drainQueue(0, completed, max_count);
+}
+
+/**
+ * @brief Same as drainCompletedRequests, for the batches of a completion queue
+ * @param queue_id given by createCompletionQueue
+ */
+extern "C" int drainCompletionQueue(int queue_id, CompletedRequest* completed, int max_count) {
+	recordCall(CALL_DRAIN_COMPLETION_QUEUE, { queue_id, max_count });
+	return drainQueue(queue_id, completed, max_count);
+}
+
+/**
+ * @brief Get data from the main thread
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" void getData_mainThread(int event_id, void** buffer, size_t* length) {
+	recordCall(CALL_GET_DATA, { event_id });
+	// Get task back
+	std::shared_ptr<Task> task = findTask(event_id);
+
+	// Do something only if initialized (thread safety)
+	if (task == nullptr || !task->done) {
+		return;
+	}
+
+	// Copy the pointer. Warning: it is only valid until dispose
+	*length = task->duplicate ? 0 : task->size;
+	*buffer = getTaskData(task.get());
+}
+
+/**
+ * @brief Copy a part of the data of a done request to a caller buffer.
+ * With lazy mapping (setLazyMapping), it is copied straight from the pixel buffer,
+ * so reading a few rows of a frame doesn't copy the whole frame.
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param offset Offset in the data, in bytes
+ * @param length Number of bytes to copy
+ * @param buffer Receives the bytes
+ * @return false if the request is not done, in error or the range is out of the data
+ */
+extern "C" bool getDataRange_mainThread(int event_id, long long offset, int length, void* buffer) {
+	recordCall(CALL_GET_DATA_RANGE, { event_id, offset, length });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr || !task->done || task->error || buffer == NULL
+		|| offset < 0 || length < 0 || (size_t)length > task->size || (size_t)offset > task->size - length) {
+		return false;
+	}
+
+	Task* read = (task->shared_read != nullptr) ? task->shared_read.get() : task.get();
+	const void* source;
+	{
+		std::lock_guard<std::mutex> lock(read->data_mutex);
+		source = (read->data != nullptr) ? read->data : read->mapped;
+	}
+	if (source == NULL) {
+		return false;
+	}
+	uint64_t trace_start = traceBegin();
+	std::memcpy(buffer, (const char*)source + offset, length);
+	traceEnd(TRACE_COPY, task->event_id, trace_start, length);
+	return true;
+}
+
+/**
+ * @brief Check if request is done
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" bool isRequestDone(int event_id) {
+	recordCall(CALL_IS_REQUEST_DONE, { event_id });
+	// Get task back
+	std::shared_ptr<Task> task = findTask(event_id);
+
+	return task != nullptr && task->done;
+}
+
+/**
+ * @brief Check if request is in error
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" bool isRequestError(int event_id) {
+	recordCall(CALL_IS_REQUEST_ERROR, { event_id });
+	// Get task back
+	std::shared_ptr<Task> task = findTask(event_id);
+
+	// Unknown or disposed
+	return task == nullptr || task->error;
+}
+
+/**
+ * @brief Get the progress of a request: the part of its chunks completed for
+ * a chunked request (see setRequestChunks), 0 or 1 otherwise
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @return From 0 to 1, 0 if the request doesn't exist
+ */
+extern "C" float getRequestProgress(int event_id) {
+	recordCall(CALL_GET_REQUEST_PROGRESS, { event_id });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return 0;
+	}
+	if (task->done) {
+		return 1;
+	}
+	int count = task->chunk_count;
+	return (count > 0) ? (float)task->chunks_done / count : 0;
+}
+
+/**
+ * @brief Get the hash of the data of a request (see setRequestHashing). Two requests
+ * with the same data have the same hash
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param hash Receives the hash
+ * @return false if the request is not done, in error or not hashed
+ */
+extern "C" bool getRequestHash(int event_id, uint64_t* hash) {
+	recordCall(CALL_GET_REQUEST_HASH, { event_id });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr || !task->done || task->error || !task->hashing || hash == NULL) {
+		return false;
+	}
+	*hash = task->hash;
+	return true;
+}
+
+/**
+ * @brief Get the whole state of a request in one call, and its data once done.
+ * Unlike the other functions, an unknown or disposed event_id is not an error.
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ * @param buffer Receives the data once done, can be NULL. Warning: it is only valid until dispose
+ * @param length Receives the size of the data once done, can be NULL. -1 over 2 GB, see getData_mainThread
+ * @return RequestStatus flags, 0 if the request doesn't exist
+ */
+extern "C" int getRequestStatus(int event_id, void** buffer, int* length) {
+	recordCall(CALL_GET_REQUEST_STATUS, { event_id });
+	std::shared_ptr<Task> task = findTask(event_id);
+	if (task == nullptr) {
+		return 0;
+	}
+	int status = REQUEST_STATUS_VALID;
+	if (task->initialized) {
+		status |= REQUEST_STATUS_ISSUED;
+	}
+	if (task->error) {
+		status |= REQUEST_STATUS_ERROR;
+	}
+	if (task->done) {
+		status |= REQUEST_STATUS_DONE;
+		if (task->duplicate) {
+			status |= REQUEST_STATUS_DUPLICATE;
+		}
+		if (!task->error) {
+			if (buffer != NULL) {
+				*buffer = task->lazy ? NULL : task->data;
+			}
+			if (length != NULL) {
+				*length = task->duplicate ? 0 : (task->size > (size_t)INT_MAX ? -1 : (int)task->size);
+			}
+		}
+	}
+	return status;
+}
+
+/**
+ * @brief Remove a task, see dispose
+ */
+static void disposeTask(int event_id) {
+	traceInstant(TRACE_DISPOSE, event_id);
+
+	// Remove from tasks, data is freed with the task once no thread uses it anymore
+	std::shared_ptr<Task> task = removeTask(event_id);
+
+	if (task != nullptr) {
+		std::lock_guard<std::mutex> lock(task->destination_mutex);
+		task->disposed = true;
+	}
+	if (task != nullptr && task->chunked != nullptr) {
+		std::lock_guard<std::mutex> lock(task->chunked->mutex);
+		task->chunked->disposed = true;
+	}
+}
+
+/**
+ * @brief clear data for a frame
+ * The data buffer is released with the task. A caller-provided destination
+ * is not written anymore once this returns, even if the request was not done.
+ * @param event_id containing the the task index, given by makeRequest_mainThread
+ */
+extern "C" void dispose(int event_id) {
+	recordCall(CALL_DISPOSE, { event_id });
+	disposeTask(event_id);
+}
+
+/**
+ * @brief dispose many requests at once, see dispose
+ */
+extern "C" void disposeRequests(const int* event_ids, int count) {
+	if (isRecording()) {
+		CallRecord(CALL_DISPOSE_REQUESTS).addArray(event_ids, count).write();
+	}
+	for (int i = 0; i < count; i++) {
+		disposeTask(event_ids[i]);
+	}
+}
+
+/**
+ * @brief Limit the bytes of bulk requests issued per frame, the others wait
+ * for the next frames (see scheduleFrame_renderThread).
+ * @param bytes_per_frame Budget, 0 for no limit (default)
+ */
+extern "C" void setBulkBudget(long long bytes_per_frame) {
+	recordCall(CALL_SET_BULK_BUDGET, { bytes_per_frame });
+	bulk_budget_bytes = (bytes_per_frame > 0) ? bytes_per_frame : 0;
+}
+
+/**
+ * @brief Limit the bytes of requests issued per frame, except high priority ones.
+ * The others wait for the next frames (see scheduleFrame_renderThread).
+ * @param bytes_per_frame Budget, 0 for no limit (default)
+ * @param max_latency_frames Adaptive throttling: the budget is halved each frame a fence
+ * takes more than this number of frames to signal, and grows back otherwise. 0 to disable
+ */
+extern "C" void setFrameBudget(long long bytes_per_frame, int max_latency_frames) {
+	recordCall(CALL_SET_FRAME_BUDGET, { bytes_per_frame, max_latency_frames });
+	frame_budget_bytes = (bytes_per_frame > 0) ? bytes_per_frame : 0;
+	max_fence_latency_frames = (max_latency_frames > 0) ? max_latency_frames : 0;
+}
+
+/**
+ * @brief Get the transfer scheduler counters
+ */
+extern "C" void getSchedulerStats(SchedulerStats* stats) {
+	recordCall(CALL_GET_SCHEDULER_STATS, {});
+	std::lock_guard<std::mutex> lock(scheduler_stats_mutex);
+	*stats = scheduler_stats;
+}
+
+/**
+ * @brief Enable or disable the coalescing of the requests of a frame reading
+ * the same texture, level, region and format (enabled by default).
+ * Coalesced requests share one read and one data buffer, released with the last of them.
+ */
+extern "C" void setCoalescing(bool enabled) {
+	recordCall(CALL_SET_COALESCING, { enabled });
+	coalescing_enabled = enabled;
+}
+
+/**
+ * @brief Leave the data of the next requests in their pixel buffer once done,
+ * instead of copying it to a data buffer right away: it is only copied when
+ * asked for, by getData_mainThread (whole data, once) or getDataRange_mainThread,
+ * so requests disposed unread cost no copy. The pixel buffers stay mapped until the
+ * requests are disposed. getRequestStatus and drainCompletedRequests then give a
+ * NULL buffer (and the length). Requests with a destination are always copied.
+ * @param enabled Disabled by default
+ */
+extern "C" void setLazyMapping(bool enabled) {
+	recordCall(CALL_SET_LAZY_MAPPING, { enabled });
+	lazy_mapping_enabled = enabled;
+}
+
+/**
+ * @brief Let the pixel buffers of the next reads be backed by host memory where the
+ * driver supports it (see PinnedMemoryMode): the GPU then writes the data where it is
+ * returned, without map and copy. Requests with a destination, lazy mapping, a reduction,
+ * points or of a video sink use regular pixel buffers. Falls back to them when a buffer can't be created.
+ * @param enabled Enabled by default
+ */
+extern "C" void setPinnedMemory(bool enabled) {
+	recordCall(CALL_SET_PINNED_MEMORY, { enabled });
+	pinned_memory_enabled = enabled;
+}
+
+/**
+ * @brief Get how the pixel buffers are backed by host memory
+ * @return A PinnedMemoryMode value, PINNED_MEMORY_NONE if disabled, not supported or not probed yet
+ */
+extern "C" int getPinnedMemoryMode() {
+	recordCall(CALL_GET_PINNED_MEMORY_MODE, {});
+	return pinned_memory_enabled ? pinned_memory_mode.load() : PINNED_MEMORY_NONE;
+}
+
+/**
+ * @brief Select how request completion is detected, for the next requests
+ * @param strategy A FenceWaitStrategy value
+ * @param timeout_us Maximum time FENCE_WAIT_CLIENT_WAIT blocks in each update_renderThread, in microseconds
+ */
+extern "C" void setFenceWaitStrategy(int strategy, int timeout_us) {
+	recordCall(CALL_SET_FENCE_WAIT_STRATEGY, { strategy, timeout_us });
+	if (strategy < FENCE_WAIT_POLL || strategy > FENCE_WAIT_THREAD) {
+		strategy = FENCE_WAIT_POLL;
+	}
+	wait_strategy = strategy;
+	client_wait_timeout_ns = (long long)(timeout_us > 0 ? timeout_us : 0) * 1000;
+}
+
+/**
+ * @brief Forget cached informations about a texture (every miplevel)
+ * Call it when a texture is destroyed or recreated by Unity.
+ * @param texture OpenGL texture id, 0 to clear the whole cache
+ */
+extern "C" void invalidateTextureInfo(GLuint texture) {
+	recordCall(CALL_INVALIDATE_TEXTURE_INFO, { texture });
+	std::lock_guard<std::mutex> lock(texture_infos_mutex);
+	if (texture == 0) {
+		texture_infos.clear();
+		return;
+	}
+	std::map<std::pair<GLuint,int>,TextureInfo>::iterator it = texture_infos.lower_bound(std::make_pair(texture, 0));
+	while (it != texture_infos.end() && it->first.first == texture) {
+		it = texture_infos.erase(it);
+	}
+}
+
+/**
+ * @brief Enable or disable the recording of trace events.
+ * Events are kept in a ring buffer per thread, the oldest ones are overwritten.
+ */
+extern "C" void setTraceEnabled(bool enabled) {
+	trace_enabled = enabled;
+}
+
+/**
+ * @brief Write the recorded trace events to a Chrome trace / Perfetto JSON file
+ * @param path Destination file
+ * @return Number of events written, -1 if the file can't be opened
+ */
+extern "C" int dumpTrace(const char* path) {
+	return traceDump(path);
+}
+
+/**
+ * @brief Record every call into this API to a compact binary log, with timestamps and the size
+ * and format of the textures read, to replay a production workload offline (bench/ReadbackReplay).
+ * Data and buffer contents are not recorded. Replaces the current log.
+ * @param path Destination file
+ * @return false if the file can't be created
+ */
+extern "C" bool startCallRecording(const char* path) {
+	{
+		std::lock_guard<std::mutex> lock(texture_infos_mutex);
+		recorded_texture_infos.clear();
+	}
+	return callLogStart(path);
+}
+
+/**
+ * @brief Stop recording the calls and close the log
+ */
+extern "C" void stopCallRecording() {
+	callLogStop();
+}
+
+/**
+ * @brief Set the number of pixel buffers kept for reuse once their request is done.
+ * More avoids allocating buffers when many requests are in flight, at the cost of GPU memory
+ * @param count Maximum number of pooled buffers, 0 to allocate one for each read (default 8)
+ */
+extern "C" void setPboPoolSize(int count) {
+	recordCall(CALL_SET_PBO_POOL_SIZE, { count });
+	pbo_pool_max = (count > 0) ? count : 0;
+}
+
+/**
+ * @brief Configure the allocator of the data buffers
+ * @param huge_pages A HugePageMode value
+ * @param max_cached_bytes Maximum size of the disposed buffers kept for reuse, 0 to release everything
+ */
+extern "C" void setAllocatorOptions(int huge_pages, long long max_cached_bytes) {
+	recordCall(CALL_SET_ALLOCATOR_OPTIONS, { huge_pages, max_cached_bytes });
+	if (huge_pages < HUGE_PAGES_NONE || huge_pages > HUGE_PAGES_HUGETLB) {
+		huge_pages = HUGE_PAGES_NONE;
+	}
+	bufferConfigure((HugePageMode)huge_pages, max_cached_bytes > 0 ? (size_t)max_cached_bytes : 0);
+}
+
+/**
+ * @brief Map and pre-fault data buffers before starting a capture stream
+ * @param size Size in bytes of the frames of the stream
+ * @param count Number of buffers to prepare (usually the number of requests in flight)
+ * @return Number of buffers actually prepared
+ */
+extern "C" int reserveBuffers(int size, int count) {
+	recordCall(CALL_RESERVE_BUFFERS, { size, count });
+	if (size <= 0 || count <= 0) {
+		return 0;
+	}
+	return bufferReserve(size, count);
+}
+
+/**
+ * @brief Tell if a texture of the given format can be captured by a video sink:
+ * the conversion reads color, not integer, depth or stencil values
+ */
+static bool isVideoSinkFormat(GLenum format) {
+	return format == GL_RED || format == GL_RG || format == GL_RGB || format == GL_RGBA;
+}
+
+/**
+ * @brief Encode every frame of a texture to a video file, without going through
+ * the managed side: issue captureVideoSink_renderThread once per frame (e.g. from
+ * a CommandBuffer). Frames are converted to NV12 on the GPU (on the sink thread
+ * without compute shaders, or for odd sizes) and encoded on the sink thread.
+ * The captures are high priority requests: frame budgets don't postpone them.
+ *
+ * @param texture OpenGL texture id, read as RGBA8. Integer and depth textures are not supported
+ * @param width Width of the texture, 0 if unknown
+ * @param height Height of the texture, 0 if unknown
+ * @param path Output file
+ * @param fps Frame rate of the video
+ * @param encoder A VideoEncoderType value
+ * @param options Encoder options (ffmpeg output options, e.g. "-c:v libx264 -crf 18", split on whitespace
+ * into arguments, without a shell), NULL or empty for the defaults
+ * @return sink_id to give to IssuePluginEvent, 0 if the arguments are invalid or the texture format is not supported
+ */
+extern "C" int createVideoSink(GLuint texture, int width, int height, const char* path, int fps, int encoder, const char* options) {
+	if (path == NULL || fps <= 0) {
+		return 0;
+	}
+	// Without a context (Unity's main thread), the format is checked by each capture
+	if (hasCurrentContext() && !isVideoSinkFormat(getTextureInfo(texture, 0, width, height).format)) {
+		return 0;
+	}
+	VideoEncoder* video_encoder;
+	if (encoder == VIDEO_ENCODER_FFMPEG) {
+		video_encoder = new FFmpegPipeEncoder(path, fps, options != NULL ? options : "");
+	}
+	else if (encoder == VIDEO_ENCODER_RAW_NV12) {
+		video_encoder = new RawNv12Encoder(path);
+	}
+	else {
+		return 0;
+	}
+
+	std::shared_ptr<VideoSinkSource> source = std::make_shared<VideoSinkSource>();
+	source->sink = std::make_shared<VideoSink>(video_encoder, VIDEO_SINK_MAX_QUEUED);
+	source->texture = texture;
+	source->width = width;
+	source->height = height;
+
+	int sink_id;
+	{
+		std::lock_guard<std::mutex> lock(video_sinks_mutex);
+		sink_id = next_video_sink_id++;
+		video_sinks[sink_id] = source;
+	}
+	if (isRecording()) {
+		CallRecord(CALL_CREATE_VIDEO_SINK).add(texture).add(width).add(height).add(fps).add(encoder).add(sink_id)
+			.addString(path).addString(options).write();
+	}
+	return sink_id;
+}
+
+/**
+ * @brief Capture a frame of the texture of a video sink, and complete its previous captures.
+ * A frame is dropped if too many captures are in flight.
+ * Has to be called by GL.IssuePluginEvent, once per frame
+ * @param sink_id given by createVideoSink
+ */
+extern "C" void UNITY_INTERFACE_API captureVideoSink_renderThread(int sink_id) {
+	recordCall(CALL_CAPTURE_VIDEO_SINK, { sink_id });
+	video_sinks_mutex.lock();
+	std::map<int,std::shared_ptr<VideoSinkSource>>::iterator it = video_sinks.find(sink_id);
+	std::shared_ptr<VideoSinkSource> source;
+	if (it != video_sinks.end()) {
+		source = it->second;
+	}
+	video_sinks_mutex.unlock();
+	if (source == nullptr) {
+		return;
+	}
+
+	// Complete the previous captures, in order
+	size_t kept = 0;
+	for (size_t i = 0; i < source->in_flight.size(); i++) {
+		std::shared_ptr<Task>& task = source->in_flight[i];
+		updateTask(task.get());
+		if (!task->done && !task->error) {
+			source->in_flight[kept++].swap(task);
+		}
+	}
+	source->in_flight.resize(kept);
+
+	if ((int)source->in_flight.size() >= VIDEO_SINK_MAX_IN_FLIGHT) {
+		source->sink->dropFrame();
+		return;
+	}
+
+	std::shared_ptr<Task> task = std::make_shared<Task>();
+	task->texture = source->texture;
+	task->miplevel = 0;
+	task->expected_width = source->width;
+	task->expected_height = source->height;
+	task->event_id = next_event_id++;
+	task->sink = source->sink;
+	traceInstant(TRACE_REQUEST, task->event_id);
+
+	if (!prepareTask(task.get()) || task->depth != 1) {
+		source->sink->dropFrame();
+		return;
+	}
+	if (!isVideoSinkFormat(task->format)) {
+		source->sink->failFrame();
+		return;
+	}
+	// Not postponed by the frame budgets: the sink would see the frames late or drop them
+	task->priority = PRIORITY_HIGH;
+	if (task->width % 2 == 0 && task->height % 2 == 0 && yuvProgramReady()) {
+		// Converted to NV12 on the GPU, the sink only flips the rows
+		task->yuv_format = YUV_FORMAT_NV12;
+		task->size = (size_t)task->width * task->height * 3 / 2;
+	}
+	else {
+		// Whatever the texture format, read RGBA8 for the conversion
+		task->format = GL_RGBA;
+		task->type = GL_UNSIGNED_BYTE;
+		task->size = (size_t)task->width * task->height * 4;
+	}
+
+	source->in_flight.push_back(task);
+	pending_tasks.push_back(task);
+	schedulePendingTasks();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_captureVideoSink_renderThread() {
+	return captureVideoSink_renderThread;
+}
+
+/**
+ * @brief Stop a video sink: the frames already read are encoded, then the file is closed.
+ * Blocks until the encoder is done.
+ * @param sink_id given by createVideoSink
+ */
+extern "C" void closeVideoSink(int sink_id) {
+	recordCall(CALL_CLOSE_VIDEO_SINK, { sink_id });
+	video_sinks_mutex.lock();
+	std::map<int,std::shared_ptr<VideoSinkSource>>::iterator it = video_sinks.find(sink_id);
+	std::shared_ptr<VideoSinkSource> source;
+	if (it != video_sinks.end()) {
+		source = it->second;
+		video_sinks.erase(it);
+	}
+	video_sinks_mutex.unlock();
+
+	if (source != nullptr) {
+		source->sink->stop();
+	}
+}
+
+static void closeVideoSinks() {
+	std::map<int,std::shared_ptr<VideoSinkSource>> sinks;
+	video_sinks_mutex.lock();
+	sinks.swap(video_sinks);
+	video_sinks_mutex.unlock();
+
+	for (std::map<int,std::shared_ptr<VideoSinkSource>>::iterator it = sinks.begin(); it != sinks.end(); ++it) {
+		it->second->sink->stop();
+	}
+}
+
+/**
+ * @brief Get the counters of a video sink
+ * @param sink_id given by createVideoSink
+ * @return false if the sink doesn't exist
+ */
+extern "C" bool getVideoSinkStats(int sink_id, VideoSinkStats* stats) {
+	recordCall(CALL_GET_VIDEO_SINK_STATS, { sink_id });
+	std::lock_guard<std::mutex> lock(video_sinks_mutex);
+	std::map<int,std::shared_ptr<VideoSinkSource>>::iterator it = video_sinks.find(sink_id);
+	if (it == video_sinks.end()) {
+		return false;
+	}
+	*stats = it->second->sink->getStats();
+	return true;
+}
+
+/**
+ * @brief Create a latest-frame mailbox for a texture, e.g. for a live preview or a remote viewer.
+ * Each captureMailbox_renderThread event reads the texture while less than MAILBOX_SLOTS frames
+ * are in flight, completed or acquired. The consumer gets the newest completed frame with
+ * acquireMailboxFrame, older frames are recycled without being copied.
+ * @param texture OpenGL texture id
+ * @param width Width of the texture, 0 if unknown
+ * @param height Height of the texture, 0 if unknown
+ * @return mailbox_id to give to IssuePluginEvent
+ */
+extern "C" int createMailbox(GLuint texture, int width, int height) {
+	std::shared_ptr<Mailbox> mailbox = std::make_shared<Mailbox>();
+	mailbox->texture = texture;
+	mailbox->width = width;
+	mailbox->height = height;
+
+	int mailbox_id;
+	{
+		std::lock_guard<std::mutex> lock(mailboxes_mutex);
+		mailbox_id = next_mailbox_id++;
+		mailboxes[mailbox_id] = mailbox;
+	}
+	recordCall(CALL_CREATE_MAILBOX, { texture, width, height, mailbox_id });
+	return mailbox_id;
+}
+
+static std::shared_ptr<Mailbox> findMailbox(int mailbox_id) {
+	std::lock_guard<std::mutex> lock(mailboxes_mutex);
+	std::map<int,std::shared_ptr<Mailbox>>::iterator it = mailboxes.find(mailbox_id);
+	if (it == mailboxes.end()) {
+		return nullptr;
+	}
+	return it->second;
+}
+
+/**
+ * @brief Publish the completed captures of a mailbox, and capture a frame of its texture
+ * if a slot is free.
+ * Has to be called by GL.IssuePluginEvent, once per frame
+ * @param mailbox_id given by createMailbox
+ */
+extern "C" void UNITY_INTERFACE_API captureMailbox_renderThread(int mailbox_id) {
+	recordCall(CALL_CAPTURE_MAILBOX, { mailbox_id });
+	std::shared_ptr<Mailbox> mailbox = findMailbox(mailbox_id);
+	if (mailbox == nullptr) {
+		return;
+	}
+
+	// Completed captures replace the latest frame, in order
+	size_t kept = 0;
+	int held = 0;
+	for (size_t i = 0; i < mailbox->in_flight.size(); i++) {
+		std::shared_ptr<Task>& task = mailbox->in_flight[i];
+		updateTask(task.get());
+		if (!task->done && !task->error) {
+			mailbox->in_flight[kept++].swap(task);
+		}
+		else if (!task->error) {
+			std::lock_guard<std::mutex> lock(mailbox->mutex);
+			mailbox->latest.swap(task);
+		}
+	}
+	mailbox->in_flight.resize(kept);
+	{
+		std::lock_guard<std::mutex> lock(mailbox->mutex);
+		held = (mailbox->latest != nullptr ? 1 : 0) + (mailbox->acquired != nullptr ? 1 : 0);
+	}
+	// Unmap the superseded frames
+	releaseMappedPbos();
+
+	if ((int)mailbox->in_flight.size() + held >= MAILBOX_SLOTS) {
+		return;
+	}
+
+	std::shared_ptr<Task> task = std::make_shared<Task>();
+	task->texture = mailbox->texture;
+	task->miplevel = 0;
+	task->expected_width = mailbox->width;
+	task->expected_height = mailbox->height;
+	task->event_id = next_event_id++;
+	// The consumer reads the mapped pbo
+	task->lazy = true;
+	task->submit_frame = frame_index.load();
+	traceInstant(TRACE_REQUEST, task->event_id);
+
+	if (!prepareTask(task.get())) {
+		return;
+	}
+	mailbox->in_flight.push_back(task);
+	pending_tasks.push_back(task);
+	schedulePendingTasks();
+}
+extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API getfunction_captureMailbox_renderThread() {
+	return captureMailbox_renderThread;
+}
+
+/**
+ * @brief Acquire the newest completed frame of a mailbox, without copy. The frame
+ * acquired before is released. Can be called from any thread.
+ * @param mailbox_id given by createMailbox
+ * @param buffer Receives the data. Warning: it is only valid until the frame is released
+ * @param length Receives the size of the data
+ * @param frame Receives the scheduler frame (see scheduleFrame_renderThread) the frame was captured in, can be NULL
+ * @return false if no frame completed since the last acquire, the acquired frame is then kept
+ */
+extern "C" bool acquireMailboxFrame(int mailbox_id, void** buffer, int* length, uint32_t* frame) {
+	recordCall(CALL_ACQUIRE_MAILBOX_FRAME, { mailbox_id });
+	std::shared_ptr<Mailbox> mailbox = findMailbox(mailbox_id);
+	if (mailbox == nullptr) {
+		return false;
+	}
+
+	std::shared_ptr<Task> released;
+	std::lock_guard<std::mutex> lock(mailbox->mutex);
+	if (mailbox->latest == nullptr) {
+		return false;
+	}
+	released.swap(mailbox->acquired);
+	mailbox->acquired.swap(mailbox->latest);
+	*buffer = mailbox->acquired->mapped;
+	*length = (int)mailbox->acquired->size;
+	if (frame != NULL) {
+		*frame = mailbox->acquired->submit_frame;
+	}
+	return true;
+}
+
+/**
+ * @brief Release the frame acquired from a mailbox, so that its slot can be reused
+ * @param mailbox_id given by createMailbox
+ */
+extern "C" void releaseMailboxFrame(int mailbox_id) {
+	recordCall(CALL_RELEASE_MAILBOX_FRAME, { mailbox_id });
+	std::shared_ptr<Mailbox> mailbox = findMailbox(mailbox_id);
+	if (mailbox == nullptr) {
+		return;
+	}
+
+	std::shared_ptr<Task> released;
+	std::lock_guard<std::mutex> lock(mailbox->mutex);
+	released.swap(mailbox->acquired);
+}
+
+/**
+ * @brief Close a mailbox. Its frames, even an acquired one, are not valid anymore.
+ * Remove the captureMailbox_renderThread events first.
+ * @param mailbox_id given by createMailbox
+ */
+extern "C" void closeMailbox(int mailbox_id) {
+	recordCall(CALL_CLOSE_MAILBOX, { mailbox_id });
+	std::lock_guard<std::mutex> lock(mailboxes_mutex);
+	mailboxes.erase(mailbox_id);
+}
+
+/**
+ * @brief Create a disk writer, e.g. to capture a dataset: the requests given to it with
+ * setRequestDiskWriter have their data written to one file each, on the writer threads,
+ * so that the capture is bounded by the disk and not by the game loop. The data is copied
+ * to an aligned buffer of the plugin allocator once read; files are dropped while max_queued
+ * of them wait to be written.
+ *
+ * @param path_format Path of the files, with exactly one integer conversion for their index (e.g. "/data/frame_%06d.raw")
+ * @param first_index Index of the first file
+ * @param backend A DiskWriterBackend value. io_uring falls back to threads when not available
+ * @param direct_io Write with O_DIRECT, bypassing the page cache, where the file system supports it
+ * @param threads Number of threads of DISK_WRITER_THREADS
+ * @param max_queued Maximum files waiting to be written
+ * @return writer_id to give to setRequestDiskWriter, 0 if the arguments are invalid
+ */
+extern "C" int createDiskWriter(const char* path_format, int first_index, int backend, bool direct_io, int threads, int max_queued) {
+	if (path_format == NULL || !isValidDiskPathFormat(path_format) || first_index < 0 || max_queued <= 0
+		|| (backend != DISK_WRITER_IO_URING && backend != DISK_WRITER_THREADS)) {
+		return 0;
+	}
+	std::shared_ptr<DiskWriter> writer = std::make_shared<DiskWriter>(path_format, first_index, (DiskWriterBackend)backend,
+		direct_io, std::min(threads, DISK_WRITER_MAX_THREADS), max_queued);
+
+	int writer_id;
+	{
+		std::lock_guard<std::mutex> lock(disk_writers_mutex);
+		writer_id = next_disk_writer_id++;
+		disk_writers[writer_id] = writer;
+	}
+	if (isRecording()) {
+		CallRecord(CALL_CREATE_DISK_WRITER).add(first_index).add(backend).add(direct_io).add(threads).add(max_queued).add(writer_id)
+			.addString(path_format).write();
+	}
+	return writer_id;
+}
+
+/**
+ * @brief Get the counters of a disk writer
+ * @param writer_id given by createDiskWriter
+ * @return false if the writer doesn't exist
+ */
+extern "C" bool getDiskWriterStats(int writer_id, DiskWriterStats* stats) {
+	recordCall(CALL_GET_DISK_WRITER_STATS, { writer_id });
+	std::lock_guard<std::mutex> lock(disk_writers_mutex);
+	std::map<int,std::shared_ptr<DiskWriter>>::iterator it = disk_writers.find(writer_id);
+	if (it == disk_writers.end()) {
+		return false;
+	}
+	*stats = it->second->getStats();
+	return true;
+}
+
+/**
+ * @brief Stop a disk writer: the files already queued are written, files of the requests
+ * still in flight are dropped. Blocks until the files are written.
+ * @param writer_id given by createDiskWriter
+ * @param stats Receives the final counters, can be NULL
+ * @return false if the writer doesn't exist
+ */
+extern "C" bool closeDiskWriter(int writer_id, DiskWriterStats* stats) {
+	recordCall(CALL_CLOSE_DISK_WRITER, { writer_id });
+	std::shared_ptr<DiskWriter> writer;
+	{
+		std::lock_guard<std::mutex> lock(disk_writers_mutex);
+		std::map<int,std::shared_ptr<DiskWriter>>::iterator it = disk_writers.find(writer_id);
+		if (it == disk_writers.end()) {
+			return false;
+		}
+		writer = it->second;
+		disk_writers.erase(it);
+	}
+
+	writer->stop();
+	if (stats != NULL) {
+		*stats = writer->getStats();
+	}
+	return true;
+}
+
+static void closeDiskWriters() {
+	std::map<int,std::shared_ptr<DiskWriter>> writers;
+	disk_writers_mutex.lock();
+	writers.swap(disk_writers);
+	disk_writers_mutex.unlock();
+
+	for (std::map<int,std::shared_ptr<DiskWriter>>::iterator it = writers.begin(); it != writers.end(); ++it) {
+		it->second->stop();
+	}
+}
+
+/**
+ * @brief Get the memory usage counters of the data buffers
+ */
+extern "C" void getMemoryStats(BufferAllocatorStats* stats) {
+	recordCall(CALL_GET_MEMORY_STATS, {});
+	*stats = bufferStats();
+}
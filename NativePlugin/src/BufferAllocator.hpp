@@ -0,0 +1,197 @@
+#pragma once
+// Page-aligned, recycled allocations for the readback data buffers
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+enum HugePageMode {
+	// Regular pages
+	HUGE_PAGES_NONE = 0,
+	// Transparent huge pages, asked with madvise(MADV_HUGEPAGE) on large buffers
+	HUGE_PAGES_MADVISE = 1,
+	// Explicit huge pages (MAP_HUGETLB), falling back to regular pages if none are reserved
+	HUGE_PAGES_HUGETLB = 2
+};
+
+/**
+ * Memory usage counters, also read by the managed plugin (keep it blittable)
+ */
+struct BufferAllocatorStats {
+	int64_t bytes_in_use;
+	int64_t bytes_cached;
+	int64_t peak_bytes_in_use;
+	int64_t allocations;
+	int64_t reuses;
+	int64_t mmap_calls;
+	int64_t munmap_calls;
+	int64_t huge_page_allocations;
+};
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static std::mutex buffer_allocator_mutex;
+// Free buffers by allocated size, still mapped and faulted in
+static std::multimap<size_t, void*> buffer_free_lists;
+// Allocated size of the buffers in use
+static std::map<void*, size_t> buffer_in_use;
+static BufferAllocatorStats buffer_stats = {};
+static HugePageMode buffer_huge_pages = HUGE_PAGES_NONE;
+static size_t buffer_max_cached_bytes = 256 * 1024 * 1024;
+
+/**
+ * @brief Size actually mapped for a buffer of the given size
+ */
+inline size_t bufferAllocatedSize(size_t size, HugePageMode huge_pages) {
+	size_t granularity = (size_t)sysconf(_SC_PAGESIZE);
+	if (huge_pages != HUGE_PAGES_NONE && size >= HUGE_PAGE_SIZE) {
+		granularity = HUGE_PAGE_SIZE;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+/**
+ * @brief Map a new buffer. Has to be called with buffer_allocator_mutex locked
+ * @param populate Pre-fault the pages
+ */
+inline void* bufferMap(size_t allocated_size, bool populate) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
+	void* ptr = MAP_FAILED;
+
+	if (buffer_huge_pages == HUGE_PAGES_HUGETLB && allocated_size % HUGE_PAGE_SIZE == 0) {
+		ptr = mmap(NULL, allocated_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED) {
+			buffer_stats.huge_page_allocations++;
+		}
+	}
+	if (ptr == MAP_FAILED) {
+		ptr = mmap(NULL, allocated_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (ptr == MAP_FAILED) {
+			return NULL;
+		}
+		if (buffer_huge_pages != HUGE_PAGES_NONE && allocated_size >= HUGE_PAGE_SIZE
+			&& madvise(ptr, allocated_size, MADV_HUGEPAGE) == 0) {
+			buffer_stats.huge_page_allocations++;
+		}
+	}
+	buffer_stats.mmap_calls++;
+	return ptr;
+}
+
+/**
+ * @brief Unmap cached buffers until the cache fits in buffer_max_cached_bytes.
+ * Has to be called with buffer_allocator_mutex locked
+ */
+inline void bufferTrimLocked() {
+	while ((size_t)buffer_stats.bytes_cached > buffer_max_cached_bytes && !buffer_free_lists.empty()) {
+		// Largest buffers first
+		std::multimap<size_t, void*>::iterator it = --buffer_free_lists.end();
+		munmap(it->second, it->first);
+		buffer_stats.bytes_cached -= it->first;
+		buffer_stats.munmap_calls++;
+		buffer_free_lists.erase(it);
+	}
+}
+
+/**
+ * @brief Get a page-aligned buffer (so also 64 bytes aligned for SIMD),
+ * recycled from a released buffer of the same size if possible.
+ * @return The buffer, NULL if out of memory
+ */
+inline void* bufferAllocate(size_t size) {
+	std::lock_guard<std::mutex> lock(buffer_allocator_mutex);
+	size_t allocated_size = bufferAllocatedSize(size, buffer_huge_pages);
+
+	void* ptr = NULL;
+	std::multimap<size_t, void*>::iterator it = buffer_free_lists.find(allocated_size);
+	if (it != buffer_free_lists.end()) {
+		ptr = it->second;
+		buffer_free_lists.erase(it);
+		buffer_stats.bytes_cached -= allocated_size;
+		buffer_stats.reuses++;
+	}
+	else {
+		ptr = bufferMap(allocated_size, false);
+		if (ptr == NULL) {
+			return NULL;
+		}
+	}
+
+	buffer_in_use[ptr] = allocated_size;
+	buffer_stats.allocations++;
+	buffer_stats.bytes_in_use += allocated_size;
+	if (buffer_stats.bytes_in_use > buffer_stats.peak_bytes_in_use) {
+		buffer_stats.peak_bytes_in_use = buffer_stats.bytes_in_use;
+	}
+	return ptr;
+}
+
+/**
+ * @brief Give back a buffer obtained with bufferAllocate
+ */
+inline void bufferRelease(void* ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(buffer_allocator_mutex);
+	std::map<void*, size_t>::iterator it = buffer_in_use.find(ptr);
+	if (it == buffer_in_use.end()) {
+		return;
+	}
+	size_t allocated_size = it->second;
+	buffer_in_use.erase(it);
+	buffer_stats.bytes_in_use -= allocated_size;
+	buffer_free_lists.insert(std::make_pair(allocated_size, ptr));
+	buffer_stats.bytes_cached += allocated_size;
+	bufferTrimLocked();
+}
+
+/**
+ * @brief Map and pre-fault buffers ahead of a capture stream so that
+ * its first frames don't page fault.
+ * @param size Size of the frames of the stream
+ * @param count Number of buffers to keep ready
+ * @return Number of buffers actually reserved
+ */
+inline int bufferReserve(size_t size, int count) {
+	std::lock_guard<std::mutex> lock(buffer_allocator_mutex);
+	size_t allocated_size = bufferAllocatedSize(size, buffer_huge_pages);
+
+	// Make room in the cache for them
+	if (buffer_max_cached_bytes < buffer_stats.bytes_cached + allocated_size * count) {
+		buffer_max_cached_bytes = buffer_stats.bytes_cached + allocated_size * count;
+	}
+
+	int reserved = 0;
+	for (; reserved < count; reserved++) {
+		void* ptr = bufferMap(allocated_size, true);
+		if (ptr == NULL) {
+			break;
+		}
+		buffer_free_lists.insert(std::make_pair(allocated_size, ptr));
+		buffer_stats.bytes_cached += allocated_size;
+	}
+	return reserved;
+}
+
+/**
+ * @brief Configure the allocator. Changing the huge page mode only affects
+ * buffers mapped afterwards, cached buffers are kept.
+ * @param max_cached_bytes Maximum size of the released buffers kept for reuse, 0 to release everything
+ */
+inline void bufferConfigure(HugePageMode huge_pages, size_t max_cached_bytes) {
+	std::lock_guard<std::mutex> lock(buffer_allocator_mutex);
+	buffer_huge_pages = huge_pages;
+	buffer_max_cached_bytes = max_cached_bytes;
+	bufferTrimLocked();
+}
+
+inline BufferAllocatorStats bufferStats() {
+	std::lock_guard<std::mutex> lock(buffer_allocator_mutex);
+	return buffer_stats;
+}
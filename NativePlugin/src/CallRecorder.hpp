@@ -0,0 +1,353 @@
+#pragma once
+// Binary log of the calls into the exported C API, replayed by bench/ReadbackReplay
+// to reproduce a production workload without Unity.
+//
+// File: "AGRL", version (uint32), then one record per call, in the order the calls returned:
+// varints of the call, thread index, nanoseconds since the previous record, number of values,
+// the zigzag-encoded values (arguments, arrays as their count then their items, then the result
+// if any), the number of strings and each string as its length then its bytes.
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Recorded calls. Values are part of the file format: only append
+ */
+enum RecordedCall {
+	// Not a call: size and format of a texture level, as seen by the plugin
+	CALL_TEXTURE = 0,
+	CALL_IS_COMPATIBLE,
+	CALL_MAKE_REQUEST,
+	CALL_MAKE_REQUEST_WITH_SIZE,
+	CALL_SET_REQUEST_REGION,
+	CALL_SET_REQUEST_DESTINATION,
+	CALL_SET_REQUEST_PRIORITY,
+	CALL_SET_REQUEST_YUV,
+	CALL_SET_REQUEST_REDUCTION,
+	CALL_SET_REQUEST_POINTS,
+	CALL_SET_REQUEST_CHUNKS,
+	CALL_SET_REQUEST_DISK_WRITER,
+	CALL_SET_REQUEST_HASHING,
+	CALL_RESET_HASH_STREAM,
+	CALL_MAKE_REQUEST_RENDER_THREAD,
+	CALL_SUBMIT_REQUEST,
+	CALL_SUBMIT_REQUESTS,
+	CALL_SCHEDULE_FRAME,
+	CALL_UPDATE,
+	CALL_MAKE_REQUEST_BATCH,
+	CALL_MAKE_REQUEST_BATCH_RENDER_THREAD,
+	CALL_UPDATE_BATCHES,
+	CALL_DRAIN_COMPLETED_REQUESTS,
+	CALL_DISPOSE_REQUESTS,
+	CALL_GET_DATA,
+	CALL_GET_DATA_RANGE,
+	CALL_IS_REQUEST_DONE,
+	CALL_IS_REQUEST_ERROR,
+	CALL_GET_REQUEST_PROGRESS,
+	CALL_GET_REQUEST_HASH,
+	CALL_GET_REQUEST_STATUS,
+	CALL_DISPOSE,
+	CALL_SET_BULK_BUDGET,
+	CALL_SET_FRAME_BUDGET,
+	CALL_GET_SCHEDULER_STATS,
+	CALL_SET_COALESCING,
+	CALL_SET_LAZY_MAPPING,
+	CALL_SET_PINNED_MEMORY,
+	CALL_GET_PINNED_MEMORY_MODE,
+	CALL_SET_FENCE_WAIT_STRATEGY,
+	CALL_INVALIDATE_TEXTURE_INFO,
+	CALL_SET_ALLOCATOR_OPTIONS,
+	CALL_RESERVE_BUFFERS,
+	CALL_SET_PBO_POOL_SIZE,
+	CALL_CREATE_VIDEO_SINK,
+	CALL_CAPTURE_VIDEO_SINK,
+	CALL_CLOSE_VIDEO_SINK,
+	CALL_GET_VIDEO_SINK_STATS,
+	CALL_CREATE_MAILBOX,
+	CALL_CAPTURE_MAILBOX,
+	CALL_ACQUIRE_MAILBOX_FRAME,
+	CALL_RELEASE_MAILBOX_FRAME,
+	CALL_CLOSE_MAILBOX,
+	CALL_CREATE_DISK_WRITER,
+	CALL_GET_DISK_WRITER_STATS,
+	CALL_CLOSE_DISK_WRITER,
+	CALL_GET_MEMORY_STATS,
+	CALL_CREATE_COMPLETION_QUEUE,
+	CALL_CLOSE_COMPLETION_QUEUE,
+	CALL_MAKE_QUEUED_REQUEST_BATCH,
+	CALL_DRAIN_COMPLETION_QUEUE,
+	RECORDED_CALL_COUNT
+};
+
+static const char* recorded_call_names[RECORDED_CALL_COUNT] = {
+	"texture", "isCompatible", "makeRequest_mainThread", "makeRequestWithSize_mainThread",
+	"setRequestRegion", "setRequestDestination", "setRequestPriority", "setRequestYuv",
+	"setRequestReduction", "setRequestPoints", "setRequestChunks", "setRequestDiskWriter",
+	"setRequestHashing", "resetHashStream", "makeRequest_renderThread", "submitRequest",
+	"submitRequests", "scheduleFrame_renderThread", "update_renderThread", "makeRequestBatch_mainThread",
+	"makeRequestBatch_renderThread", "updateBatches_renderThread", "drainCompletedRequests", "disposeRequests",
+	"getData_mainThread", "getDataRange_mainThread", "isRequestDone", "isRequestError",
+	"getRequestProgress", "getRequestHash", "getRequestStatus", "dispose",
+	"setBulkBudget", "setFrameBudget", "getSchedulerStats", "setCoalescing",
+	"setLazyMapping", "setPinnedMemory", "getPinnedMemoryMode", "setFenceWaitStrategy",
+	"invalidateTextureInfo", "setAllocatorOptions", "reserveBuffers", "setPboPoolSize",
+	"createVideoSink", "captureVideoSink_renderThread", "closeVideoSink", "getVideoSinkStats",
+	"createMailbox", "captureMailbox_renderThread", "acquireMailboxFrame", "releaseMailboxFrame",
+	"closeMailbox", "createDiskWriter", "getDiskWriterStats", "closeDiskWriter",
+	"getMemoryStats", "createCompletionQueue", "closeCompletionQueue", "makeQueuedRequestBatch_mainThread",
+	"drainCompletionQueue"
+};
+
+static const char CALL_LOG_MAGIC[4] = { 'A', 'G', 'R', 'L' };
+static const uint32_t CALL_LOG_VERSION = 1;
+// Encoded records are written to the file by blocks of this size
+static const size_t CALL_LOG_BLOCK_SIZE = 1 << 16;
+
+static std::atomic<bool> recording_enabled(false);
+static std::mutex recording_mutex;
+static FILE* recording_file = NULL;
+static std::vector<uint8_t> recording_buffer;
+static std::chrono::steady_clock::time_point recording_last;
+static std::atomic<int> recording_next_thread(1);
+static thread_local int recording_thread = 0;
+
+inline bool isRecording() {
+	return recording_enabled.load(std::memory_order_relaxed);
+}
+
+inline void callLogPutVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+inline uint64_t callLogZigzag(int64_t value) {
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/**
+ * One call to record: values and strings are added, then it is written at once
+ */
+class CallRecord {
+public:
+	explicit CallRecord(RecordedCall call) : call(call) {}
+
+	CallRecord& add(int64_t value) {
+		values.push_back(value);
+		return *this;
+	}
+
+	/**
+	 * @brief Add an array as its count then its items, a NULL array as empty
+	 */
+	template <typename T>
+	CallRecord& addArray(const T* items, int count) {
+		if (items == NULL || count < 0) {
+			count = 0;
+		}
+		values.push_back(count);
+		for (int i = 0; i < count; i++) {
+			values.push_back((int64_t)items[i]);
+		}
+		return *this;
+	}
+
+	CallRecord& addString(const char* value) {
+		strings.push_back(value != NULL ? value : "");
+		return *this;
+	}
+
+	/**
+	 * @brief Append the record to the log, if it is still recording
+	 */
+	void write() {
+		if (recording_thread == 0) {
+			recording_thread = recording_next_thread++;
+		}
+		std::lock_guard<std::mutex> lock(recording_mutex);
+		if (recording_file == NULL) {
+			return;
+		}
+		// Timestamps taken under the lock, so that they follow the records
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		uint64_t delta = std::chrono::duration_cast<std::chrono::nanoseconds>(now - recording_last).count();
+		recording_last = now;
+
+		callLogPutVarint(recording_buffer, call);
+		callLogPutVarint(recording_buffer, recording_thread);
+		callLogPutVarint(recording_buffer, delta);
+		callLogPutVarint(recording_buffer, values.size());
+		for (size_t i = 0; i < values.size(); i++) {
+			callLogPutVarint(recording_buffer, callLogZigzag(values[i]));
+		}
+		callLogPutVarint(recording_buffer, strings.size());
+		for (size_t i = 0; i < strings.size(); i++) {
+			callLogPutVarint(recording_buffer, strings[i].size());
+			recording_buffer.insert(recording_buffer.end(), strings[i].begin(), strings[i].end());
+		}
+
+		if (recording_buffer.size() >= CALL_LOG_BLOCK_SIZE) {
+			if (std::fwrite(recording_buffer.data(), 1, recording_buffer.size(), recording_file) != recording_buffer.size()) {
+				// Disk full: stop there, the log stays readable up to the last block
+				std::fclose(recording_file);
+				recording_file = NULL;
+				recording_enabled = false;
+			}
+			recording_buffer.clear();
+		}
+	}
+
+private:
+	RecordedCall call;
+	std::vector<int64_t> values;
+	std::vector<std::string> strings;
+};
+
+/**
+ * @brief Record a call with only scalar values, if recording
+ */
+inline void recordCall(RecordedCall call, std::initializer_list<int64_t> values) {
+	if (!isRecording()) {
+		return;
+	}
+	CallRecord record(call);
+	for (std::initializer_list<int64_t>::const_iterator it = values.begin(); it != values.end(); ++it) {
+		record.add(*it);
+	}
+	record.write();
+}
+
+/**
+ * @brief Start recording the calls to a new log, replacing the current one
+ * @return false if the file can't be created
+ */
+inline bool callLogStart(const char* path) {
+	std::lock_guard<std::mutex> lock(recording_mutex);
+	if (recording_file != NULL) {
+		std::fwrite(recording_buffer.data(), 1, recording_buffer.size(), recording_file);
+		std::fclose(recording_file);
+	}
+	recording_buffer.clear();
+	recording_file = (path != NULL) ? std::fopen(path, "wb") : NULL;
+	if (recording_file == NULL) {
+		recording_enabled = false;
+		return false;
+	}
+	std::fwrite(CALL_LOG_MAGIC, 1, sizeof(CALL_LOG_MAGIC), recording_file);
+	std::fwrite(&CALL_LOG_VERSION, sizeof(CALL_LOG_VERSION), 1, recording_file);
+	recording_last = std::chrono::steady_clock::now();
+	recording_enabled = true;
+	return true;
+}
+
+/**
+ * @brief Write the buffered records and close the log
+ */
+inline void callLogStop() {
+	std::lock_guard<std::mutex> lock(recording_mutex);
+	recording_enabled = false;
+	if (recording_file == NULL) {
+		return;
+	}
+	std::fwrite(recording_buffer.data(), 1, recording_buffer.size(), recording_file);
+	std::fclose(recording_file);
+	recording_file = NULL;
+	recording_buffer.clear();
+}
+
+/**
+ * A call read back from a log
+ */
+struct LoggedCall {
+	uint32_t call;
+	uint32_t thread;
+	// Since the start of the recording
+	uint64_t timestamp_ns;
+	std::vector<int64_t> values;
+	std::vector<std::string> strings;
+};
+
+inline bool callLogGetVarint(const std::vector<uint8_t>& in, size_t& offset, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (offset >= in.size()) {
+			return false;
+		}
+		uint8_t byte = in[offset++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Read a whole log. A truncated last record (recording not stopped) is ignored
+ * @return false if the file can't be read or is not a log
+ */
+inline bool callLogRead(const char* path, std::vector<LoggedCall>& calls) {
+	FILE* in = std::fopen(path, "rb");
+	if (in == NULL) {
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t block[CALL_LOG_BLOCK_SIZE];
+	size_t read;
+	while ((read = std::fread(block, 1, sizeof(block), in)) > 0) {
+		data.insert(data.end(), block, block + read);
+	}
+	std::fclose(in);
+
+	uint32_t version = 0;
+	if (data.size() < 8 || std::memcmp(data.data(), CALL_LOG_MAGIC, 4) != 0) {
+		return false;
+	}
+	std::memcpy(&version, data.data() + 4, sizeof(version));
+	if (version != CALL_LOG_VERSION) {
+		return false;
+	}
+
+	size_t offset = 8;
+	uint64_t timestamp = 0;
+	while (offset < data.size()) {
+		LoggedCall call;
+		uint64_t kind, thread, delta, count;
+		if (!callLogGetVarint(data, offset, kind) || !callLogGetVarint(data, offset, thread)
+			|| !callLogGetVarint(data, offset, delta) || !callLogGetVarint(data, offset, count)) {
+			break;
+		}
+		bool complete = true;
+		for (uint64_t i = 0; i < count && complete; i++) {
+			uint64_t value;
+			complete = callLogGetVarint(data, offset, value);
+			call.values.push_back((int64_t)(value >> 1) ^ -(int64_t)(value & 1));
+		}
+		complete = complete && callLogGetVarint(data, offset, count);
+		for (uint64_t i = 0; i < count && complete; i++) {
+			uint64_t length;
+			complete = callLogGetVarint(data, offset, length) && length <= data.size() - offset;
+			if (complete) {
+				call.strings.push_back(std::string((const char*)data.data() + offset, length));
+				offset += length;
+			}
+		}
+		if (!complete) {
+			break;
+		}
+		timestamp += delta;
+		call.call = (uint32_t)kind;
+		call.thread = (uint32_t)thread;
+		call.timestamp_ns = timestamp;
+		calls.push_back(call);
+	}
+	return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+// RGBA to YUV 4:2:0 conversions (BT.601, limited range), SSE2 when available
+#include <cstddef>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+inline uint8_t rgbToY(int r, int g, int b) {
+	return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t rgbToU(int r, int g, int b) {
+	return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+inline uint8_t rgbToV(int r, int g, int b) {
+	return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/**
+ * @brief Convert pixels [x, width) of a pair of rows, 2 by 2
+ */
+inline void rgbaToNv12RowsScalar(const uint8_t* row0, const uint8_t* row1, int x, int width,
+	uint8_t* y0, uint8_t* y1, uint8_t* uv) {
+	for (; x < width; x += 2) {
+		const uint8_t* p[4] = { row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4, row1 + x * 4 + 4 };
+		y0[x] = rgbToY(p[0][0], p[0][1], p[0][2]);
+		y0[x + 1] = rgbToY(p[1][0], p[1][1], p[1][2]);
+		y1[x] = rgbToY(p[2][0], p[2][1], p[2][2]);
+		y1[x + 1] = rgbToY(p[3][0], p[3][1], p[3][2]);
+
+		int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+		int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+		int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+		uv[x] = rgbToU(r, g, b);
+		uv[x + 1] = rgbToV(r, g, b);
+	}
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Split 8 RGBA pixels in 16 bits R, G and B lanes
+ */
+inline void rgbaUnpack8(const uint8_t* src, __m128i& r, __m128i& g, __m128i& b) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	__m128i p0 = _mm_loadu_si128((const __m128i*)src);
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(src + 16));
+	r = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+/**
+ * @brief Luma of 8 pixels, as 16 bits lanes. The sums fit in unsigned 16 bits.
+ */
+inline __m128i rgbToY8(__m128i r, __m128i g, __m128i b) {
+	__m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+	y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+	return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+/**
+ * @brief Average the 2x2 blocks of 8 pixels of two rows, as 4 lanes of 16 bits (upper lanes zero)
+ */
+inline __m128i average2x2(__m128i row0, __m128i row1) {
+	__m128i sum = _mm_add_epi16(row0, row1);
+	// Add horizontal neighbours into 32 bits lanes
+	__m128i pairs = _mm_add_epi32(_mm_and_si128(sum, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(sum, 16));
+	pairs = _mm_srli_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+	return _mm_packs_epi32(pairs, _mm_setzero_si128());
+}
+
+/**
+ * @brief Chroma of averaged pixels, as 16 bits lanes. The sums fit in signed 16 bits.
+ */
+inline __m128i rgbToChroma(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb) {
+	__m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+	c = _mm_srai_epi16(_mm_add_epi16(c, _mm_set1_epi16(128)), 8);
+	return _mm_add_epi16(c, _mm_set1_epi16(128));
+}
+#endif
+
+/**
+ * @brief Convert an RGBA8 image to NV12 (Y plane, then interleaved UV plane at half resolution).
+ * @param rgba Source pixels
+ * @param rgba_stride Bytes between two source rows
+ * @param width Width, even
+ * @param height Height, even
+ * @param flip Read the source rows bottom-up (OpenGL images) to write a top-down image
+ * @param y Destination Y plane
+ * @param y_stride Bytes between two Y rows
+ * @param uv Destination UV plane
+ * @param uv_stride Bytes between two UV rows
+ */
+inline void rgbaToNv12(const uint8_t* rgba, size_t rgba_stride, int width, int height, bool flip,
+	uint8_t* y, size_t y_stride, uint8_t* uv, size_t uv_stride) {
+	for (int row = 0; row < height; row += 2) {
+		int src0 = flip ? height - 1 - row : row;
+		int src1 = flip ? height - 2 - row : row + 1;
+		const uint8_t* row0 = rgba + src0 * rgba_stride;
+		const uint8_t* row1 = rgba + src1 * rgba_stride;
+		uint8_t* y0 = y + row * y_stride;
+		uint8_t* y1 = y0 + y_stride;
+		uint8_t* uv_row = uv + (row / 2) * uv_stride;
+
+		int x = 0;
+#if defined(__SSE2__)
+		for (; x + 16 <= width; x += 16) {
+			__m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+			rgbaUnpack8(row0 + x * 4, r0a, g0a, b0a);
+			rgbaUnpack8(row0 + x * 4 + 32, r0b, g0b, b0b);
+			rgbaUnpack8(row1 + x * 4, r1a, g1a, b1a);
+			rgbaUnpack8(row1 + x * 4 + 32, r1b, g1b, b1b);
+
+			_mm_storeu_si128((__m128i*)(y0 + x), _mm_packus_epi16(rgbToY8(r0a, g0a, b0a), rgbToY8(r0b, g0b, b0b)));
+			_mm_storeu_si128((__m128i*)(y1 + x), _mm_packus_epi16(rgbToY8(r1a, g1a, b1a), rgbToY8(r1b, g1b, b1b)));
+
+			// 8 averaged pixels: 4 from each half
+			__m128i r = _mm_unpacklo_epi64(average2x2(r0a, r1a), average2x2(r0b, r1b));
+			__m128i g = _mm_unpacklo_epi64(average2x2(g0a, g1a), average2x2(g0b, g1b));
+			__m128i b = _mm_unpacklo_epi64(average2x2(b0a, b1a), average2x2(b0b, b1b));
+			__m128i u = _mm_packus_epi16(rgbToChroma(r, g, b, -38, -74, 112), _mm_setzero_si128());
+			__m128i v = _mm_packus_epi16(rgbToChroma(r, g, b, 112, -94, -18), _mm_setzero_si128());
+			_mm_storeu_si128((__m128i*)(uv_row + x), _mm_unpacklo_epi8(u, v));
+		}
+#endif
+		rgbaToNv12RowsScalar(row0, row1, x, width, y0, y1, uv_row);
+	}
+}
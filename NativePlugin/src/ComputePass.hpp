@@ -0,0 +1,115 @@
+#pragma once
+// Helpers of the compute shader passes run on Unity's context before a read
+#include "TypeHelpers.hpp"
+
+/**
+ * @brief Check if compute shaders are supported (OpenGL 4.3)
+ */
+inline bool hasComputeShaders() {
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major > 4 || (major == 4 && minor >= 3);
+}
+
+/**
+ * @brief Compile and link a compute shader
+ * @return The program, 0 on error
+ */
+inline GLuint buildComputeProgram(const char* source) {
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled) {
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+/**
+ * Saves the GL state a pass may change, restored when it goes out of scope:
+ * the program, texture unit 0 (2D texture and sampler), image unit 0
+ * and the shader storage buffer bindings 0 and 1.
+ */
+class ComputeStateGuard {
+public:
+	ComputeStateGuard() {
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+		glActiveTexture(GL_TEXTURE0);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+		glGetIntegerv(GL_SAMPLER_BINDING, &sampler);
+		glGetIntegeri_v(GL_IMAGE_BINDING_NAME, 0, &image_name);
+		glGetIntegeri_v(GL_IMAGE_BINDING_LEVEL, 0, &image_level);
+		glGetBooleani_v(GL_IMAGE_BINDING_LAYERED, 0, &image_layered);
+		glGetIntegeri_v(GL_IMAGE_BINDING_LAYER, 0, &image_layer);
+		glGetIntegeri_v(GL_IMAGE_BINDING_ACCESS, 0, &image_access);
+		glGetIntegeri_v(GL_IMAGE_BINDING_FORMAT, 0, &image_format);
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_BINDING, &storage_buffer);
+		for (GLuint i = 0; i < 2; i++) {
+			glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, i, &storage_buffers[i]);
+			glGetInteger64i_v(GL_SHADER_STORAGE_BUFFER_START, i, &storage_starts[i]);
+			glGetInteger64i_v(GL_SHADER_STORAGE_BUFFER_SIZE, i, &storage_sizes[i]);
+		}
+	}
+
+	~ComputeStateGuard() {
+		for (GLuint i = 0; i < 2; i++) {
+			if (storage_buffers[i] != 0 && storage_sizes[i] > 0) {
+				glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i, storage_buffers[i], storage_starts[i], storage_sizes[i]);
+			}
+			else {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, storage_buffers[i]);
+			}
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, storage_buffer);
+		glBindImageTexture(0, image_name, image_level, image_layered, image_layer, image_access, image_format);
+		glBindSampler(0, sampler);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glActiveTexture(active_texture);
+		glUseProgram(program);
+	}
+
+private:
+	GLint program = 0;
+	GLint active_texture = GL_TEXTURE0;
+	GLint texture = 0;
+	GLint sampler = 0;
+	GLint image_name = 0;
+	GLint image_level = 0;
+	GLboolean image_layered = GL_FALSE;
+	GLint image_layer = 0;
+	GLint image_access = GL_READ_ONLY;
+	GLint image_format = GL_R8;
+	GLint storage_buffer = 0;
+	GLint storage_buffers[2] = { 0, 0 };
+	GLint64 storage_starts[2] = { 0, 0 };
+	GLint64 storage_sizes[2] = { 0, 0 };
+};
+
+/**
+ * @brief Create the samplers of the passes: nearest filtering, so that the fetched
+ * level is complete whatever the texture filtering. The second one is mipmapped, for levels above 0
+ */
+inline void createNearestSamplers(GLuint samplers[2]) {
+	glGenSamplers(2, samplers);
+	glSamplerParameteri(samplers[0], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(samplers[1], GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	for (int i = 0; i < 2; i++) {
+		glSamplerParameteri(samplers[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+}
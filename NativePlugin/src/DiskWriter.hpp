@@ -0,0 +1,542 @@
+#pragma once
+// Optional sink writing completed readbacks to files, on its own threads:
+// io_uring with batched submissions, or a pool of threads calling pwrite
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "BufferAllocator.hpp"
+
+enum DiskWriterBackend {
+	// io_uring, one thread submitting the writes by batches. Falls back to DISK_WRITER_THREADS
+	// when the kernel doesn't allow it (before Linux 5.1, seccomp filters of containers...)
+	DISK_WRITER_IO_URING = 0,
+	// Pool of threads, each one writing a file at a time with pwrite
+	DISK_WRITER_THREADS = 1
+};
+
+/**
+ * Disk writer counters, also read by the managed plugin (keep it blittable)
+ */
+struct DiskWriterStats {
+	int64_t files_received;
+	int64_t files_written;
+	// Files dropped because too many were waiting to be written
+	int64_t files_dropped;
+	int64_t errors;
+	int64_t bytes_written;
+	// Backend in use, a DiskWriterBackend value
+	int32_t backend;
+	// The files are written with O_DIRECT, not through the page cache
+	int32_t direct_io;
+};
+
+// Alignment of the O_DIRECT writes: buffers (page-aligned allocations) and sizes
+static const size_t DISK_WRITE_ALIGNMENT = 4096;
+// Size of a single io_uring write, the rest of a larger file is written with pwrite
+static const size_t DISK_WRITE_MAX_SUBMIT = 1 << 30;
+static const unsigned IO_URING_ENTRIES = 32;
+
+/**
+ * @brief Check that a file path format has exactly one integer conversion for the
+ * index of the file (e.g. "/data/frame_%06d.raw"), and no other conversion than "%%"
+ */
+inline bool isValidDiskPathFormat(const char* format) {
+	int conversions = 0;
+	for (const char* c = format; *c != '\0'; c++) {
+		if (*c != '%') {
+			continue;
+		}
+		c++;
+		if (*c == '%') {
+			continue;
+		}
+		// Flags and width only
+		while (*c == '0' || *c == '-' || *c == '+' || *c == ' ' || *c == '#') {
+			c++;
+		}
+		while (*c >= '0' && *c <= '9') {
+			c++;
+		}
+		if (*c != 'd' && *c != 'i' && *c != 'u' && *c != 'x' && *c != 'X') {
+			return false;
+		}
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+/**
+ * Minimal io_uring through the raw system calls, not to depend on liburing.
+ * Only used by one thread.
+ */
+class IoUring {
+public:
+	~IoUring() {
+		destroy();
+	}
+
+	/**
+	 * @brief Create the rings
+	 * @return false if io_uring is not available
+	 */
+	bool init(unsigned entries) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (fd < 0) {
+			return false;
+		}
+
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap) {
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		}
+		sq_ring = mapRing(sq_ring_size, IORING_OFF_SQ_RING);
+		cq_ring = single_mmap ? sq_ring : mapRing(cq_ring_size, IORING_OFF_CQ_RING);
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = (io_uring_sqe*)mapRing(sqes_size, IORING_OFF_SQES);
+		if (sq_ring == NULL || cq_ring == NULL || sqes == NULL) {
+			destroy();
+			return false;
+		}
+
+		char* sq = (char*)sq_ring;
+		sq_head = (unsigned*)(sq + params.sq_off.head);
+		sq_tail = (unsigned*)(sq + params.sq_off.tail);
+		sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+		sq_array = (unsigned*)(sq + params.sq_off.array);
+		sq_entries = params.sq_entries;
+		char* cq = (char*)cq_ring;
+		cq_head = (unsigned*)(cq + params.cq_off.head);
+		cq_tail = (unsigned*)(cq + params.cq_off.tail);
+		cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Number of operations the submission queue holds
+	 */
+	unsigned capacity() const {
+		return sq_entries;
+	}
+
+	/**
+	 * @brief Queue a write, sent to the kernel by the next submit
+	 * @return false if the submission queue is full
+	 */
+	bool queueWrite(int file, const void* data, unsigned length, uint64_t offset, uint64_t user_data) {
+		unsigned tail = *sq_tail;
+		if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+			return false;
+		}
+		unsigned index = tail & sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = file;
+		sqe->addr = (uint64_t)(uintptr_t)data;
+		sqe->len = length;
+		sqe->off = offset;
+		sqe->user_data = user_data;
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		unsubmitted++;
+		return true;
+	}
+
+	/**
+	 * @brief Submit the queued operations in one system call, and wait for some completions
+	 * @param wait_count Completions to wait for, 0 not to wait
+	 * @return false if the ring can't be used anymore
+	 */
+	bool submit(unsigned wait_count) {
+#if defined(__NR_io_uring_enter)
+		while (true) {
+			int submitted = (int)syscall(__NR_io_uring_enter, fd, unsubmitted, wait_count,
+				wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+			if (submitted >= 0) {
+				unsubmitted -= (unsigned)submitted;
+				return true;
+			}
+			if (errno == EAGAIN || errno == EBUSY) {
+				std::this_thread::yield();
+			}
+			else if (errno != EINTR) {
+				return false;
+			}
+		}
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Take back the queued operations the kernel has not consumed, once submit failed.
+	 * Without SQPOLL the kernel only reads the submission queue in io_uring_enter
+	 * @return User data of the operations, not sent to the kernel anymore
+	 */
+	std::vector<uint64_t> cancelUnsubmitted() {
+		std::vector<uint64_t> cancelled;
+		unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+		unsigned tail = *sq_tail;
+		for (unsigned i = head; i != tail; i++) {
+			cancelled.push_back(sqes[sq_array[i & sq_mask]].user_data);
+		}
+		__atomic_store_n(sq_tail, head, __ATOMIC_RELEASE);
+		unsubmitted = 0;
+		return cancelled;
+	}
+
+	/**
+	 * @brief Take the next completion
+	 * @param result Result of the operation: bytes written, or -errno
+	 * @return false if there is none
+	 */
+	bool nextCompletion(uint64_t& user_data, int& result) {
+		unsigned head = *cq_head;
+		if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			return false;
+		}
+		const io_uring_cqe* cqe = &cqes[head & cq_mask];
+		user_data = cqe->user_data;
+		result = cqe->res;
+		__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+private:
+	void* mapRing(size_t size, off_t offset) {
+		void* ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+		return (ring == MAP_FAILED) ? NULL : ring;
+	}
+
+	void destroy() {
+		if (sqes != NULL) {
+			munmap(sqes, sqes_size);
+		}
+		if (cq_ring != NULL && cq_ring != sq_ring) {
+			munmap(cq_ring, cq_ring_size);
+		}
+		if (sq_ring != NULL) {
+			munmap(sq_ring, sq_ring_size);
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+		sqes = NULL;
+		cq_ring = NULL;
+		sq_ring = NULL;
+		fd = -1;
+	}
+
+	int fd = -1;
+	void* sq_ring = NULL;
+	void* cq_ring = NULL;
+	io_uring_sqe* sqes = NULL;
+	size_t sq_ring_size = 0;
+	size_t cq_ring_size = 0;
+	size_t sqes_size = 0;
+	unsigned* sq_head = NULL;
+	unsigned* sq_tail = NULL;
+	unsigned* sq_array = NULL;
+	unsigned sq_mask = 0;
+	unsigned sq_entries = 0;
+	unsigned* cq_head = NULL;
+	unsigned* cq_tail = NULL;
+	unsigned cq_mask = 0;
+	io_uring_cqe* cqes = NULL;
+	unsigned unsubmitted = 0;
+};
+
+/**
+ * Writes the data pushed by the readback to one file each, named from a path format and
+ * an index. The data is copied to an aligned buffer of the plugin allocator, so that the
+ * files can be written with O_DIRECT: the writes are then rounded up to DISK_WRITE_ALIGNMENT
+ * and the files truncated back to the size of the data.
+ */
+class DiskWriter {
+public:
+	DiskWriter(const std::string& path_format, int first_index, DiskWriterBackend backend, bool direct_io, int threads, int max_queued)
+		: path_format(path_format), next_index(first_index), direct_io(direct_io), max_queued(max_queued) {
+		stats.direct_io = direct_io;
+		if (backend == DISK_WRITER_IO_URING && ring.init(IO_URING_ENTRIES)) {
+			stats.backend = DISK_WRITER_IO_URING;
+			workers.push_back(std::thread(&DiskWriter::ioUringMain, this));
+		}
+		else {
+			stats.backend = DISK_WRITER_THREADS;
+			for (int i = 0; i < std::max(threads, 1); i++) {
+				workers.push_back(std::thread(&DiskWriter::threadMain, this));
+			}
+		}
+	}
+
+	~DiskWriter() {
+		stop();
+	}
+
+	/**
+	 * @brief Take the index of the next file
+	 */
+	int takeIndex() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return next_index++;
+	}
+
+	/**
+	 * @brief Copy data and queue the write of its file. Called from the thread completing the readback
+	 * @return false if the file is dropped
+	 */
+	bool pushFile(const void* data, size_t size, int index) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.files_received++;
+			if (!running || pending >= max_queued) {
+				stats.files_dropped++;
+				return false;
+			}
+			pending++;
+		}
+
+		File file;
+		file.index = index;
+		file.size = size;
+		file.write_size = (size + DISK_WRITE_ALIGNMENT - 1) / DISK_WRITE_ALIGNMENT * DISK_WRITE_ALIGNMENT;
+		file.data = (uint8_t*)bufferAllocate(file.write_size);
+		file.fd = -1;
+		if (file.data == NULL) {
+			std::lock_guard<std::mutex> lock(mutex);
+			pending--;
+			stats.errors++;
+			return false;
+		}
+		std::memcpy(file.data, data, size);
+		std::memset(file.data + size, 0, file.write_size - size);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(file);
+		condition.notify_one();
+		return true;
+	}
+
+	/**
+	 * @brief Write the queued files, then stop the threads
+	 */
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+			condition.notify_all();
+		}
+		for (size_t i = 0; i < workers.size(); i++) {
+			if (workers[i].joinable()) {
+				workers[i].join();
+			}
+		}
+	}
+
+	DiskWriterStats getStats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	struct File {
+		uint8_t* data;
+		size_t size;
+		// Size of the write, rounded up for O_DIRECT
+		size_t write_size;
+		int index;
+		int fd;
+	};
+
+	/**
+	 * @brief Create the file of a write, with O_DIRECT if asked and supported by the file system
+	 */
+	void openFile(File& file) {
+		char path[4096];
+		int length = std::snprintf(path, sizeof(path), path_format.c_str(), file.index);
+		if (length < 0 || length >= (int)sizeof(path)) {
+			file.fd = -1;
+			return;
+		}
+
+		int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+		if (direct_io) {
+			file.fd = open(path, flags | O_DIRECT, 0644);
+			if (file.fd >= 0 || errno != EINVAL) {
+				return;
+			}
+			// Not supported by the file system (tmpfs...): through the page cache from now on
+			direct_io = false;
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.direct_io = 0;
+		}
+		file.fd = open(path, flags, 0644);
+		file.write_size = file.size;
+	}
+
+	/**
+	 * @brief Write what is left of a file, remove the O_DIRECT padding and close it
+	 * @param written Bytes already written from the start of the data
+	 */
+	void finishFile(File& file, size_t written) {
+		bool ok = (file.fd >= 0);
+		while (ok && written < file.write_size) {
+			ssize_t result = pwrite(file.fd, file.data + written, file.write_size - written, (off_t)written);
+			if (result < 0 && errno == EINTR) {
+				continue;
+			}
+			ok = (result > 0);
+			written += ok ? (size_t)result : 0;
+		}
+		if (ok && file.write_size != file.size) {
+			ok = (ftruncate(file.fd, (off_t)file.size) == 0);
+		}
+		if (file.fd >= 0 && close(file.fd) != 0) {
+			ok = false;
+		}
+		bufferRelease(file.data);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		pending--;
+		if (ok) {
+			stats.files_written++;
+			stats.bytes_written += file.size;
+		}
+		else {
+			stats.errors++;
+		}
+	}
+
+	void threadMain() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [this] { return !queue.empty() || !running; });
+			if (queue.empty()) {
+				break;
+			}
+			File file = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			openFile(file);
+			finishFile(file, 0);
+
+			lock.lock();
+		}
+	}
+
+	/**
+	 * Takes every queued file the ring can hold, submits their writes with one system call,
+	 * then waits for a completion while other files are queued
+	 */
+	void ioUringMain() {
+		// Files being written, by user data of their write
+		std::vector<File> slots(ring.capacity());
+		std::vector<uint64_t> free_slots;
+		for (size_t i = 0; i < slots.size(); i++) {
+			free_slots.push_back(i);
+		}
+		std::vector<File> batch;
+		bool ring_failed = false;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			if (free_slots.size() == slots.size()) {
+				condition.wait(lock, [this] { return !queue.empty() || !running; });
+				if (queue.empty()) {
+					break;
+				}
+			}
+			batch.clear();
+			while (!queue.empty() && batch.size() < free_slots.size()) {
+				batch.push_back(queue.front());
+				queue.pop_front();
+			}
+			lock.unlock();
+
+			for (size_t i = 0; i < batch.size(); i++) {
+				File& file = batch[i];
+				openFile(file);
+				if (file.fd < 0 || ring_failed) {
+					finishFile(file, 0);
+					continue;
+				}
+				uint64_t slot = free_slots.back();
+				free_slots.pop_back();
+				slots[slot] = file;
+				ring.queueWrite(file.fd, file.data, (unsigned)std::min(file.write_size, DISK_WRITE_MAX_SUBMIT), 0, slot);
+			}
+
+			if (free_slots.size() < slots.size() && !ring.submit(1)) {
+				// Should not happen with a valid ring. The writes the kernel didn't take are
+				// written with pwrite, like the next files
+				ring_failed = true;
+				std::vector<uint64_t> cancelled = ring.cancelUnsubmitted();
+				for (size_t i = 0; i < cancelled.size(); i++) {
+					finishFile(slots[cancelled[i]], 0);
+					free_slots.push_back(cancelled[i]);
+				}
+				// The kernel may still read the buffers of the others: their completions are
+				// posted without io_uring_enter, wait for them before releasing the buffers
+				uint64_t slot;
+				int result;
+				while (free_slots.size() < slots.size()) {
+					if (!ring.nextCompletion(slot, result)) {
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+						continue;
+					}
+					finishFile(slots[slot], result > 0 ? (size_t)result : 0);
+					free_slots.push_back(slot);
+				}
+			}
+
+			// Short or failed writes (e.g. no IORING_OP_WRITE before Linux 5.6) are finished with pwrite
+			uint64_t slot;
+			int result;
+			while (ring.nextCompletion(slot, result)) {
+				finishFile(slots[slot], result > 0 ? (size_t)result : 0);
+				free_slots.push_back(slot);
+			}
+
+			lock.lock();
+		}
+	}
+
+	std::string path_format;
+	int next_index;
+	std::atomic<bool> direct_io;
+	int max_queued;
+	IoUring ring;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<File> queue;
+	// Files pushed and not written yet
+	int pending = 0;
+	bool running = true;
+	DiskWriterStats stats = {};
+};
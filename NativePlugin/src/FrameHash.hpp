@@ -0,0 +1,176 @@
+#pragma once
+// 64-bit hash of the readback data, computed while it is copied out of the pixel buffer.
+// Built like XXH3 for long inputs: 64 bytes stripes accumulated in 8 lanes with 32x32 bits
+// multiplies, scrambled every 512 bytes. SSE2 when available, with the same values as the
+// scalar path. Not a cryptographic hash, and not XXH3 values.
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const size_t HASH_STRIPE_SIZE = 64;
+static const size_t HASH_STRIPES_PER_BLOCK = 8;
+static const uint64_t HASH_PRIME32_1 = 0x9E3779B1ULL;
+static const uint64_t HASH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t HASH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+
+// Random key mixed with the data: stripe keys at 8 bytes steps, then the scramble key at 64
+alignas(16) static const uint8_t hash_secret[128] = {
+	0xdf, 0x92, 0xb3, 0x5b, 0x9f, 0xa4, 0xf1, 0x7d, 0x90, 0xa2, 0xd5, 0x6f, 0x6a, 0x41, 0x4f, 0xee,
+	0x1b, 0x87, 0xdc, 0x70, 0xd9, 0x6f, 0x5a, 0x0d, 0x9a, 0x99, 0x1b, 0x42, 0xbc, 0x9d, 0x02, 0xe0,
+	0x54, 0xa1, 0xfe, 0x19, 0x97, 0xe2, 0x36, 0xdb, 0x62, 0x8d, 0x6d, 0x4a, 0x94, 0xe7, 0x5e, 0x4a,
+	0x87, 0x74, 0x7b, 0xfd, 0xb2, 0x10, 0x89, 0xed, 0x2e, 0x7f, 0x1a, 0x73, 0xa2, 0xac, 0x97, 0x62,
+	0x49, 0x9c, 0xc1, 0xc2, 0xcd, 0x82, 0x36, 0x1e, 0x8d, 0xa9, 0x3e, 0xf0, 0xb4, 0xab, 0xd7, 0x76,
+	0x0c, 0x64, 0xc6, 0x0e, 0xc1, 0x19, 0xfe, 0x8f, 0xb8, 0xbb, 0x9c, 0x76, 0xc4, 0x9d, 0x74, 0xcc,
+	0xec, 0x5f, 0x8c, 0x09, 0xd8, 0xa2, 0xfa, 0x15, 0xf0, 0xa6, 0x0b, 0x78, 0x12, 0x2b, 0xf9, 0x8c,
+	0x3e, 0x68, 0x05, 0x36, 0x01, 0x78, 0xd2, 0xe4, 0x6e, 0x51, 0x27, 0x6c, 0x15, 0xf0, 0x5b, 0x03,
+};
+// Key of the zero-padded last stripe
+static const size_t HASH_TAIL_KEY = 17;
+static const size_t HASH_SCRAMBLE_KEY = 64;
+
+inline uint64_t hashRead64(const uint8_t* p) {
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint64_t hashRotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+#if defined(__SSE2__)
+// 2 accumulators per lane
+typedef __m128i HashLane;
+static const int HASH_LANES = 4;
+
+inline void hashLoadLanes(HashLane* lanes, const uint64_t* acc) {
+	for (int i = 0; i < HASH_LANES; i++) {
+		lanes[i] = _mm_load_si128((const __m128i*)acc + i);
+	}
+}
+
+inline void hashStoreLanes(const HashLane* lanes, uint64_t* acc) {
+	for (int i = 0; i < HASH_LANES; i++) {
+		_mm_store_si128((__m128i*)acc + i, lanes[i]);
+	}
+}
+
+/**
+ * @brief Accumulate a stripe, copying it to out if not NULL
+ */
+inline void hashStripe(HashLane* lanes, const uint8_t* in, uint8_t* out, const uint8_t* key) {
+	for (int i = 0; i < HASH_LANES; i++) {
+		__m128i data = _mm_loadu_si128((const __m128i*)(in + 16 * i));
+		if (out != NULL) {
+			_mm_storeu_si128((__m128i*)(out + 16 * i), data);
+		}
+		__m128i data_key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + 16 * i)));
+		// Low 32 bits times high 32 bits of each 64 bits value
+		__m128i product = _mm_mul_epu32(data_key, _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+		// The data goes to the other accumulator of the lane
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		lanes[i] = _mm_add_epi64(lanes[i], _mm_add_epi64(product, swapped));
+	}
+}
+
+inline void hashScramble(HashLane* lanes, const uint8_t* key) {
+	const __m128i prime = _mm_set1_epi32((int)HASH_PRIME32_1);
+	for (int i = 0; i < HASH_LANES; i++) {
+		__m128i acc = _mm_xor_si128(lanes[i], _mm_srli_epi64(lanes[i], 47));
+		acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i*)(key + 16 * i)));
+		// 64 bits times 32 bits multiply, from two 32x32 bits ones
+		__m128i low = _mm_mul_epu32(acc, prime);
+		__m128i high = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+		lanes[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+	}
+}
+#else
+typedef uint64_t HashLane;
+static const int HASH_LANES = 8;
+
+inline void hashLoadLanes(HashLane* lanes, const uint64_t* acc) {
+	std::memcpy(lanes, acc, 8 * sizeof(uint64_t));
+}
+
+inline void hashStoreLanes(const HashLane* lanes, uint64_t* acc) {
+	std::memcpy(acc, lanes, 8 * sizeof(uint64_t));
+}
+
+inline void hashStripe(HashLane* lanes, const uint8_t* in, uint8_t* out, const uint8_t* key) {
+	if (out != NULL) {
+		std::memcpy(out, in, HASH_STRIPE_SIZE);
+	}
+	for (int i = 0; i < HASH_LANES; i++) {
+		uint64_t data = hashRead64(in + 8 * i);
+		uint64_t data_key = data ^ hashRead64(key + 8 * i);
+		lanes[i ^ 1] += data;
+		lanes[i] += (data_key & 0xFFFFFFFFULL) * (data_key >> 32);
+	}
+}
+
+inline void hashScramble(HashLane* lanes, const uint8_t* key) {
+	for (int i = 0; i < HASH_LANES; i++) {
+		uint64_t acc = lanes[i] ^ (lanes[i] >> 47);
+		lanes[i] = (acc ^ hashRead64(key + 8 * i)) * HASH_PRIME32_1;
+	}
+}
+#endif
+
+/**
+ * @brief Hash data, copying it to dst at the same time: the source (e.g. a mapped pixel buffer)
+ * is only read once
+ * @param dst Destination of the copy, NULL to only hash
+ * @return 64-bit hash of the data and its size
+ */
+inline uint64_t copyAndHash(void* dst, const void* src, size_t size) {
+	const uint8_t* in = (const uint8_t*)src;
+	uint8_t* out = (uint8_t*)dst;
+	alignas(16) uint64_t acc[8] = {
+		HASH_PRIME32_1, HASH_PRIME64_1, HASH_PRIME64_2, HASH_PRIME64_4,
+		~HASH_PRIME32_1, ~HASH_PRIME64_1, ~HASH_PRIME64_2, ~HASH_PRIME64_4
+	};
+	HashLane lanes[HASH_LANES];
+	hashLoadLanes(lanes, acc);
+
+	size_t stripes = size / HASH_STRIPE_SIZE;
+	for (size_t n = 0; n < stripes; n++) {
+		size_t stripe = n % HASH_STRIPES_PER_BLOCK;
+		hashStripe(lanes, in + n * HASH_STRIPE_SIZE, (out != NULL) ? out + n * HASH_STRIPE_SIZE : NULL, hash_secret + stripe * 8);
+		if (stripe == HASH_STRIPES_PER_BLOCK - 1) {
+			hashScramble(lanes, hash_secret + HASH_SCRAMBLE_KEY);
+		}
+	}
+
+	size_t tail = size - stripes * HASH_STRIPE_SIZE;
+	if (tail > 0) {
+		alignas(16) uint8_t last[HASH_STRIPE_SIZE] = { 0 };
+		std::memcpy(last, in + stripes * HASH_STRIPE_SIZE, tail);
+		if (out != NULL) {
+			std::memcpy(out + stripes * HASH_STRIPE_SIZE, last, tail);
+		}
+		hashStripe(lanes, last, NULL, hash_secret + HASH_TAIL_KEY);
+	}
+	hashStoreLanes(lanes, acc);
+
+	// Merge the accumulators and the size, then avalanche
+	uint64_t hash = (uint64_t)size * HASH_PRIME64_1;
+	for (int i = 0; i < 8; i++) {
+		uint64_t value = hashRotl((acc[i] ^ hashRead64(hash_secret + 8 * i + 11)) * HASH_PRIME64_2, 31) * HASH_PRIME64_1;
+		hash = hashRotl(hash ^ value, 27) * HASH_PRIME64_1 + HASH_PRIME64_4;
+	}
+	hash ^= hash >> 37;
+	hash *= 0x165667919E3779F9ULL;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+/**
+ * @brief Hash data without copying it, see copyAndHash
+ */
+inline uint64_t hashData(const void* data, size_t size) {
+	return copyAndHash(NULL, data, size);
+}
@@ -0,0 +1,168 @@
+#pragma once
+// Pixel buffers backed by host memory, so that the GPU writes the data of a read
+// where it is used, without map and copy
+#include <cstring>
+#include <map>
+#include "TypeHelpers.hpp"
+#include "BufferAllocator.hpp"
+
+#ifndef GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD
+#define GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD 0x9160
+#endif
+
+enum PinnedMemoryMode {
+	// Not supported: regular pixel buffers, mapped and copied
+	PINNED_MEMORY_NONE = 0,
+	// Buffer storage in client memory (GL_CLIENT_STORAGE_BIT), persistently mapped
+	PINNED_MEMORY_CLIENT_STORAGE = 1,
+	// Plugin-owned, page-aligned memory pinned by the driver (GL_AMD_pinned_memory)
+	PINNED_MEMORY_AMD = 2
+};
+
+/**
+ * Pixel buffer and the host memory backing it
+ */
+struct PinnedBuffer {
+	GLuint pbo;
+	void* data;
+	size_t size;
+	// data comes from bufferAllocate, not from the driver
+	bool plugin_memory;
+};
+
+static const size_t PINNED_POOL_MAX = 8;
+// Free pinned buffers by size, only accessed from the render thread
+static std::multimap<size_t,PinnedBuffer> pinned_pool;
+
+/**
+ * @brief Find how pixel buffers can be backed by host memory.
+ * Has to be called from the render thread
+ */
+inline PinnedMemoryMode probePinnedMemory() {
+	bool buffer_storage = false;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension == NULL) {
+			continue;
+		}
+		if (std::strcmp(extension, "GL_AMD_pinned_memory") == 0) {
+			return PINNED_MEMORY_AMD;
+		}
+		if (std::strcmp(extension, "GL_ARB_buffer_storage") == 0) {
+			buffer_storage = true;
+		}
+	}
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (buffer_storage || major > 4 || (major == 4 && minor >= 4)) {
+		return PINNED_MEMORY_CLIENT_STORAGE;
+	}
+	return PINNED_MEMORY_NONE;
+}
+
+/**
+ * @brief Delete a pinned buffer and its memory. Has to be called from the render thread
+ */
+inline void destroyPinnedBuffer(const PinnedBuffer& buffer) {
+	// Unpins or unmaps the memory
+	glDeleteBuffers(1, &buffer.pbo);
+	if (buffer.plugin_memory) {
+		bufferRelease(buffer.data);
+	}
+}
+
+/**
+ * @brief Get a pinned buffer of the given size from the pool, or create one.
+ * Has to be called from the render thread
+ * @return false if the buffer could not be created, regular pixel buffers have to be used
+ */
+inline bool acquirePinnedBuffer(PinnedMemoryMode mode, size_t size, bool dsa, PinnedBuffer& buffer) {
+	std::multimap<size_t,PinnedBuffer>::iterator it = pinned_pool.find(size);
+	if (it != pinned_pool.end()) {
+		buffer = it->second;
+		pinned_pool.erase(it);
+		return true;
+	}
+
+	buffer.pbo = 0;
+	buffer.data = NULL;
+	buffer.size = size;
+	buffer.plugin_memory = (mode == PINNED_MEMORY_AMD);
+	GLint previous = 0;
+	GLint64 created_size = 0;
+	if (mode == PINNED_MEMORY_AMD) {
+		// The allocations are page-aligned, as the extension requires
+		buffer.data = bufferAllocate(size);
+		if (buffer.data == NULL) {
+			return false;
+		}
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previous);
+		glGenBuffers(1, &buffer.pbo);
+		glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, buffer.pbo);
+		glBufferData(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, size, buffer.data, GL_STREAM_READ);
+		glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+		glGetBufferParameteri64v(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &created_size);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, previous);
+	}
+	else if (mode == PINNED_MEMORY_CLIENT_STORAGE) {
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		if (dsa) {
+			glCreateBuffers(1, &buffer.pbo);
+			glNamedBufferStorage(buffer.pbo, size, NULL, flags | GL_CLIENT_STORAGE_BIT);
+			glGetNamedBufferParameteri64v(buffer.pbo, GL_BUFFER_SIZE, &created_size);
+			if (created_size == (GLint64)size) {
+				buffer.data = glMapNamedBufferRange(buffer.pbo, 0, size, flags);
+			}
+		}
+		else {
+			glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previous);
+			glGenBuffers(1, &buffer.pbo);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+			glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, flags | GL_CLIENT_STORAGE_BIT);
+			glGetBufferParameteri64v(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &created_size);
+			if (created_size == (GLint64)size) {
+				buffer.data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, previous);
+		}
+	}
+
+	// Checked without glGetError, whose errors belong to Unity
+	if (created_size != (GLint64)size || buffer.data == NULL) {
+		if (buffer.pbo != 0) {
+			glDeleteBuffers(1, &buffer.pbo);
+		}
+		if (buffer.plugin_memory) {
+			bufferRelease(buffer.data);
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Give back a pinned buffer whose data is not used anymore to the pool,
+ * delete it if the pool is full. Has to be called from the render thread
+ */
+inline void releasePinnedBuffer(const PinnedBuffer& buffer) {
+	if (pinned_pool.size() < PINNED_POOL_MAX) {
+		pinned_pool.insert(std::make_pair(buffer.size, buffer));
+		return;
+	}
+	destroyPinnedBuffer(buffer);
+}
+
+/**
+ * @brief Delete every pooled pinned buffer. Has to be called from the render thread
+ */
+inline void clearPinnedBuffers() {
+	for (std::multimap<size_t,PinnedBuffer>::iterator it = pinned_pool.begin(); it != pinned_pool.end(); ++it) {
+		destroyPinnedBuffer(it->second);
+	}
+	pinned_pool.clear();
+}
@@ -0,0 +1,165 @@
+#pragma once
+// Gather of sparse texels (picking, probes) with a compute shader,
+// so that only the requested pixels are read back
+#include <string>
+#include <vector>
+#include "ComputePass.hpp"
+
+// Size of the value of a gathered texel: 4 floats, ints or uints
+static const int GATHER_VALUE_SIZE = 16;
+
+/**
+ * One invocation per point. The sampler and value types depend on the texture:
+ * float (normalized and float textures), int or uint (integer textures).
+ * Points outside the texture level give zeros.
+ */
+static const char* gather_compute_source =
+	"layout(local_size_x = 64) in;\n"
+	"uniform SAMPLER source;\n"
+	"uniform ivec2 size;\n"
+	"uniform int miplevel;\n"
+	"uniform int srgb;\n"
+	"uniform int count;\n"
+	"layout(std430, binding = 0) readonly buffer Points { ivec2 points[]; };\n"
+	"layout(std430, binding = 1) writeonly buffer Values { VALUE values[]; };\n"
+	"void main() {\n"
+	"	uint i = gl_GlobalInvocationID.x;\n"
+	"	if (i >= uint(count)) {\n"
+	"		return;\n"
+	"	}\n"
+	"	ivec2 p = points[i];\n"
+	"	VALUE value = VALUE(0);\n"
+	"	if (all(greaterThanEqual(p, ivec2(0))) && all(lessThan(p, size))) {\n"
+	"		value = texelFetch(source, p, miplevel);\n"
+	"#ifdef FLOAT_VALUES\n"
+	"		// Same values as a read of the texture: sRGB encoded\n"
+	"		if (srgb != 0) {\n"
+	"			value.rgb = mix(value.rgb * 12.92, 1.055 * pow(value.rgb, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), value.rgb));\n"
+	"		}\n"
+	"#endif\n"
+	"	}\n"
+	"	values[i] = value;\n"
+	"}\n";
+
+enum GatherValueType {
+	GATHER_FLOAT = 0,
+	GATHER_INT = 1,
+	GATHER_UINT = 2
+};
+
+static const char* gather_defines[3] = {
+	"#version 430\n#define SAMPLER sampler2D\n#define VALUE vec4\n#define FLOAT_VALUES\n",
+	"#version 430\n#define SAMPLER isampler2D\n#define VALUE ivec4\n",
+	"#version 430\n#define SAMPLER usampler2D\n#define VALUE uvec4\n"
+};
+
+static GLuint gather_programs[3] = { 0, 0, 0 };
+static bool gather_programs_failed = false;
+static GLuint gather_samplers[2] = { 0, 0 };
+// Coordinates of the points, rewritten by each request
+static GLuint gather_points = 0;
+static int gather_points_size = 0;
+
+/**
+ * @brief Type of the gathered values of a texture
+ * @param format Format of a read of the texture (see getFormatFromInternalFormat)
+ * @param type Type of a read of the texture (see getTypeFromInternalFormat)
+ */
+inline GatherValueType getGatherValueType(GLenum format, GLenum type) {
+	if (format != GL_RED_INTEGER && format != GL_RG_INTEGER && format != GL_RGB_INTEGER && format != GL_RGBA_INTEGER) {
+		return GATHER_FLOAT;
+	}
+	return (type == GL_INT || type == GL_SHORT || type == GL_BYTE) ? GATHER_INT : GATHER_UINT;
+}
+
+/**
+ * @brief Build the gather programs once. Has to be called from the render thread
+ * @return false if compute shaders are not supported
+ */
+inline bool gatherProgramsReady() {
+	if (gather_programs[0] != 0 || gather_programs_failed) {
+		return gather_programs[0] != 0;
+	}
+	gather_programs_failed = true;
+	if (!hasComputeShaders()) {
+		return false;
+	}
+	GLuint programs[3];
+	for (int i = 0; i < 3; i++) {
+		std::string source = std::string(gather_defines[i]) + gather_compute_source;
+		programs[i] = buildComputeProgram(source.c_str());
+		if (programs[i] == 0) {
+			for (int j = 0; j < i; j++) {
+				glDeleteProgram(programs[j]);
+			}
+			return false;
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		gather_programs[i] = programs[i];
+	}
+	createNearestSamplers(gather_samplers);
+	gather_programs_failed = false;
+	return true;
+}
+
+/**
+ * @brief Gather texels of a texture level into a buffer. Unity's GL state
+ * touched by the pass is restored (see ComputeStateGuard).
+ * Has to be called from the render thread, after gatherProgramsReady
+ * @param points x, y coordinates of each point in the level, origin at the bottom left
+ * @param srgb The texture is sRGB: gather its encoded values, not the linear ones
+ * @param result Buffer receiving GATHER_VALUE_SIZE bytes per point
+ */
+inline void runGather(GLuint texture, int miplevel, int width, int height, const std::vector<int>& points, bool srgb,
+	GatherValueType value_type, GLuint result) {
+	ComputeStateGuard state;
+	int count = (int)points.size() / 2;
+	int points_size = (int)(points.size() * sizeof(int));
+
+	if (gather_points == 0) {
+		glGenBuffers(1, &gather_points);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gather_points);
+	if (points_size > gather_points_size) {
+		glBufferData(GL_SHADER_STORAGE_BUFFER, points_size, points.data(), GL_STREAM_DRAW);
+		gather_points_size = points_size;
+	}
+	else {
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, points_size, points.data());
+	}
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, gather_points, 0, points_size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, result, 0, count * GATHER_VALUE_SIZE);
+
+	GLuint program = gather_programs[value_type];
+	glUseProgram(program);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindSampler(0, gather_samplers[miplevel > 0 ? 1 : 0]);
+	glUniform1i(glGetUniformLocation(program, "source"), 0);
+	glUniform2i(glGetUniformLocation(program, "size"), width, height);
+	glUniform1i(glGetUniformLocation(program, "miplevel"), miplevel);
+	glUniform1i(glGetUniformLocation(program, "srgb"), srgb);
+	glUniform1i(glGetUniformLocation(program, "count"), count);
+	glDispatchCompute((count + 63) / 64, 1, 1);
+	// The result is mapped once the fence signals
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+/**
+ * @brief Delete the programs and the buffer. Has to be called from the render thread
+ */
+inline void clearGatherResources() {
+	if (gather_programs[0] != 0) {
+		for (int i = 0; i < 3; i++) {
+			glDeleteProgram(gather_programs[i]);
+			gather_programs[i] = 0;
+		}
+		glDeleteSamplers(2, gather_samplers);
+	}
+	if (gather_points != 0) {
+		glDeleteBuffers(1, &gather_points);
+		gather_points = 0;
+	}
+	gather_points_size = 0;
+	gather_programs_failed = false;
+}
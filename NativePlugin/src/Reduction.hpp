@@ -0,0 +1,307 @@
+#pragma once
+// GPU reductions of a texture (statistics, histograms) with compute shaders,
+// so that only the small result is read back instead of the pixels
+#include <cstdint>
+#include "ComputePass.hpp"
+
+enum ReductionType {
+	REDUCTION_NONE = 0,
+	// Minimum, maximum and mean of each channel: a ReductionStats
+	REDUCTION_STATS = 1,
+	// Histograms of R, G, B and luminance (Rec. 709) of values in [0, 1]:
+	// 4 x bins uint32 counts, values out of range counted in the first or last bin
+	REDUCTION_HISTOGRAM = 2
+};
+
+static const int REDUCTION_MAX_BINS = 256;
+
+/**
+ * Result of a REDUCTION_STATS request, also read by the managed plugin (keep it blittable)
+ */
+struct ReductionStats {
+	float minimum[4];
+	float maximum[4];
+	float mean[4];
+	uint32_t pixel_count;
+	uint32_t padding[3];
+};
+
+// Values as a read of the texture gives them: sRGB encoded
+#define REDUCTION_SHADER_HEADER \
+	"#version 430\n" \
+	"uniform sampler2D source;\n" \
+	"uniform ivec2 origin;\n" \
+	"uniform ivec2 size;\n" \
+	"uniform int miplevel;\n" \
+	"uniform int srgb;\n" \
+	"vec4 fetch(ivec2 p) {\n" \
+	"	vec4 c = texelFetch(source, origin + p, miplevel);\n" \
+	"	if (srgb != 0) {\n" \
+	"		c.rgb = mix(c.rgb * 12.92, 1.055 * pow(c.rgb, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), c.rgb));\n" \
+	"	}\n" \
+	"	return c;\n" \
+	"}\n" \
+	"struct Partial { vec4 minimum; vec4 maximum; vec4 sum; };\n"
+
+/**
+ * Statistics, first pass: one partial result per 64x64 tile, each invocation reducing 4x4 pixels
+ */
+static const char* reduction_partials_source =
+	REDUCTION_SHADER_HEADER
+	"layout(local_size_x = 16, local_size_y = 16) in;\n"
+	"layout(std430, binding = 0) writeonly buffer Partials { Partial partials[]; };\n"
+	"shared vec4 minimums[256];\n"
+	"shared vec4 maximums[256];\n"
+	"shared vec4 sums[256];\n"
+	"void main() {\n"
+	"	uint i = gl_LocalInvocationIndex;\n"
+	"	vec4 minimum = vec4(3.4e38);\n"
+	"	vec4 maximum = vec4(-3.4e38);\n"
+	"	vec4 sum = vec4(0.0);\n"
+	"	ivec2 base = ivec2(gl_GlobalInvocationID.xy) * 4;\n"
+	"	for (int y = 0; y < 4; y++) {\n"
+	"		for (int x = 0; x < 4; x++) {\n"
+	"			ivec2 p = base + ivec2(x, y);\n"
+	"			if (p.x < size.x && p.y < size.y) {\n"
+	"				vec4 c = fetch(p);\n"
+	"				minimum = min(minimum, c);\n"
+	"				maximum = max(maximum, c);\n"
+	"				sum += c;\n"
+	"			}\n"
+	"		}\n"
+	"	}\n"
+	"	minimums[i] = minimum;\n"
+	"	maximums[i] = maximum;\n"
+	"	sums[i] = sum;\n"
+	"	barrier();\n"
+	"	for (uint stride = 128u; stride > 0u; stride >>= 1) {\n"
+	"		if (i < stride) {\n"
+	"			minimums[i] = min(minimums[i], minimums[i + stride]);\n"
+	"			maximums[i] = max(maximums[i], maximums[i + stride]);\n"
+	"			sums[i] += sums[i + stride];\n"
+	"		}\n"
+	"		barrier();\n"
+	"	}\n"
+	"	if (i == 0u) {\n"
+	"		partials[gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x] = Partial(minimums[0], maximums[0], sums[0]);\n"
+	"	}\n"
+	"}\n";
+
+/**
+ * Statistics, second pass: one work group reducing the partial results into a ReductionStats
+ */
+static const char* reduction_stats_source =
+	"#version 430\n"
+	"layout(local_size_x = 256) in;\n"
+	"struct Partial { vec4 minimum; vec4 maximum; vec4 sum; };\n"
+	"layout(std430, binding = 0) readonly buffer Partials { Partial partials[]; };\n"
+	"layout(std430, binding = 1) writeonly buffer Result { vec4 minimum; vec4 maximum; vec4 mean; uint pixel_count; };\n"
+	"uniform int partial_count;\n"
+	"uniform int count;\n"
+	"shared vec4 minimums[256];\n"
+	"shared vec4 maximums[256];\n"
+	"shared vec4 sums[256];\n"
+	"void main() {\n"
+	"	uint i = gl_LocalInvocationIndex;\n"
+	"	vec4 low = vec4(3.4e38);\n"
+	"	vec4 high = vec4(-3.4e38);\n"
+	"	vec4 sum = vec4(0.0);\n"
+	"	for (uint k = i; k < uint(partial_count); k += 256u) {\n"
+	"		low = min(low, partials[k].minimum);\n"
+	"		high = max(high, partials[k].maximum);\n"
+	"		sum += partials[k].sum;\n"
+	"	}\n"
+	"	minimums[i] = low;\n"
+	"	maximums[i] = high;\n"
+	"	sums[i] = sum;\n"
+	"	barrier();\n"
+	"	for (uint stride = 128u; stride > 0u; stride >>= 1) {\n"
+	"		if (i < stride) {\n"
+	"			minimums[i] = min(minimums[i], minimums[i + stride]);\n"
+	"			maximums[i] = max(maximums[i], maximums[i + stride]);\n"
+	"			sums[i] += sums[i + stride];\n"
+	"		}\n"
+	"		barrier();\n"
+	"	}\n"
+	"	if (i == 0u) {\n"
+	"		minimum = minimums[0];\n"
+	"		maximum = maximums[0];\n"
+	"		mean = sums[0] / float(count);\n"
+	"		pixel_count = uint(count);\n"
+	"	}\n"
+	"}\n";
+
+/**
+ * Histograms: each work group counts its 64x64 tile in shared memory, then adds it to the result
+ */
+static const char* reduction_histogram_source =
+	REDUCTION_SHADER_HEADER
+	"layout(local_size_x = 16, local_size_y = 16) in;\n"
+	"layout(std430, binding = 1) buffer Result { uint counts[]; };\n"
+	"uniform int bins;\n"
+	"shared uint tile_counts[4 * 256];\n"
+	"void main() {\n"
+	"	uint i = gl_LocalInvocationIndex;\n"
+	"	for (uint k = i; k < uint(4 * bins); k += 256u) {\n"
+	"		tile_counts[k] = 0u;\n"
+	"	}\n"
+	"	barrier();\n"
+	"	ivec2 base = ivec2(gl_GlobalInvocationID.xy) * 4;\n"
+	"	for (int y = 0; y < 4; y++) {\n"
+	"		for (int x = 0; x < 4; x++) {\n"
+	"			ivec2 p = base + ivec2(x, y);\n"
+	"			if (p.x < size.x && p.y < size.y) {\n"
+	"				vec4 c = fetch(p);\n"
+	"				c.a = dot(c.rgb, vec3(0.2126, 0.7152, 0.0722));\n"
+	"				ivec4 bin = clamp(ivec4(floor(c * float(bins))), ivec4(0), ivec4(bins - 1));\n"
+	"				atomicAdd(tile_counts[bin.r], 1u);\n"
+	"				atomicAdd(tile_counts[bins + bin.g], 1u);\n"
+	"				atomicAdd(tile_counts[2 * bins + bin.b], 1u);\n"
+	"				atomicAdd(tile_counts[3 * bins + bin.a], 1u);\n"
+	"			}\n"
+	"		}\n"
+	"	}\n"
+	"	barrier();\n"
+	"	for (uint k = i; k < uint(4 * bins); k += 256u) {\n"
+	"		if (tile_counts[k] != 0u) {\n"
+	"			atomicAdd(counts[k], tile_counts[k]);\n"
+	"		}\n"
+	"	}\n"
+	"}\n";
+
+static const int REDUCTION_TILE_SIZE = 64;
+static const int REDUCTION_PARTIAL_SIZE = 48;
+
+static GLuint reduction_programs[3] = { 0, 0, 0 };
+static bool reduction_programs_failed = false;
+static GLuint reduction_samplers[2] = { 0, 0 };
+// Partial results of the statistics. The passes of a request run one after
+// the other, so the next request can reuse the same buffer.
+static GLuint reduction_partials = 0;
+static int reduction_partials_size = 0;
+
+/**
+ * @brief Size of the result of a reduction
+ * @return 0 if the reduction or the number of bins is invalid
+ */
+inline int getReductionResultSize(ReductionType type, int bins) {
+	if (type == REDUCTION_STATS) {
+		return sizeof(ReductionStats);
+	}
+	if (type == REDUCTION_HISTOGRAM && bins > 0 && bins <= REDUCTION_MAX_BINS) {
+		return 4 * bins * sizeof(uint32_t);
+	}
+	return 0;
+}
+
+/**
+ * @brief Build the reduction programs once. Has to be called from the render thread
+ * @return false if compute shaders are not supported
+ */
+inline bool reductionProgramsReady() {
+	if (reduction_programs[0] != 0 || reduction_programs_failed) {
+		return reduction_programs[0] != 0;
+	}
+	reduction_programs_failed = true;
+	if (!hasComputeShaders()) {
+		return false;
+	}
+	const char* sources[3] = { reduction_partials_source, reduction_stats_source, reduction_histogram_source };
+	GLuint programs[3];
+	for (int i = 0; i < 3; i++) {
+		programs[i] = buildComputeProgram(sources[i]);
+		if (programs[i] == 0) {
+			for (int j = 0; j < i; j++) {
+				glDeleteProgram(programs[j]);
+			}
+			return false;
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		reduction_programs[i] = programs[i];
+	}
+	createNearestSamplers(reduction_samplers);
+	reduction_programs_failed = false;
+	return true;
+}
+
+inline void setReductionSource(GLuint program, GLuint texture, int miplevel, int x, int y, int width, int height, bool srgb) {
+	glUseProgram(program);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindSampler(0, reduction_samplers[miplevel > 0 ? 1 : 0]);
+	glUniform1i(glGetUniformLocation(program, "source"), 0);
+	glUniform2i(glGetUniformLocation(program, "origin"), x, y);
+	glUniform2i(glGetUniformLocation(program, "size"), width, height);
+	glUniform1i(glGetUniformLocation(program, "miplevel"), miplevel);
+	glUniform1i(glGetUniformLocation(program, "srgb"), srgb);
+}
+
+/**
+ * @brief Reduce a region of a texture level into a buffer. Unity's GL state
+ * touched by the passes is restored (see ComputeStateGuard).
+ * Has to be called from the render thread, after reductionProgramsReady
+ * @param srgb The texture is sRGB: reduce its encoded values, not the linear ones
+ * @param result Buffer receiving the result, of getReductionResultSize bytes
+ */
+inline void runReduction(GLuint texture, int miplevel, int x, int y, int width, int height, bool srgb,
+	ReductionType type, int bins, GLuint result) {
+	ComputeStateGuard state;
+	glActiveTexture(GL_TEXTURE0);
+	int groups_x = (width + REDUCTION_TILE_SIZE - 1) / REDUCTION_TILE_SIZE;
+	int groups_y = (height + REDUCTION_TILE_SIZE - 1) / REDUCTION_TILE_SIZE;
+	int result_size = getReductionResultSize(type, bins);
+
+	if (type == REDUCTION_STATS) {
+		int partials_size = groups_x * groups_y * REDUCTION_PARTIAL_SIZE;
+		if (partials_size > reduction_partials_size) {
+			if (reduction_partials == 0) {
+				glGenBuffers(1, &reduction_partials);
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, reduction_partials);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, partials_size, NULL, GL_DYNAMIC_COPY);
+			reduction_partials_size = partials_size;
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, reduction_partials);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, result, 0, result_size);
+
+		setReductionSource(reduction_programs[0], texture, miplevel, x, y, width, height, srgb);
+		glDispatchCompute(groups_x, groups_y, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glUseProgram(reduction_programs[1]);
+		glUniform1i(glGetUniformLocation(reduction_programs[1], "partial_count"), groups_x * groups_y);
+		glUniform1i(glGetUniformLocation(reduction_programs[1], "count"), width * height);
+		glDispatchCompute(1, 1, 1);
+	}
+	else {
+		// Counts are accumulated in the result
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, result);
+		glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, result_size, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, result, 0, result_size);
+
+		setReductionSource(reduction_programs[2], texture, miplevel, x, y, width, height, srgb);
+		glUniform1i(glGetUniformLocation(reduction_programs[2], "bins"), bins);
+		glDispatchCompute(groups_x, groups_y, 1);
+	}
+	// The result is mapped once the fence signals, and the partials are rewritten by the next request
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/**
+ * @brief Delete the programs and the buffers. Has to be called from the render thread
+ */
+inline void clearReductionResources() {
+	if (reduction_programs[0] != 0) {
+		for (int i = 0; i < 3; i++) {
+			glDeleteProgram(reduction_programs[i]);
+			reduction_programs[i] = 0;
+		}
+		glDeleteSamplers(2, reduction_samplers);
+	}
+	if (reduction_partials != 0) {
+		glDeleteBuffers(1, &reduction_partials);
+		reduction_partials = 0;
+	}
+	reduction_partials_size = 0;
+	reduction_programs_failed = false;
+}
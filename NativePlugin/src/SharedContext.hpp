@@ -0,0 +1,207 @@
+#pragma once
+// Secondary OpenGL context sharing objects with Unity's one (GLX or EGL)
+#include "TypeHelpers.hpp"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glx.h>
+
+struct SharedContext {
+	bool egl = false;
+
+	// EGL
+	EGLDisplay egl_display = EGL_NO_DISPLAY;
+	EGLContext egl_context = EGL_NO_CONTEXT;
+	EGLSurface egl_surface = EGL_NO_SURFACE;
+
+	// GLX
+	Display* glx_display = NULL;
+	GLXContext glx_context = NULL;
+	GLXPbuffer glx_pbuffer = 0;
+};
+
+/**
+ * @brief Tell if an OpenGL context (EGL or GLX) is current on the calling thread
+ */
+inline bool hasCurrentContext() {
+	return eglGetCurrentContext() != EGL_NO_CONTEXT || glXGetCurrentContext() != NULL;
+}
+
+typedef GLXContext (*GLXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
+
+/**
+ * @brief Set by onGlxError: an X request of createSharedContext failed
+ */
+inline bool& glxErrorRaised() {
+	static bool raised = false;
+	return raised;
+}
+
+/**
+ * @brief X error handler installed while the GLX objects are created:
+ * the default one would exit the process on a BadMatch or BadValue
+ */
+inline int onGlxError(Display* display, XErrorEvent* event) {
+	glxErrorRaised() = true;
+	return 0;
+}
+
+/**
+ * @brief Create a context sharing objects with the current one.
+ * Has to be called from the render thread, while Unity's context is current.
+ * The context is not made current, use makeSharedContextCurrent from the thread
+ * that will use it.
+ *
+ * @param shared The context to fill
+ * @return true if the context was created
+ */
+inline bool createSharedContext(SharedContext& shared) {
+	// Mirror the version and profile of Unity's context
+	GLint major = 0, minor = 0, profile = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 3 || (major == 3 && minor >= 2)) {
+		glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+	}
+	bool core = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+
+	EGLContext egl_current = eglGetCurrentContext();
+	if (egl_current != EGL_NO_CONTEXT) {
+		shared.egl = true;
+		shared.egl_display = eglGetCurrentDisplay();
+
+		// Use the same config as the current context if it has one
+		EGLConfig config = EGL_NO_CONFIG_KHR;
+		EGLint config_id = 0;
+		eglQueryContext(shared.egl_display, egl_current, EGL_CONFIG_ID, &config_id);
+		if (config_id != 0) {
+			EGLint config_attribs[] = { EGL_CONFIG_ID, config_id, EGL_NONE };
+			EGLint num_configs = 0;
+			if (!eglChooseConfig(shared.egl_display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+				config = EGL_NO_CONFIG_KHR;
+			}
+		}
+
+		EGLint context_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, major,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, core ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+			EGL_NONE
+		};
+		eglBindAPI(EGL_OPENGL_API);
+		shared.egl_context = eglCreateContext(shared.egl_display, config, egl_current, context_attribs);
+		if (shared.egl_context == EGL_NO_CONTEXT) {
+			return false;
+		}
+
+		// A 1x1 pbuffer if the config allows it, surfaceless otherwise
+		if (config != EGL_NO_CONFIG_KHR) {
+			EGLint surface_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			shared.egl_surface = eglCreatePbufferSurface(shared.egl_display, config, surface_attribs);
+		}
+		return true;
+	}
+
+	GLXContext glx_current = glXGetCurrentContext();
+	if (glx_current != NULL) {
+		shared.egl = false;
+		shared.glx_display = glXGetCurrentDisplay();
+
+		GLXCreateContextAttribsARBProc glXCreateContextAttribsARB = (GLXCreateContextAttribsARBProc)
+			glXGetProcAddressARB((const GLubyte*)"glXCreateContextAttribsARB");
+		if (glXCreateContextAttribsARB == NULL) {
+			return false;
+		}
+
+		// Find back the config of the current context
+		int screen = 0, fbconfig_id = 0;
+		glXQueryContext(shared.glx_display, glx_current, GLX_SCREEN, &screen);
+		glXQueryContext(shared.glx_display, glx_current, GLX_FBCONFIG_ID, &fbconfig_id);
+		int config_attribs[] = { GLX_FBCONFIG_ID, fbconfig_id, None };
+		int num_configs = 0;
+		GLXFBConfig* configs = glXChooseFBConfig(shared.glx_display, screen, config_attribs, &num_configs);
+		if (configs == NULL || num_configs == 0) {
+			return false;
+		}
+
+		int context_attribs[] = {
+			GLX_CONTEXT_MAJOR_VERSION_ARB, major,
+			GLX_CONTEXT_MINOR_VERSION_ARB, minor,
+			GLX_CONTEXT_PROFILE_MASK_ARB, core ? GLX_CONTEXT_CORE_PROFILE_BIT_ARB : GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB,
+			None
+		};
+		// Errors (config, version or profile rejected) make the creation fail instead of the process
+		XSync(shared.glx_display, False);
+		glxErrorRaised() = false;
+		XErrorHandler previous_handler = XSetErrorHandler(onGlxError);
+		shared.glx_context = glXCreateContextAttribsARB(shared.glx_display, configs[0], glx_current, True, context_attribs);
+		XSync(shared.glx_display, False);
+		if (glxErrorRaised() && shared.glx_context != NULL) {
+			glXDestroyContext(shared.glx_display, shared.glx_context);
+			shared.glx_context = NULL;
+		}
+
+		// A 1x1 pbuffer if the config allows it, no drawable otherwise
+		int drawable_type = 0;
+		glXGetFBConfigAttrib(shared.glx_display, configs[0], GLX_DRAWABLE_TYPE, &drawable_type);
+		if (shared.glx_context != NULL && (drawable_type & GLX_PBUFFER_BIT) != 0) {
+			int pbuffer_attribs[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+			glxErrorRaised() = false;
+			shared.glx_pbuffer = glXCreatePbuffer(shared.glx_display, configs[0], pbuffer_attribs);
+			XSync(shared.glx_display, False);
+			if (glxErrorRaised()) {
+				shared.glx_pbuffer = 0;
+			}
+		}
+		XSetErrorHandler(previous_handler);
+		XFree(configs);
+		return shared.glx_context != NULL;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Make the shared context current on the calling thread
+ */
+inline bool makeSharedContextCurrent(SharedContext& shared) {
+	if (shared.egl) {
+		eglBindAPI(EGL_OPENGL_API);
+		return eglMakeCurrent(shared.egl_display, shared.egl_surface, shared.egl_surface, shared.egl_context);
+	}
+	return glXMakeContextCurrent(shared.glx_display, shared.glx_pbuffer, shared.glx_pbuffer, shared.glx_context);
+}
+
+/**
+ * @brief Detach the shared context from the calling thread
+ */
+inline void releaseSharedContext(SharedContext& shared) {
+	if (shared.egl) {
+		eglMakeCurrent(shared.egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	}
+	else {
+		glXMakeContextCurrent(shared.glx_display, None, None, NULL);
+	}
+}
+
+/**
+ * @brief Destroy the shared context. It must not be current on any thread.
+ */
+inline void destroySharedContext(SharedContext& shared) {
+	if (shared.egl) {
+		if (shared.egl_surface != EGL_NO_SURFACE) {
+			eglDestroySurface(shared.egl_display, shared.egl_surface);
+		}
+		if (shared.egl_context != EGL_NO_CONTEXT) {
+			eglDestroyContext(shared.egl_display, shared.egl_context);
+		}
+	}
+	else {
+		if (shared.glx_pbuffer != 0) {
+			glXDestroyPbuffer(shared.glx_display, shared.glx_pbuffer);
+		}
+		if (shared.glx_context != NULL) {
+			glXDestroyContext(shared.glx_display, shared.glx_context);
+		}
+	}
+	shared = SharedContext();
+}
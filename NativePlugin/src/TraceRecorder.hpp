@@ -0,0 +1,179 @@
+#pragma once
+// Low-overhead binary trace of the readback pipeline, exported as Chrome trace JSON
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+enum TraceEventType {
+	TRACE_REQUEST = 0,
+	TRACE_ISSUE,
+	TRACE_FENCE_CHECK,
+	TRACE_SIGNAL,
+	TRACE_MAP,
+	TRACE_COPY,
+	TRACE_DISPOSE,
+	TRACE_GL_ERROR,
+	TRACE_EXPIRE,
+	TRACE_COALESCE,
+	TRACE_EVENT_TYPE_COUNT
+};
+
+static const char* trace_event_names[TRACE_EVENT_TYPE_COUNT] = {
+	"request", "issue", "fence_check", "signal", "map", "copy", "dispose", "gl_error", "expire", "coalesce"
+};
+
+struct TraceEvent {
+	uint64_t timestamp_ns;
+	uint64_t duration_ns;
+	int64_t value;
+	int32_t event_id;
+	uint32_t type;
+};
+
+/**
+ * Ring buffer of the events of one thread.
+ * Only its thread writes it, traceDump reads it concurrently and drops
+ * the events that may have been overwritten while it was copying.
+ */
+struct TraceRing {
+	static const uint64_t CAPACITY = 1 << 14;
+	std::atomic<uint64_t> head{0};
+	TraceEvent events[CAPACITY];
+	int thread_index = 0;
+	const char* thread_name = NULL;
+};
+
+static std::atomic<bool> trace_enabled(false);
+static std::vector<TraceRing*> trace_rings;
+static std::mutex trace_rings_mutex;
+static thread_local TraceRing* trace_ring = NULL;
+static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+inline uint64_t traceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+/**
+ * @brief Get the ring of the calling thread, registering it the first time.
+ * Rings live until the plugin is unloaded.
+ */
+inline TraceRing* traceThreadRing() {
+	if (trace_ring == NULL) {
+		trace_ring = new TraceRing();
+		std::lock_guard<std::mutex> lock(trace_rings_mutex);
+		trace_ring->thread_index = (int)trace_rings.size() + 1;
+		trace_rings.push_back(trace_ring);
+	}
+	return trace_ring;
+}
+
+/**
+ * @brief Name the calling thread in the exported traces
+ */
+inline void traceThreadName(const char* name) {
+	if (trace_enabled.load(std::memory_order_relaxed)) {
+		traceThreadRing()->thread_name = name;
+	}
+}
+
+/**
+ * @brief Start timing a traced section
+ * @return Start timestamp to give to traceEnd, 0 if tracing is disabled
+ */
+inline uint64_t traceBegin() {
+	if (!trace_enabled.load(std::memory_order_relaxed)) {
+		return 0;
+	}
+	return traceNow();
+}
+
+inline void traceRecord(TraceEventType type, int event_id, uint64_t timestamp_ns, uint64_t duration_ns, int64_t value) {
+	TraceRing* ring = traceThreadRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	TraceEvent& event = ring->events[head % TraceRing::CAPACITY];
+	event.timestamp_ns = timestamp_ns;
+	event.duration_ns = duration_ns;
+	event.value = value;
+	event.event_id = event_id;
+	event.type = type;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Record a section started with traceBegin
+ * @param start Value returned by traceBegin, nothing is recorded if 0
+ */
+inline void traceEnd(TraceEventType type, int event_id, uint64_t start, int64_t value = 0) {
+	if (start == 0) {
+		return;
+	}
+	traceRecord(type, event_id, start, traceNow() - start, value);
+}
+
+/**
+ * @brief Record an instant event
+ */
+inline void traceInstant(TraceEventType type, int event_id, int64_t value = 0) {
+	if (!trace_enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+	traceRecord(type, event_id, traceNow(), 0, value);
+}
+
+/**
+ * @brief Write every buffered event as Chrome trace / Perfetto JSON
+ * @return Number of events written, -1 if the file can't be opened
+ */
+inline int traceDump(const char* path) {
+	FILE* out = std::fopen(path, "w");
+	if (out == NULL) {
+		return -1;
+	}
+
+	std::vector<TraceRing*> rings;
+	{
+		std::lock_guard<std::mutex> lock(trace_rings_mutex);
+		rings = trace_rings;
+	}
+
+	int count = 0;
+	std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (size_t r = 0; r < rings.size(); r++) {
+		TraceRing* ring = rings[r];
+		std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			(r == 0) ? "" : ",\n", ring->thread_index, ring->thread_name != NULL ? ring->thread_name : "AsyncGPUReadbackPlugin");
+
+		// Copy the available events, then drop the ones overwritten meanwhile
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t first = (head > TraceRing::CAPACITY) ? head - TraceRing::CAPACITY : 0;
+		std::vector<TraceEvent> events;
+		events.reserve(head - first);
+		for (uint64_t i = first; i < head; i++) {
+			events.push_back(ring->events[i % TraceRing::CAPACITY]);
+		}
+		uint64_t head_after = ring->head.load(std::memory_order_acquire);
+		// The event at head_after may be written meanwhile, over the one CAPACITY before it
+		uint64_t valid_from = (head_after + 1 > TraceRing::CAPACITY) ? head_after + 1 - TraceRing::CAPACITY : 0;
+
+		for (uint64_t i = std::max(first, valid_from); i < head; i++) {
+			const TraceEvent& event = events[i - first];
+			const char* name = (event.type < TRACE_EVENT_TYPE_COUNT) ? trace_event_names[event.type] : "unknown";
+			if (event.duration_ns > 0) {
+				std::fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"readback\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"event_id\":%d,\"value\":%lld}}",
+					name, event.timestamp_ns / 1000.0, event.duration_ns / 1000.0, ring->thread_index, event.event_id, (long long)event.value);
+			}
+			else {
+				std::fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"readback\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"event_id\":%d,\"value\":%lld}}",
+					name, event.timestamp_ns / 1000.0, ring->thread_index, event.event_id, (long long)event.value);
+			}
+			count++;
+		}
+	}
+	std::fprintf(out, "\n]}\n");
+	std::fclose(out);
+	return count;
+}
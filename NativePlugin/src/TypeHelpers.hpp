@@ -1,3 +1,4 @@
+#pragma once
 
 // Opengl includes
 #define GL_GLEXT_PROTOTYPES
@@ -248,4 +249,49 @@ inline int getTypeFromInternalFormat(int internalFormat)
 			return GL_INT;
 	}
 	return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Get the size of a pixel read back with the given format and type
+ * 
+ * @param format Format given by getFormatFromInternalFormat
+ * @param type Type given by getTypeFromInternalFormat
+ * @return int The size of the pixel in number of bytes. 0 if not found
+ */
+inline int getPixelSizeFromFormatAndType(int format, int type)
+{
+	int components = 0;
+	switch(format) {
+		case GL_RED:
+		case GL_RED_INTEGER:
+			components = 1;
+			break;
+		case GL_RG:
+		case GL_RG_INTEGER:
+			components = 2;
+			break;
+		case GL_RGB:
+		case GL_RGB_INTEGER:
+			components = 3;
+			break;
+		case GL_RGBA:
+		case GL_RGBA_INTEGER:
+			components = 4;
+			break;
+	}
+
+	switch(type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			return components;
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			return components * 2;
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			return components * 4;
+	}
+	return 0;
+}
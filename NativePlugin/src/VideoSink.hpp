@@ -0,0 +1,358 @@
+#pragma once
+// Optional sink encoding completed readbacks to a video file, on its own thread
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <signal.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ColorConversion.hpp"
+#include "BufferAllocator.hpp"
+
+enum VideoEncoderType {
+	// libx264 in an MP4 (or any container ffmpeg guesses from the path), through an ffmpeg process
+	VIDEO_ENCODER_FFMPEG = 0,
+	// Raw NV12 frames, one after the other
+	VIDEO_ENCODER_RAW_NV12 = 1
+};
+
+/**
+ * Video sink counters, also read by the managed plugin (keep it blittable)
+ */
+struct VideoSinkStats {
+	int64_t frames_captured;
+	int64_t frames_encoded;
+	// Frames dropped because the encoder was late
+	int64_t frames_dropped;
+	int64_t errors;
+};
+
+/**
+ * Encoder of NV12 frames. Only called from the sink thread, frames come
+ * in order at the sink frame rate.
+ */
+class VideoEncoder {
+public:
+	virtual ~VideoEncoder() {}
+	virtual bool open(int width, int height) = 0;
+	virtual bool encode(const uint8_t* nv12, size_t size) = 0;
+	virtual bool close() = 0;
+};
+
+/**
+ * Software encoder piping the frames to an ffmpeg process (libx264 by default).
+ * ffmpeg is started without a shell: the options are split on whitespace into its arguments.
+ */
+class FFmpegPipeEncoder : public VideoEncoder {
+public:
+	FFmpegPipeEncoder(const std::string& path, int fps, const std::string& options)
+		: path(path), fps(fps), options(options.empty() ? "-c:v libx264 -preset veryfast -crf 20 -pix_fmt yuv420p" : options) {
+	}
+
+	bool open(int width, int height) {
+		char size[32], rate[16];
+		std::snprintf(size, sizeof(size), "%dx%d", width, height);
+		std::snprintf(rate, sizeof(rate), "%d", fps);
+		std::vector<std::string> arguments = { "ffmpeg", "-loglevel", "error", "-y",
+			"-f", "rawvideo", "-pix_fmt", "nv12", "-s", size, "-r", rate, "-i", "-" };
+		size_t start = options.find_first_not_of(" \t\r\n");
+		while (start != std::string::npos) {
+			size_t end = options.find_first_of(" \t\r\n", start);
+			arguments.push_back(options.substr(start, end - start));
+			start = options.find_first_not_of(" \t\r\n", end);
+		}
+		arguments.push_back(path);
+		std::vector<char*> argv;
+		for (size_t i = 0; i < arguments.size(); i++) {
+			argv.push_back(&arguments[i][0]);
+		}
+		argv.push_back(NULL);
+
+		// Only the read end goes to ffmpeg, as its stdin
+		int fds[2];
+		if (::pipe(fds) != 0) {
+			return false;
+		}
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+		int spawned = posix_spawnp(&pid, "ffmpeg", &actions, NULL, argv.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		::close(fds[0]);
+		if (spawned != 0) {
+			pid = -1;
+			::close(fds[1]);
+			return false;
+		}
+		pipe = fdopen(fds[1], "w");
+		if (pipe == NULL) {
+			::close(fds[1]);
+			waitpid(pid, NULL, 0);
+			pid = -1;
+			return false;
+		}
+		return true;
+	}
+
+	bool encode(const uint8_t* nv12, size_t size) {
+		return std::fwrite(nv12, 1, size, pipe) == size;
+	}
+
+	bool close() {
+		if (pipe == NULL) {
+			return true;
+		}
+		// ffmpeg finishes the file once its stdin is closed
+		bool ok = std::fclose(pipe) == 0;
+		pipe = NULL;
+		int status = 0;
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+		pid = -1;
+		return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+private:
+	std::string path;
+	int fps;
+	std::string options;
+	FILE* pipe = NULL;
+	pid_t pid = -1;
+};
+
+/**
+ * Writes the raw NV12 frames, e.g. for a later encoding or for tests
+ */
+class RawNv12Encoder : public VideoEncoder {
+public:
+	explicit RawNv12Encoder(const std::string& path) : path(path) {
+	}
+
+	bool open(int width, int height) {
+		file = std::fopen(path.c_str(), "wb");
+		return file != NULL;
+	}
+
+	bool encode(const uint8_t* nv12, size_t size) {
+		return std::fwrite(nv12, 1, size, file) == size;
+	}
+
+	bool close() {
+		if (file == NULL) {
+			return true;
+		}
+		bool ok = std::fclose(file) == 0;
+		file = NULL;
+		return ok;
+	}
+
+private:
+	std::string path;
+	FILE* file = NULL;
+};
+
+/**
+ * Converts the frames pushed by the readback to NV12 and hands them to its encoder thread.
+ * The encoder is opened with the size of the first frame (rounded down to even),
+ * frames of another size are counted as errors.
+ */
+class VideoSink {
+public:
+	VideoSink(VideoEncoder* encoder, int max_queued) : encoder(encoder), max_queued(max_queued) {
+		thread = std::thread(&VideoSink::threadMain, this);
+	}
+
+	~VideoSink() {
+		stop();
+	}
+
+	/**
+	 * @brief Convert and queue a frame. Called from the thread completing the readback
+	 * @param rgba RGBA8 pixels, bottom-up as read by OpenGL
+	 */
+	void pushFrame(const uint8_t* rgba, int rgba_width, int rgba_height) {
+		int frame_width = rgba_width & ~1;
+		int frame_height = rgba_height & ~1;
+		Frame frame;
+		if (!allocateFrame(frame_width, frame_height, frame)) {
+			return;
+		}
+		size_t y_size = (size_t)frame_width * frame_height;
+		rgbaToNv12(rgba, (size_t)rgba_width * 4, frame_width, frame_height, true,
+			frame.data, frame_width, frame.data + y_size, frame_width);
+		queueFrame(frame);
+	}
+
+	/**
+	 * @brief Queue a frame already converted to NV12 on the GPU. Called from the thread completing the readback
+	 * @param nv12 NV12 planes of an even size, bottom-up rows as read by OpenGL
+	 */
+	void pushNv12Frame(const uint8_t* nv12, int frame_width, int frame_height) {
+		Frame frame;
+		if (!allocateFrame(frame_width, frame_height, frame)) {
+			return;
+		}
+		// Only flip the rows of both planes
+		size_t y_size = (size_t)frame_width * frame_height;
+		for (int row = 0; row < frame_height; row++) {
+			std::memcpy(frame.data + row * (size_t)frame_width, nv12 + (frame_height - 1 - row) * (size_t)frame_width, frame_width);
+		}
+		for (int row = 0; row < frame_height / 2; row++) {
+			std::memcpy(frame.data + y_size + row * (size_t)frame_width,
+				nv12 + y_size + (frame_height / 2 - 1 - row) * (size_t)frame_width, frame_width);
+		}
+		queueFrame(frame);
+	}
+
+	/**
+	 * @brief Count a frame that could not be captured
+	 */
+	void dropFrame() {
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.frames_captured++;
+		stats.frames_dropped++;
+	}
+
+	/**
+	 * @brief Count a frame of a texture that can't be captured
+	 */
+	void failFrame() {
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.frames_captured++;
+		stats.errors++;
+	}
+
+	/**
+	 * @brief Encode the queued frames, then close the encoder
+	 */
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+			condition.notify_one();
+		}
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	VideoSinkStats getStats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	struct Frame {
+		uint8_t* data;
+		size_t size;
+	};
+
+	/**
+	 * @brief Count a pushed frame, and get its buffer unless it is dropped
+	 */
+	bool allocateFrame(int frame_width, int frame_height, Frame& frame) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.frames_captured++;
+			if (!running || frame_width == 0 || frame_height == 0
+				|| (width != 0 && (frame_width != width || frame_height != height))) {
+				stats.errors++;
+				return false;
+			}
+			width = frame_width;
+			height = frame_height;
+			if ((int)queue.size() >= max_queued) {
+				stats.frames_dropped++;
+				return false;
+			}
+		}
+
+		size_t y_size = (size_t)frame_width * frame_height;
+		frame.size = y_size + y_size / 2;
+		frame.data = (uint8_t*)bufferAllocate(frame.size);
+		if (frame.data == NULL) {
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.errors++;
+			return false;
+		}
+		return true;
+	}
+
+	void queueFrame(const Frame& frame) {
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(frame);
+		condition.notify_one();
+	}
+
+	void threadMain() {
+		// A dead ffmpeg must make the writes fail, not kill the application
+		sigset_t sigpipe;
+		sigemptyset(&sigpipe);
+		sigaddset(&sigpipe, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+
+		bool opened = false;
+		bool failed = false;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [this] { return !queue.empty() || !running; });
+			if (queue.empty()) {
+				break;
+			}
+			Frame frame = queue.front();
+			queue.pop_front();
+			int frame_width = width;
+			int frame_height = height;
+			lock.unlock();
+
+			if (!opened && !failed) {
+				opened = encoder->open(frame_width, frame_height);
+				failed = !opened;
+			}
+			bool encoded = opened && encoder->encode(frame.data, frame.size);
+			bufferRelease(frame.data);
+
+			lock.lock();
+			if (encoded) {
+				stats.frames_encoded++;
+			}
+			else {
+				stats.errors++;
+			}
+		}
+		lock.unlock();
+
+		if (opened && !encoder->close()) {
+			std::lock_guard<std::mutex> error_lock(mutex);
+			stats.errors++;
+		}
+	}
+
+	std::unique_ptr<VideoEncoder> encoder;
+	int max_queued;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<Frame> queue;
+	std::thread thread;
+	bool running = true;
+	int width = 0;
+	int height = 0;
+	VideoSinkStats stats = {};
+};
@@ -0,0 +1,160 @@
+#pragma once
+// GPU conversion of a texture to YUV 4:2:0 (BT.601, limited range) with a compute shader,
+// so that only 1.5 bytes per pixel are read back
+#include <map>
+#include <utility>
+#include "ComputePass.hpp"
+
+enum YuvFormat {
+	YUV_FORMAT_NONE = 0,
+	// Y plane, then interleaved UV plane
+	YUV_FORMAT_NV12 = 1,
+	// Y plane, then U plane, then V plane
+	YUV_FORMAT_I420 = 2
+};
+
+/**
+ * One invocation per 2x2 block. The planes are written in an R8 texture of
+ * width x (height * 3 / 2) texels, the chroma planes one after the other as
+ * in memory, so that reading the texture back gives the packed layout.
+ */
+static const char* yuv_compute_source =
+	"#version 430\n"
+	"layout(local_size_x = 8, local_size_y = 8) in;\n"
+	"uniform sampler2D source;\n"
+	"layout(r8) uniform writeonly image2D planes;\n"
+	"uniform ivec2 origin;\n"
+	"uniform ivec2 size;\n"
+	"uniform int miplevel;\n"
+	"uniform int i420;\n"
+	"uniform int srgb;\n"
+	"vec3 fetch(ivec2 p) {\n"
+	"	vec3 c = clamp(texelFetch(source, origin + p, miplevel).rgb, 0.0, 1.0);\n"
+	"	// Same values as a read of the texture: sRGB encoded\n"
+	"	if (srgb != 0) {\n"
+	"		c = mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), c));\n"
+	"	}\n"
+	"	return c * 255.0;\n"
+	"}\n"
+	"float luma(vec3 c) {\n"
+	"	return (16.0 + dot(c, vec3(66.0, 129.0, 25.0) / 256.0)) / 255.0;\n"
+	"}\n"
+	"void storeChroma(int offset, float value) {\n"
+	"	imageStore(planes, ivec2(offset % size.x, size.y + offset / size.x), vec4(value));\n"
+	"}\n"
+	"void main() {\n"
+	"	ivec2 block = ivec2(gl_GlobalInvocationID.xy);\n"
+	"	if (block.x * 2 >= size.x || block.y * 2 >= size.y) {\n"
+	"		return;\n"
+	"	}\n"
+	"	ivec2 p = block * 2;\n"
+	"	vec3 c00 = fetch(p);\n"
+	"	vec3 c10 = fetch(p + ivec2(1, 0));\n"
+	"	vec3 c01 = fetch(p + ivec2(0, 1));\n"
+	"	vec3 c11 = fetch(p + ivec2(1, 1));\n"
+	"	imageStore(planes, p, vec4(luma(c00)));\n"
+	"	imageStore(planes, p + ivec2(1, 0), vec4(luma(c10)));\n"
+	"	imageStore(planes, p + ivec2(0, 1), vec4(luma(c01)));\n"
+	"	imageStore(planes, p + ivec2(1, 1), vec4(luma(c11)));\n"
+	"	vec3 c = (c00 + c10 + c01 + c11) * 0.25;\n"
+	"	float u = (128.0 + dot(c, vec3(-38.0, -74.0, 112.0) / 256.0)) / 255.0;\n"
+	"	float v = (128.0 + dot(c, vec3(112.0, -94.0, -18.0) / 256.0)) / 255.0;\n"
+	"	if (i420 != 0) {\n"
+	"		int offset = block.y * (size.x / 2) + block.x;\n"
+	"		storeChroma(offset, u);\n"
+	"		storeChroma(size.x * size.y / 4 + offset, v);\n"
+	"	}\n"
+	"	else {\n"
+	"		int offset = block.y * size.x + block.x * 2;\n"
+	"		storeChroma(offset, u);\n"
+	"		storeChroma(offset + 1, v);\n"
+	"	}\n"
+	"}\n";
+
+static GLuint yuv_program = 0;
+static bool yuv_program_failed = false;
+static GLuint yuv_samplers[2] = { 0, 0 };
+// Planes texture per size. The read is queued right after the conversion,
+// so the next conversion can reuse the same texture.
+static std::map<std::pair<int,int>,GLuint> yuv_textures;
+
+/**
+ * @brief Build the conversion program once. Has to be called from the render thread
+ * @return false if compute shaders are not supported
+ */
+inline bool yuvProgramReady() {
+	if (yuv_program != 0 || yuv_program_failed) {
+		return yuv_program != 0;
+	}
+	yuv_program_failed = true;
+	if (!hasComputeShaders()) {
+		return false;
+	}
+	yuv_program = buildComputeProgram(yuv_compute_source);
+	if (yuv_program == 0) {
+		return false;
+	}
+	createNearestSamplers(yuv_samplers);
+	yuv_program_failed = false;
+	return true;
+}
+
+/**
+ * @brief Convert a region of a texture level to YUV planes. Unity's GL state
+ * touched by the pass is restored (see ComputeStateGuard).
+ * Has to be called from the render thread
+ * @param width Width of the region, even
+ * @param height Height of the region, even
+ * @param srgb The texture is sRGB: convert its encoded values, not the linear ones
+ * @return R8 texture of width x (height * 3 / 2) holding the planes, 0 on error
+ */
+inline GLuint convertToYuv(GLuint texture, int miplevel, int x, int y, int width, int height, YuvFormat format, bool srgb) {
+	if (!yuvProgramReady()) {
+		return 0;
+	}
+
+	GLuint& planes = yuv_textures[std::make_pair(width, height)];
+	if (planes == 0) {
+		GLint previous = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+		glGenTextures(1, &planes);
+		glBindTexture(GL_TEXTURE_2D, planes);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, width, height * 3 / 2);
+		glBindTexture(GL_TEXTURE_2D, previous);
+	}
+
+	// Restores the state the pass changes
+	ComputeStateGuard state;
+
+	glUseProgram(yuv_program);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindSampler(0, yuv_samplers[miplevel > 0 ? 1 : 0]);
+	glBindImageTexture(0, planes, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+	glUniform1i(glGetUniformLocation(yuv_program, "source"), 0);
+	glUniform1i(glGetUniformLocation(yuv_program, "planes"), 0);
+	glUniform2i(glGetUniformLocation(yuv_program, "origin"), x, y);
+	glUniform2i(glGetUniformLocation(yuv_program, "size"), width, height);
+	glUniform1i(glGetUniformLocation(yuv_program, "miplevel"), miplevel);
+	glUniform1i(glGetUniformLocation(yuv_program, "i420"), format == YUV_FORMAT_I420);
+	glUniform1i(glGetUniformLocation(yuv_program, "srgb"), srgb);
+	glDispatchCompute((width / 2 + 7) / 8, (height / 2 + 7) / 8, 1);
+	// The planes are read back right after
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+	return planes;
+}
+
+/**
+ * @brief Delete the program and the planes textures. Has to be called from the render thread
+ */
+inline void clearYuvResources() {
+	for (std::map<std::pair<int,int>,GLuint>::iterator it = yuv_textures.begin(); it != yuv_textures.end(); ++it) {
+		glDeleteTextures(1, &(it->second));
+	}
+	yuv_textures.clear();
+	if (yuv_program != 0) {
+		glDeleteProgram(yuv_program);
+		glDeleteSamplers(2, yuv_samplers);
+	}
+	yuv_program = 0;
+	yuv_program_failed = false;
+}